@@ -1,22 +1,75 @@
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 CONFIG += c++17
 
+# PngEncoder 直接使用 zlib 的 raw deflate 與 adler32_combine；
+# RowDecoder 以 libpng、libtiff、libjpeg 逐列解碼（zlib 放最後，靜態連結時 libpng 與 libtiff 會用到）
+LIBS += -lpng -ltiff -ljpeg -lz
+
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    batchprocessor.cpp \
+    framescheduler.cpp \
+    histogramengine.cpp \
+    imagegraph.cpp \
+    imagecanvas.cpp \
+    imageloader.cpp \
+    imagepyramid.cpp \
+    imagesaver.cpp \
+    imagestore.cpp \
     imagetransform.cpp \
+    imageviewport.cpp \
+    inputlatency.cpp \
+    lumaplane.cpp \
     main.cpp \
+    mirrorengine.cpp \
+    pngencoder.cpp \
+    resampler.cpp \
+    rowdecoder.cpp \
+    sparselayer.cpp \
+    strokeengine.cpp \
     imageprocessor.cpp \
+    tiledimagestore.cpp \
+    tilehistory.cpp \
+    traceoverlay.cpp \
+    tracer.cpp \
+    warpengine.cpp \
     zoomwindow.cpp
 
 HEADERS += \
+    batchprocessor.h \
+    framescheduler.h \
+    histogramengine.h \
+    imagegraph.h \
+    imagecanvas.h \
+    imageloader.h \
+    imagepyramid.h \
+    imagesaver.h \
+    imagestore.h \
     imageprocessor.h \
     imagetransform.h \
+    imageviewport.h \
+    inputlatency.h \
+    lumaplane.h \
+    mirrorengine.h \
+    parallelfor.h \
+    pixelformats.h \
+    pngencoder.h \
+    resampler.h \
+    rowdecoder.h \
+    simdsupport.h \
+    sparselayer.h \
+    strokeengine.h \
+    tiledimagestore.h \
+    tilehistory.h \
+    traceoverlay.h \
+    tracer.h \
+    warpengine.h \
     zoomwindow.h
 
 # Default rules for deployment.
@@ -0,0 +1,34 @@
+# 效能基準測試：量測程式實際用到的各項像素運算，輸出 JSON 供追蹤效能退步
+# 建置：qmake ImageProcessorBench.pro && make
+# 執行：ImageProcessorBench --output bench.json [--sizes 1,12] [--formats RGB32,Grayscale8]
+
+QT       += core gui concurrent
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = ImageProcessorBench
+INCLUDEPATH += $$PWD
+LIBS += -lz
+
+SOURCES += \
+    bench/imagebench.cpp \
+    imagegraph.cpp \
+    imagepyramid.cpp \
+    mirrorengine.cpp \
+    pngencoder.cpp \
+    resampler.cpp \
+    tracer.cpp \
+    warpengine.cpp
+
+HEADERS += \
+    imagegraph.h \
+    imagepyramid.h \
+    mirrorengine.h \
+    parallelfor.h \
+    pixelformats.h \
+    pngencoder.h \
+    resampler.h \
+    simdsupport.h \
+    tracer.h \
+    warpengine.h
@@ -0,0 +1,258 @@
+#include "batchprocessor.h"
+#include "imagetransform.h"
+#include "pixelformats.h"
+#include "tracer.h"
+#include "tiledimagestore.h"
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QImageReader>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QFuture>
+#include <QtConcurrent/QtConcurrentRun>
+#include <cstring>
+
+namespace {
+
+// 單一檔案的處理結果
+struct FileResult
+{
+    QString name;
+    QSize   size;
+    qint64  loadMs = 0;
+    qint64  processMs = 0;
+    qint64  saveMs = 0;
+    bool    ok = false;
+    QString error;
+};
+
+QMutex outputMutex;     // 工作執行緒同時輸出時避免訊息交錯
+
+void printLine(const QString &line, bool error = false)
+{
+    QMutexLocker locker(&outputMutex);
+    QTextStream stream(error ? stderr : stdout);
+    stream << line << Qt::endl;
+}
+
+FileResult processFile(const QString &inputPath, const BatchProcessor::Options &options)
+{
+    TRACE_SCOPE("BatchProcessor::processFile");
+    FileResult result;
+    const QFileInfo info(inputPath);
+    result.name = info.fileName();
+
+    const QString suffix = options.format.isEmpty() ? info.suffix() : options.format;
+    const QString outputPath = QDir(options.outputDir).filePath(info.completeBaseName() + "." + suffix);
+    const bool tiledOutput = suffix.compare(QLatin1String("iptiles"), Qt::CaseInsensitive) == 0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // 純轉檔成分塊格式時不必整張載入，交給 TiledImageStore 逐段解碼
+    if (tiledOutput && !options.mirrorH && !options.mirrorV && !options.rotate && options.scale == 1.0)
+    {
+        QString error;
+        if (!TiledImageStore::convert(inputPath, outputPath, TiledImageStore::DefaultTileSize, &error))
+        {
+            result.error = QStringLiteral("無法轉換 ") + error;
+            return result;
+        }
+        result.size = QImageReader(inputPath).size();
+        result.saveMs = timer.elapsed();
+        result.ok = true;
+        return result;
+    }
+
+    QImage image;
+    if (!image.load(inputPath))
+    {
+        result.error = QStringLiteral("無法讀取");
+        return result;
+    }
+    image = PixelFormats::normalized(image);
+    result.size = image.size();
+    result.loadMs = timer.restart();
+
+    const QImage output = BatchProcessor::apply(image, options);
+    result.processMs = timer.restart();
+    if (output.isNull())
+    {
+        result.error = QStringLiteral("處理失敗");
+        return result;
+    }
+
+    const bool saved = tiledOutput ? TiledImageStore::save(output, outputPath) : output.save(outputPath);
+    if (!saved)
+    {
+        result.error = QStringLiteral("無法寫入 ") + outputPath;
+        return result;
+    }
+    result.saveMs = timer.elapsed();
+    result.ok = true;
+    return result;
+}
+
+}
+
+bool BatchProcessor::isBatchInvocation(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--batch") == 0)
+            return true;
+    }
+    return false;
+}
+
+QImage BatchProcessor::apply(const QImage &image, const Options &options)
+{
+    // 鏡射、旋轉、縮放合成一個矩陣，整條只取樣一次，不產生中間影像
+    ImageGraph graph = ImageTransform::transformGraph(image, options.mirrorH, options.mirrorV,
+                                                      options.rotate ? options.angle : 0);
+    if (options.scale != 1.0)
+    {
+        // 四捨五入且至少 1 像素，小圖以小倍率縮小時不會得到空影像
+        const QSize size = graph.size();
+        graph = graph.scaled(QSize(qMax(1, qRound(size.width() * options.scale)),
+                                   qMax(1, qRound(size.height() * options.scale))));
+    }
+    else
+    {
+        graph = graph.withFilter(Resampler::Nearest);  // 只有旋轉時與視窗中的旋鈕結果相同
+    }
+    return graph.render();
+}
+
+int BatchProcessor::run(const QStringList &arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("影像批次處理：依序套用鏡射、旋轉、縮放"));
+    parser.addHelpOption();
+    const QCommandLineOption batchOption("batch", QStringLiteral("批次模式，不開啟視窗"));
+    const QCommandLineOption mirrorOption("mirror", QStringLiteral("鏡射方向：h、v 或 hv"), "direction");
+    const QCommandLineOption rotateOption("rotate", QStringLiteral("旋轉角度"), "degrees");
+    const QCommandLineOption scaleOption("scale", QStringLiteral("縮放倍率"), "factor");
+    const QCommandLineOption formatOption("format", QStringLiteral("輸出格式（如 png、jpg；iptiles 為分塊檔），預設沿用輸入檔"), "suffix");
+    const QCommandLineOption jobsOption("jobs", QStringLiteral("同時處理的檔案數，預設為 CPU 核心數"), "count");
+    parser.addOptions({ batchOption, mirrorOption, rotateOption, scaleOption, formatOption, jobsOption });
+    parser.addPositionalArgument("in_dir", QStringLiteral("輸入資料夾"));
+    parser.addPositionalArgument("out_dir", QStringLiteral("輸出資料夾"));
+    parser.process(arguments);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.size() != 2)
+    {
+        printLine(QStringLiteral("需要輸入與輸出資料夾") + "\n" + parser.helpText(), true);
+        return 2;
+    }
+
+    Options options;
+    options.inputDir = positional.at(0);
+    options.outputDir = positional.at(1);
+    if (parser.isSet(mirrorOption))
+    {
+        const QString direction = parser.value(mirrorOption).toLower();
+        options.mirrorH = direction.contains('h');
+        options.mirrorV = direction.contains('v');
+        if (!options.mirrorH && !options.mirrorV)
+        {
+            printLine(QStringLiteral("--mirror 只接受 h、v 或 hv"), true);
+            return 2;
+        }
+    }
+    bool ok = true;
+    if (parser.isSet(rotateOption))
+    {
+        options.rotate = true;
+        options.angle = parser.value(rotateOption).toInt(&ok);
+        if (!ok)
+        {
+            printLine(QStringLiteral("--rotate 需要整數角度"), true);
+            return 2;
+        }
+    }
+    if (parser.isSet(scaleOption))
+    {
+        options.scale = parser.value(scaleOption).toDouble(&ok);
+        if (!ok || options.scale <= 0)
+        {
+            printLine(QStringLiteral("--scale 需要大於 0 的倍率"), true);
+            return 2;
+        }
+    }
+    options.format = parser.value(formatOption);
+    if (parser.isSet(jobsOption))
+        options.jobs = parser.value(jobsOption).toInt();
+    if (options.jobs <= 0)
+        options.jobs = QThread::idealThreadCount();
+
+    // 收集輸入資料夾中 Qt 讀得懂的影像檔
+    QStringList nameFilters;
+    for (const QByteArray &format : QImageReader::supportedImageFormats())
+        nameFilters << "*." + QString::fromLatin1(format);
+    const QDir inputDir(options.inputDir);
+    if (!inputDir.exists())
+    {
+        printLine(QStringLiteral("找不到輸入資料夾 ") + options.inputDir, true);
+        return 2;
+    }
+    if (!QDir().mkpath(options.outputDir))
+    {
+        printLine(QStringLiteral("無法建立輸出資料夾 ") + options.outputDir, true);
+        return 2;
+    }
+    const QStringList files = inputDir.entryList(nameFilters, QDir::Files | QDir::Readable, QDir::Name);
+    if (files.isEmpty())
+    {
+        printLine(QStringLiteral("輸入資料夾中沒有影像檔"));
+        return 0;
+    }
+
+    // 有上限的執行緒池：同時最多 jobs 個檔案在記憶體中
+    QThreadPool pool;
+    pool.setMaxThreadCount(options.jobs);
+
+    QElapsedTimer wallClock;
+    wallClock.start();
+    QList<QFuture<FileResult>> futures;
+    for (const QString &file : files)
+        futures.append(QtConcurrent::run(&pool, processFile, inputDir.filePath(file), options));
+
+    int succeeded = 0;
+    int failed = 0;
+    double megapixels = 0;
+    for (QFuture<FileResult> &future : futures)
+    {
+        const FileResult result = future.result();
+        if (result.ok)
+        {
+            ++succeeded;
+            megapixels += double(result.size.width()) * result.size.height() / 1e6;
+            printLine(QString("%1\t%2x%3\tload %4 ms\tprocess %5 ms\tsave %6 ms\ttotal %7 ms")
+                          .arg(result.name)
+                          .arg(result.size.width()).arg(result.size.height())
+                          .arg(result.loadMs).arg(result.processMs).arg(result.saveMs)
+                          .arg(result.loadMs + result.processMs + result.saveMs));
+        }
+        else
+        {
+            ++failed;
+            printLine(result.name + "\t" + result.error, true);
+        }
+    }
+
+    const double seconds = qMax<qint64>(1, wallClock.elapsed()) / 1000.0;
+    printLine(QString("%1 images (%2 failed) in %3 s with %4 jobs: %5 images/s, %6 MP/s")
+                  .arg(succeeded).arg(failed)
+                  .arg(seconds, 0, 'f', 2)
+                  .arg(options.jobs)
+                  .arg(succeeded / seconds, 0, 'f', 2)
+                  .arg(megapixels / seconds, 0, 'f', 1));
+    return failed == 0 ? 0 : 1;
+}
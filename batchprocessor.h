@@ -0,0 +1,36 @@
+#ifndef BATCHPROCESSOR_H
+#define BATCHPROCESSOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QImage>
+
+// 命令列批次模式：不建立任何視窗，把資料夾內的影像依序做鏡射、旋轉、縮放後存到輸出資料夾
+// 例如：ImageProcessor --batch in_dir out_dir --mirror h --rotate 90 --scale 0.5
+class BatchProcessor
+{
+public:
+    struct Options
+    {
+        QString inputDir;
+        QString outputDir;
+        bool    mirrorH = false;
+        bool    mirrorV = false;
+        bool    rotate = false;
+        int     angle = 0;
+        double  scale = 1.0;
+        QString format;         // 輸出格式（副檔名），空字串代表沿用輸入檔
+        int     jobs = 0;       // 同時處理的檔案數，0 代表 CPU 核心數
+    };
+
+    // 命令列中是否有 --batch，用來決定要不要建立 GUI
+    static bool isBatchInvocation(int argc, char *argv[]);
+
+    // 解析參數並執行，回傳程式結束碼
+    static int run(const QStringList &arguments);
+
+    // 對單張影像依序套用鏡射、旋轉、縮放，與 GUI 使用相同的運算
+    static QImage apply(const QImage &image, const Options &options);
+};
+
+#endif // BATCHPROCESSOR_H
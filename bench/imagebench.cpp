@@ -0,0 +1,356 @@
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QBuffer>
+#include <QFile>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPixmap>
+#include <QRandomGenerator>
+#include <QSysInfo>
+#include <QTextStream>
+#include <QThread>
+#include <QTransform>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include "imagegraph.h"
+#include "imagepyramid.h"
+#include "mirrorengine.h"
+#include "pixelformats.h"
+#include "pngencoder.h"
+#include "resampler.h"
+#include "simdsupport.h"
+#include "warpengine.h"
+
+namespace {
+
+// 受測的影像格式（名稱用於命令列與 JSON）
+struct FormatEntry
+{
+    const char *name;
+    QImage::Format format;
+};
+
+const FormatEntry AllFormats[] = {
+    { "Grayscale8",             QImage::Format_Grayscale8 },
+    { "Grayscale16",            QImage::Format_Grayscale16 },
+    { "Indexed8",               QImage::Format_Indexed8 },
+    { "RGB888",                 QImage::Format_RGB888 },
+    { "RGB32",                  QImage::Format_RGB32 },
+    { "ARGB32",                 QImage::Format_ARGB32 },
+    { "ARGB32_Premultiplied",   QImage::Format_ARGB32_Premultiplied },
+    { "RGBX8888",               QImage::Format_RGBX8888 },
+    { "RGBA8888",               QImage::Format_RGBA8888 },
+    { "RGBA8888_Premultiplied", QImage::Format_RGBA8888_Premultiplied },
+    { "RGBA64",                 QImage::Format_RGBA64 },
+};
+
+// 百萬像素數 -> 4:3 的寬高
+QSize sizeForMegapixels(double megapixels)
+{
+    const int height = qRound(std::sqrt(megapixels * 1e6 * 3.0 / 4.0));
+    return QSize(qRound(height * 4.0 / 3.0), height);
+}
+
+// 有梯度與雜訊的測試影像，避免全平的內容讓壓縮或分支預測失真
+QImage makeTestImage(const QSize &size, QImage::Format format)
+{
+    QImage image(size, QImage::Format_ARGB32);
+    QRandomGenerator random(12345);
+    for (int y = 0; y < size.height(); ++y)
+    {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < size.width(); ++x)
+        {
+            const int noise = int(random.bounded(32));
+            line[x] = qRgba((x * 255 / size.width() + noise) & 0xff,
+                            (y * 255 / size.height() + noise) & 0xff,
+                            ((x + y) & 0xff) ^ noise,
+                            200 + noise);
+        }
+    }
+    return format == QImage::Format_Indexed8
+               ? image.convertToFormat(format, Qt::ThresholdDither | Qt::AvoidDither)
+               : image.convertToFormat(format);
+}
+
+struct Measurement
+{
+    double minMs = 0;
+    double medianMs = 0;
+    double meanMs = 0;
+};
+
+// 先暖身一次，再量 iterations 次
+Measurement measure(int iterations, const std::function<void()> &operation)
+{
+    operation();
+    QVector<double> samples;
+    for (int i = 0; i < iterations; ++i)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        operation();
+        samples.append(timer.nsecsElapsed() / 1e6);
+    }
+    std::sort(samples.begin(), samples.end());
+    Measurement m;
+    m.minMs = samples.first();
+    m.medianMs = samples.at(samples.size() / 2);
+    double total = 0;
+    for (double sample : samples)
+        total += sample;
+    m.meanMs = total / samples.size();
+    return m;
+}
+
+// 避免編譯器把結果當成沒用到而整段省略
+volatile qint64 sink = 0;
+
+void consume(const QImage &image)
+{
+    sink = sink + image.cacheKey() + image.width();
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    // QPixmap 需要 QGuiApplication；沒有指定平台時用 offscreen，可在無顯示器的機器上執行
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("ImageProcessor 像素運算效能基準"));
+    parser.addHelpOption();
+    const QCommandLineOption sizesOption("sizes", QStringLiteral("百萬像素清單，預設 1,12,40,100"), "list", "1,12,40,100");
+    const QCommandLineOption formatsOption("formats", QStringLiteral("格式清單，預設全部"), "list");
+    const QCommandLineOption opsOption("ops", QStringLiteral("只執行名稱包含這些字串的運算"), "list");
+    const QCommandLineOption iterationsOption("iterations", QStringLiteral("每項量測次數，預設 3"), "count", "3");
+    const QCommandLineOption outputOption("output", QStringLiteral("JSON 輸出檔，預設輸出到 stdout"), "file");
+    parser.addOptions({ sizesOption, formatsOption, opsOption, iterationsOption, outputOption });
+    parser.process(app);
+
+    const int iterations = qMax(1, parser.value(iterationsOption).toInt());
+    const QStringList sizeList = parser.value(sizesOption).split(',', Qt::SkipEmptyParts);
+    const QStringList formatFilter = parser.value(formatsOption).split(',', Qt::SkipEmptyParts);
+    const QStringList opsFilter = parser.value(opsOption).split(',', Qt::SkipEmptyParts);
+    QTextStream err(stderr);
+
+    QJsonArray results;
+    for (const QString &sizeText : sizeList)
+    {
+        const double megapixels = sizeText.toDouble();
+        const QSize size = sizeForMegapixels(megapixels);
+        for (const FormatEntry &entry : AllFormats)
+        {
+            if (!formatFilter.isEmpty() && !formatFilter.contains(QLatin1String(entry.name)))
+                continue;
+            const QImage image = makeTestImage(size, entry.format);
+            if (image.isNull())
+            {
+                err << "skip " << entry.name << " " << megapixels << " MP: out of memory" << Qt::endl;
+                continue;
+            }
+
+            // 選取區域：影像中央 1/4 面積，與放大視窗的典型用法相近
+            const QRect selection(size.width() / 4, size.height() / 4, size.width() / 2, size.height() / 2);
+
+            auto run = [&](const QString &op, double workMegapixels, qint64 items, const std::function<void()> &operation) {
+                if (!opsFilter.isEmpty() &&
+                    std::none_of(opsFilter.begin(), opsFilter.end(), [&](const QString &f) { return op.contains(f); }))
+                    return;
+                const Measurement m = measure(iterations, operation);
+                QJsonObject row;
+                row["op"] = op;
+                row["format"] = QLatin1String(entry.name);
+                row["megapixels"] = megapixels;
+                row["width"] = size.width();
+                row["height"] = size.height();
+                row["iterations"] = iterations;
+                row["min_ms"] = m.minMs;
+                row["median_ms"] = m.medianMs;
+                row["mean_ms"] = m.meanMs;
+                row["mpix_per_s"] = m.minMs > 0 ? workMegapixels / (m.minMs / 1000.0) : 0.0;
+                if (items > 0)
+                    row["ns_per_item"] = m.minMs * 1e6 / items;
+                results.append(row);
+                err << op << " " << entry.name << " " << megapixels << " MP: " << m.minMs << " ms" << Qt::endl;
+            };
+
+            const double mp = double(size.width()) * size.height() / 1e6;
+
+            // ImageTransform::mirroredImage
+            run("mirrored_h", mp, 0, [&]() { consume(image.mirrored(true, false)); });
+            run("mirrored_v", mp, 0, [&]() { consume(image.mirrored(false, true)); });
+            run("mirrored_hv", mp, 0, [&]() { consume(image.mirrored(true, true)); });
+            QImage mirrorTarget;
+            run("mirror_engine_h_reuse", mp, 0, [&]() { MirrorEngine::mirror(image, mirrorTarget, true, false); });
+            run("mirror_engine_v_reuse", mp, 0, [&]() { MirrorEngine::mirror(image, mirrorTarget, false, true); });
+            run("mirror_engine_hv_reuse", mp, 0, [&]() { MirrorEngine::mirror(image, mirrorTarget, true, true); });
+            QImage mirrorInPlace = image.copy();
+            run("mirror_engine_hv_inplace", mp, 0, [&]() { MirrorEngine::mirrorInPlace(mirrorInPlace, true, true); });
+
+            // ImageTransform::rotatedImage：Qt 的 transformed 與目前使用的 WarpEngine
+            for (int angle : { 15, 45, 90, 180 })
+            {
+                QTransform tran;
+                tran.rotate(angle);
+                run(QString("transformed_%1").arg(angle), mp, 0, [&]() { consume(image.transformed(tran)); });
+                run(QString("warp_nearest_%1").arg(angle), mp, 0, [&]() {
+                    consume(WarpEngine::rotated(image, angle, WarpEngine::Nearest));
+                });
+                run(QString("warp_bilinear_%1").arg(angle), mp, 0, [&]() {
+                    consume(WarpEngine::rotated(image, angle, WarpEngine::Bilinear));
+                });
+            }
+
+            // 放大/縮小動作與放大視窗建構子的平滑縮放
+            run("scaled_smooth_1.5x", mp, 0, [&]() {
+                consume(image.scaled(image.width() * 1.5, image.height() * 1.5, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+            });
+            run("scaled_smooth_0.5x", mp, 0, [&]() {
+                consume(image.scaled(image.width() * 0.5, image.height() * 0.5, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+            });
+            const QImage region = image.copy(selection);
+            run("zoomwindow_scaled_2x", double(selection.width()) * selection.height() / 1e6, 0, [&]() {
+                consume(region.scaled(region.width() * 2, region.height() * 2, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+            });
+
+            // 目前使用的 Resampler：各核心的放大與縮小
+            const struct { const char *name; Resampler::Filter filter; } filters[] = {
+                { "nearest", Resampler::Nearest }, { "bilinear", Resampler::Bilinear },
+                { "bicubic", Resampler::Bicubic }, { "lanczos3", Resampler::Lanczos3 },
+                { "area", Resampler::Area },
+            };
+            for (const auto &entry : filters)
+            {
+                for (double factor : { 1.5, 0.5 })
+                {
+                    const QSize target(qRound(image.width() * factor), qRound(image.height() * factor));
+                    run(QString("resample_%1_%2x").arg(entry.name).arg(factor), mp, 0, [&]() {
+                        consume(Resampler::scaled(image, target, entry.filter));
+                    });
+                }
+            }
+
+            // 鏡射 → 旋轉 → 縮小：逐步產生中間影像，與合成成一個矩陣後只取樣一次
+            run("chain_mirror_rotate30_half", mp, 0, [&]() {
+                const QImage mirrored = MirrorEngine::mirrored(image, true, false);
+                const QImage rotated = WarpEngine::rotated(mirrored, 30, WarpEngine::Bilinear);
+                consume(Resampler::scaled(rotated, QSize(rotated.width() / 2, rotated.height() / 2), Resampler::Area));
+            });
+            run("graph_mirror_rotate30_half", mp, 0, [&]() {
+                const ImageGraph graph = ImageGraph(image).mirrored(true, false).rotated(30);
+                consume(graph.scaled(graph.size() / 2).render());
+            });
+
+            // 放大視窗捲動時取樣一個 256x256 的顯示區塊
+            const QSize zoomed = region.size() * 2;
+            const QRect tile = QRect(zoomed.width() / 2, zoomed.height() / 2, 256, 256)
+                                   .intersected(QRect(QPoint(0, 0), zoomed));
+            run("zoomwindow_tile_2x", double(tile.width()) * tile.height() / 1e6, 0, [&]() {
+                consume(Resampler::scaledRegion(region, zoomed, tile, Resampler::Bicubic));
+            });
+
+            // 放大視窗擷取選取區域
+            run("copy_rect", double(selection.width()) * selection.height() / 1e6, 0, [&]() {
+                consume(image.copy(selection));
+            });
+
+            // 存檔：QImage::save 的單執行緒 PNG（品質 100 為 zlib 最高等級）與平行編碼器的各個取捨
+            run("png_save_qt_q100", mp, 0, [&]() {
+                QBuffer buffer;
+                buffer.open(QIODevice::WriteOnly);
+                image.save(&buffer, "PNG", 100);
+                sink = sink + buffer.size();
+            });
+            for (PngEncoder::Preset preset : { PngEncoder::Fast, PngEncoder::Balanced, PngEncoder::Smallest })
+            {
+                static const char *const names[] = { "fast", "balanced", "smallest" };
+                run(QString("png_encode_%1").arg(names[preset]), mp, 0, [&]() {
+                    QBuffer buffer;
+                    buffer.open(QIODevice::WriteOnly);
+                    PngEncoder::write(image, &buffer, preset);
+                    sink = sink + buffer.size();
+                });
+            }
+
+            // 載入時正規化的一次性成本，以及正規化後的顯示上傳與建金字塔
+            run("normalize", mp, 0, [&]() { consume(PixelFormats::normalized(image)); });
+            const QImage canonical = PixelFormats::normalized(image);
+            run("pixmap_fromImage_canonical", mp, 0, [&]() {
+                const QPixmap pixmap = QPixmap::fromImage(canonical);
+                sink = sink + pixmap.cacheKey();
+            });
+            run("pyramid_build_canonical", mp, 0, [&]() {
+                const ImagePyramid pyramid(canonical);
+                sink = sink + pyramid.levelCount();
+            });
+
+            // 顯示上傳與金字塔
+            run("pixmap_fromImage", mp, 0, [&]() {
+                const QPixmap pixmap = QPixmap::fromImage(image);
+                sink = sink + pixmap.cacheKey();
+            });
+            run("pyramid_build", mp, 0, [&]() {
+                const ImagePyramid pyramid(image);
+                sink = sink + pyramid.levelCount();
+            });
+
+            // 滑鼠移動時的 pixel() + qGray 讀值
+            const int probes = 1000000;
+            run("pixel_qGray_probe", 0, probes, [&]() {
+                QRandomGenerator random(7);
+                qint64 total = 0;
+                for (int i = 0; i < probes; ++i)
+                {
+                    const int x = int(random.bounded(image.width()));
+                    const int y = int(random.bounded(image.height()));
+                    total += qGray(image.pixel(x, y));
+                }
+                sink = sink + total;
+            });
+        }
+    }
+
+    QJsonObject build;
+    build["qt_version"] = QLatin1String(qVersion());
+    build["cpu"] = QSysInfo::currentCpuArchitecture();
+    build["os"] = QSysInfo::prettyProductName();
+    build["threads"] = QThread::idealThreadCount();
+    build["avx2"] = Simd::hasAvx2();
+    build["sse41"] = Simd::hasSse41();
+#if defined(__clang__)
+    build["compiler"] = QStringLiteral("clang ") + QLatin1String(__clang_version__);
+#elif defined(__GNUC__)
+    build["compiler"] = QStringLiteral("gcc ") + QLatin1String(__VERSION__);
+#elif defined(_MSC_VER)
+    build["compiler"] = QStringLiteral("msvc ") + QString::number(_MSC_VER);
+#endif
+
+    QJsonObject root;
+    root["build"] = build;
+    root["results"] = results;
+    const QByteArray json = QJsonDocument(root).toJson();
+
+    if (parser.isSet(outputOption))
+    {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            err << "cannot write " << file.fileName() << Qt::endl;
+            return 1;
+        }
+        file.write(json);
+    }
+    else
+    {
+        QTextStream(stdout) << json;
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include "framescheduler.h"
+#include <QScreen>
+
+FrameScheduler::FrameScheduler(QWidget *window)
+    : QObject(window), window(window), lastFrame(-1)
+{
+    timer.setSingleShot(true);
+    timer.setTimerType(Qt::PreciseTimer);
+    connect(&timer, &QTimer::timeout, this, &FrameScheduler::deliver);
+    clock.start();
+}
+
+void FrameScheduler::requestFrame()
+{
+    if (timer.isActive())
+        return;
+    // 距離上一次送出還不到一個週期時等到下一個週期，否則下一輪事件迴圈就送出
+    const qint64 wait = lastFrame < 0 ? 0 : lastFrame + period() - clock.nsecsElapsed();
+    timer.start(wait > 0 ? int((wait + 999999) / 1000000) : 0);
+}
+
+void FrameScheduler::flush()
+{
+    if (!timer.isActive())
+        return;
+    timer.stop();
+    deliver();
+}
+
+bool FrameScheduler::isPending() const
+{
+    return timer.isActive();
+}
+
+void FrameScheduler::deliver()
+{
+    lastFrame = clock.nsecsElapsed();
+    emit frame();
+}
+
+qint64 FrameScheduler::period() const
+{
+    double hz = 60;
+    if (QScreen *screen = window->screen())
+        if (screen->refreshRate() > 0)
+            hz = screen->refreshRate();
+    return qint64(1e9 / hz);
+}
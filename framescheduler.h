@@ -0,0 +1,41 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <QObject>
+#include <QWidget>
+#include <QTimer>
+#include <QElapsedTimer>
+
+// 以螢幕更新頻率合併輸入：滑鼠事件只把資料排進佇列並呼叫 requestFrame()，
+// 每個更新週期最多送出一次 frame()，由接收端一次處理佇列中累積的所有輸入。
+//
+// 閒置後的第一個輸入在下一輪事件迴圈就處理，不必等滿一個週期；持續輸入時以上一次送出的時間為基準，
+// 每隔一個更新週期送出一次，工作量只跟螢幕更新頻率有關，與滑鼠回報頻率無關。
+// Qt Widgets 沒有垂直同步的通知，週期取自 window 所在螢幕的 refreshRate()。只在 GUI 執行緒使用
+class FrameScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FrameScheduler(QWidget *window);
+
+    void requestFrame();        // 有新的輸入排隊，在下一個畫面時間送出 frame()
+    void flush();               // 有排隊的輸入時立刻送出 frame()，例如放開滑鼠前
+    bool isPending() const;
+
+signals:
+    void frame();               // 處理佇列中累積的輸入
+
+private slots:
+    void deliver();
+
+private:
+    qint64 period() const;      // 更新週期（奈秒）
+
+    QWidget *window;
+    QTimer timer;
+    QElapsedTimer clock;
+    qint64 lastFrame;           // 上一次送出 frame() 的時間，-1 表示還沒送過
+};
+
+#endif // FRAMESCHEDULER_H
@@ -0,0 +1,260 @@
+#include "histogramengine.h"
+#include "parallelfor.h"
+#include "pixelformats.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRegion>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const int BandHeight = 64;      // 平行處理時每條帶的列數
+const int MinParallelPixels = 1 << 16;  // 小於此像素數的區域不值得分給執行緒池
+
+// 單一條帶的計數；用 32 位元計數，條帶再大也不會溢位
+struct BandCounts
+{
+    quint32 bins[Histogram::ChannelCount][256];
+};
+
+// 每種正規格式各產生一份，內層迴圈不判斷格式
+template<typename F>
+void countRow(const uchar *p, int count, BandCounts &counts)
+{
+    for (int i = 0; i < count; ++i, p += F::bytesPerPixel)
+    {
+        ++counts.bins[Histogram::Red][F::red(p)];
+        ++counts.bins[Histogram::Green][F::green(p)];
+        ++counts.bins[Histogram::Blue][F::blue(p)];
+        ++counts.bins[Histogram::Luma][F::luma(p)];
+    }
+}
+
+// 灰階影像的四個通道相同，只數一次，合併時再複製
+template<>
+void countRow<PixelFormats::Gray8>(const uchar *p, int count, BandCounts &counts)
+{
+    for (int i = 0; i < count; ++i)
+        ++counts.bins[Histogram::Luma][p[i]];
+}
+
+}
+
+/*------------------------------ Histogram ------------------------------*/
+
+Histogram::Histogram()
+{
+    clear();
+}
+
+void Histogram::clear()
+{
+    std::memset(bins, 0, sizeof(bins));
+    pixels = 0;
+}
+
+quint64 Histogram::count() const
+{
+    return pixels;
+}
+
+quint64 Histogram::bin(Channel channel, int value) const
+{
+    return value >= 0 && value < 256 ? bins[channel][value] : 0;
+}
+
+int Histogram::min(Channel channel) const
+{
+    for (int v = 0; v < 256; ++v)
+        if (bins[channel][v])
+            return v;
+    return -1;
+}
+
+int Histogram::max(Channel channel) const
+{
+    for (int v = 255; v >= 0; --v)
+        if (bins[channel][v])
+            return v;
+    return -1;
+}
+
+double Histogram::mean(Channel channel) const
+{
+    if (!pixels)
+        return 0;
+    quint64 sum = 0;
+    for (int v = 0; v < 256; ++v)
+        sum += bins[channel][v] * quint64(v);
+    return double(sum) / pixels;
+}
+
+// 最小的 v，使累積數量達到 percent% 的像素
+int Histogram::percentile(Channel channel, double percent) const
+{
+    if (!pixels)
+        return -1;
+    const double target = qBound(0.0, percent, 100.0) / 100.0 * pixels;
+    quint64 cumulative = 0;
+    for (int v = 0; v < 256; ++v)
+    {
+        cumulative += bins[channel][v];
+        if (cumulative > 0 && cumulative >= target)
+            return v;
+    }
+    return 255;
+}
+
+double Histogram::entropy(Channel channel) const
+{
+    if (!pixels)
+        return 0;
+    double result = 0;
+    for (int v = 0; v < 256; ++v)
+    {
+        if (!bins[channel][v])
+            continue;
+        const double p = double(bins[channel][v]) / pixels;
+        result -= p * std::log2(p);
+    }
+    return result;
+}
+
+Histogram &Histogram::operator+=(const Histogram &other)
+{
+    for (int c = 0; c < ChannelCount; ++c)
+        for (int v = 0; v < 256; ++v)
+            bins[c][v] += other.bins[c][v];
+    pixels += other.pixels;
+    return *this;
+}
+
+Histogram &Histogram::operator-=(const Histogram &other)
+{
+    for (int c = 0; c < ChannelCount; ++c)
+        for (int v = 0; v < 256; ++v)
+            bins[c][v] -= other.bins[c][v];
+    pixels -= other.pixels;
+    return *this;
+}
+
+/*------------------------------ HistogramEngine ------------------------------*/
+
+HistogramEngine::HistogramEngine()
+{
+}
+
+void HistogramEngine::setSource(const QImage &image)
+{
+    source = PixelFormats::normalized(image);   // 載入時已正規化的影像直接共用
+    tracked.clear();
+    trackedArea = QRect();
+}
+
+bool HistogramEngine::hasSource() const
+{
+    return !source.isNull();
+}
+
+// 每條帶先數進自己的 BandCounts，再一次併入結果，鎖只在合併時取得
+void HistogramEngine::accumulate(const QRect &rect, Histogram &histogram, bool subtract) const
+{
+    const QRect region = rect.intersected(source.rect());
+    if (region.isEmpty())
+        return;
+
+    QMutex mergeMutex;
+    auto run = [&](auto format) {
+        using F = decltype(format);
+        auto countBand = [&](int first, int last) {
+            BandCounts counts;
+            std::memset(&counts, 0, sizeof(counts));
+            for (int y = region.top() + first; y < region.top() + last; ++y)
+                countRow<F>(source.constScanLine(y) + region.left() * F::bytesPerPixel, region.width(), counts);
+            if (F::isGray)
+                for (int c = Histogram::Red; c < Histogram::Luma; ++c)
+                    std::memcpy(counts.bins[c], counts.bins[Histogram::Luma], sizeof(counts.bins[c]));
+
+            QMutexLocker locker(&mergeMutex);
+            for (int c = 0; c < Histogram::ChannelCount; ++c)
+                for (int v = 0; v < 256; ++v)
+                {
+                    if (subtract)
+                        histogram.bins[c][v] -= counts.bins[c][v];
+                    else
+                        histogram.bins[c][v] += counts.bins[c][v];
+                }
+        };
+
+        if (qint64(region.width()) * region.height() < MinParallelPixels)
+        {
+            for (int first = 0; first < region.height(); first += BandHeight)
+                countBand(first, qMin(first + BandHeight, region.height()));
+        }
+        else
+        {
+            Parallel::forEachBand(region.height(), BandHeight, countBand);
+        }
+    };
+    if (!PixelFormats::dispatch(source.format(), run))
+        return;
+
+    const quint64 pixels = quint64(region.width()) * region.height();
+    if (subtract)
+        histogram.pixels -= pixels;
+    else
+        histogram.pixels += pixels;
+}
+
+Histogram HistogramEngine::compute(const QRect &rect) const
+{
+    Histogram result;
+    accumulate(rect, result, false);
+    return result;
+}
+
+void HistogramEngine::beginTracking(const QRect &rect)
+{
+    trackedArea = rect.intersected(source.rect());
+    tracked = compute(trackedArea);
+}
+
+// 新舊矩形相減得到的 QRegion 已是不重疊的條帶；
+// 條帶總面積超過新矩形時（例如跳到很遠的位置）直接重算比較快
+const Histogram &HistogramEngine::update(const QRect &rect)
+{
+    const QRect next = rect.intersected(source.rect());
+    if (next == trackedArea)
+        return tracked;
+
+    const QRegion left = QRegion(trackedArea).subtracted(QRegion(next));
+    const QRegion entered = QRegion(next).subtracted(QRegion(trackedArea));
+    qint64 changed = 0;
+    for (const QRect &strip : left)
+        changed += qint64(strip.width()) * strip.height();
+    for (const QRect &strip : entered)
+        changed += qint64(strip.width()) * strip.height();
+
+    if (changed >= qint64(next.width()) * next.height())
+    {
+        beginTracking(next);
+        return tracked;
+    }
+    for (const QRect &strip : left)
+        accumulate(strip, tracked, true);
+    for (const QRect &strip : entered)
+        accumulate(strip, tracked, false);
+    trackedArea = next;
+    return tracked;
+}
+
+const Histogram &HistogramEngine::current() const
+{
+    return tracked;
+}
+
+QRect HistogramEngine::trackedRect() const
+{
+    return trackedArea;
+}
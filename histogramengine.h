@@ -0,0 +1,59 @@
+#ifndef HISTOGRAMENGINE_H
+#define HISTOGRAMENGINE_H
+
+#include <QImage>
+#include <QRect>
+
+// 每個通道 256 格的直方圖；可以相加減，讓選取區域移動時只處理進出的條帶
+class Histogram
+{
+public:
+    enum Channel { Red, Green, Blue, Luma, ChannelCount };
+
+    Histogram();
+    void clear();
+
+    quint64 count() const;                      // 像素數
+    quint64 bin(Channel channel, int value) const;
+    int    min(Channel channel) const;          // 沒有像素時回傳 -1
+    int    max(Channel channel) const;
+    double mean(Channel channel) const;
+    int    percentile(Channel channel, double percent) const;  // percent 為 0 到 100
+    double entropy(Channel channel) const;      // 以位元為單位
+
+    Histogram &operator+=(const Histogram &other);
+    Histogram &operator-=(const Histogram &other);
+
+private:
+    friend class HistogramEngine;
+    quint64 bins[ChannelCount][256];
+    quint64 pixels;
+};
+
+// 直方圖引擎：整塊計算時每條帶累積到自己的私有直方圖，最後再合併，隨核心數線性加速；
+// 拖曳選取時以 update() 追蹤矩形，只加上新進入、減去離開的列與行條帶
+class HistogramEngine
+{
+public:
+    HistogramEngine();
+
+    // 正規格式（見 pixelformats.h）直接讀取，其他格式先正規化
+    void setSource(const QImage &image);
+    bool hasSource() const;
+
+    Histogram compute(const QRect &rect) const;     // rect 會先裁到影像範圍內
+
+    void beginTracking(const QRect &rect);          // 開始追蹤，先整塊算一次
+    const Histogram &update(const QRect &rect);     // 移到新的矩形，回傳更新後的直方圖
+    const Histogram &current() const;
+    QRect trackedRect() const;
+
+private:
+    void accumulate(const QRect &rect, Histogram &histogram, bool subtract) const;
+
+    QImage source;
+    Histogram tracked;
+    QRect trackedArea;
+};
+
+#endif // HISTOGRAMENGINE_H
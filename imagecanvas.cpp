@@ -0,0 +1,106 @@
+#include "imagecanvas.h"
+#include "tracer.h"
+#include <QPainter>
+
+namespace {
+
+const int TileCacheKB = 64 * 1024;  // 顯示區塊快取上限（KB），約 256 個 256x256 區塊
+
+}
+
+ImageCanvas::ImageCanvas(QWidget *parent)
+    : QWidget(parent), overlay(nullptr), tiles(TileCacheKB)
+{
+    // 區塊完全覆蓋畫布，不需要 Qt 先清除背景
+    setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+void ImageCanvas::setSource(const ImageGraph &graph)
+{
+    view = graph;
+    displaySize = graph.size();
+    tiles.clear();
+    setFixedSize(displaySize);
+    update();
+}
+
+void ImageCanvas::setOverlay(const SparseLayer *layer)
+{
+    overlay = layer;
+    update();
+}
+
+void ImageCanvas::updateRegion(const QRect &rect)
+{
+    const QRect dirty = rect.intersected(QRect(QPoint(0, 0), displaySize));
+    if (!dirty.isEmpty())
+        update(dirty);
+}
+
+QSize ImageCanvas::sizeHint() const
+{
+    return displaySize;
+}
+
+void ImageCanvas::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(this);
+    const QRect exposed = event->rect().intersected(QRect(QPoint(0, 0), displaySize));
+    if (exposed.isEmpty() || view.isNull())
+    {
+        painter.fillRect(event->rect(), palette().window());
+        return;
+    }
+
+    // 只處理與重繪範圍相交的區塊，其餘部分完全不取樣
+    const int firstColumn = exposed.left() / TileSize;
+    const int lastColumn = exposed.right() / TileSize;
+    const int firstRow = exposed.top() / TileSize;
+    const int lastRow = exposed.bottom() / TileSize;
+    for (int row = firstRow; row <= lastRow; ++row)
+    {
+        for (int column = firstColumn; column <= lastColumn; ++column)
+        {
+            const QPoint origin(column * TileSize, row * TileSize);
+            const QRect part = QRect(origin, QSize(TileSize, TileSize)).intersected(exposed);
+            painter.drawPixmap(part.topLeft(), displayTile(column, row), part.translated(-origin));
+        }
+    }
+
+    if (overlay && !overlay->isEmpty())
+    {
+        painter.setClipRect(exposed);
+        overlay->drawOnto(painter, exposed);
+    }
+}
+
+QPixmap ImageCanvas::displayTile(int column, int row)
+{
+    const quint64 key = (quint64(quint32(row)) << 32) | quint32(column);
+    if (QPixmap *cached = tiles.object(key))
+        return *cached;
+
+    const QRect rect = QRect(column * TileSize, row * TileSize, TileSize, TileSize)
+                           .intersected(QRect(QPoint(0, 0), displaySize));
+    TRACE_SCOPE("ImageCanvas::displayTile");
+    QPixmap *pixmap = new QPixmap(QPixmap::fromImage(renderTile(rect)));
+    const QPixmap result = *pixmap;
+    tiles.insert(key, pixmap, qMax(1, rect.width() * rect.height() * 4 / 1024));
+    return result;
+}
+
+QImage ImageCanvas::renderTile(const QRect &rect) const
+{
+    // 只取樣這個區塊的範圍，結果與整張縮放後再裁切相同，相鄰區塊自然接合
+    const QImage tile = view.render(rect);
+    if (!tile.hasAlphaChannel())
+        return tile;
+
+    // 含透明度的來源先鋪底色，避免不透明重繪留下舊內容
+    QImage opaque(rect.size(), QImage::Format_RGB32);
+    opaque.fill(palette().window().color());
+    QPainter painter(&opaque);
+    painter.drawImage(0, 0, tile);
+    painter.end();
+    return opaque;
+}
@@ -0,0 +1,43 @@
+#ifndef IMAGECANVAS_H
+#define IMAGECANVAS_H
+
+#include <QWidget>
+#include <QImage>
+#include <QPixmap>
+#include <QCache>
+#include <QPaintEvent>
+#include "imagegraph.h"
+#include "sparselayer.h"
+
+// 顯示放大影像的虛擬畫布：只保留描述「來源如何變成畫面」的 ImageGraph，
+// 重繪時才把可見範圍內的 256x256 顯示區塊由來源一次取樣出來，並放進容量有限的快取；
+// 繪圖圖層每次重繪時疊在最上面，因此畫筆只需要讓變動的矩形重繪
+class ImageCanvas : public QWidget
+{
+    Q_OBJECT
+
+public:
+    static const int TileSize = 256;
+
+    explicit ImageCanvas(QWidget *parent = nullptr);
+
+    // 顯示 graph 的輸出；開啟的成本與放大倍率無關，取樣延後到實際重繪
+    void setSource(const ImageGraph &graph);
+    void setOverlay(const SparseLayer *layer);  // 疊在影像上的繪圖圖層（座標為顯示座標）
+    void updateRegion(const QRect &rect);       // 圖層的 rect 範圍改變，只重繪該區域
+    QSize sizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    QPixmap displayTile(int column, int row);   // 取快取中的區塊，沒有時重新取樣
+    QImage renderTile(const QRect &rect) const;
+
+    ImageGraph view;                // 來源影像與裁切、縮放組成的運算鏈
+    QSize  displaySize;             // 放大後的顯示大小
+    const SparseLayer *overlay;
+    QCache<quint64, QPixmap> tiles; // 以 KB 計算成本的顯示區塊快取
+};
+
+#endif // IMAGECANVAS_H
@@ -0,0 +1,177 @@
+#include "imagegraph.h"
+#include "imagepyramid.h"
+#include "mirrorengine.h"
+#include "warpengine.h"
+#include <QtMath>
+
+ImageGraph::ImageGraph()
+    : filter(Resampler::Bicubic), hasFilter(false)
+{
+}
+
+ImageGraph::ImageGraph(const QImage &source)
+    : src(source), outputSize(source.size()), filter(Resampler::Bicubic), hasFilter(false)
+{
+}
+
+bool ImageGraph::isNull() const
+{
+    return src.isNull() || outputSize.isEmpty();
+}
+
+QImage ImageGraph::source() const
+{
+    return src;
+}
+
+QSize ImageGraph::size() const
+{
+    return outputSize;
+}
+
+QTransform ImageGraph::transform() const
+{
+    return matrix;
+}
+
+QString ImageGraph::key() const
+{
+    return QString("graph:%1,%2,%3,%4,%5,%6:%7x%8:%9")
+        .arg(matrix.m11(), 0, 'g', 12).arg(matrix.m12(), 0, 'g', 12)
+        .arg(matrix.m21(), 0, 'g', 12).arg(matrix.m22(), 0, 'g', 12)
+        .arg(matrix.dx(), 0, 'g', 12).arg(matrix.dy(), 0, 'g', 12)
+        .arg(outputSize.width()).arg(outputSize.height())
+        .arg(hasFilter ? int(filter) : -1);
+}
+
+ImageGraph ImageGraph::mirrored(bool horizontal, bool vertical) const
+{
+    ImageGraph graph = *this;
+    if (!horizontal && !vertical)
+        return graph;
+    // 對目前輸出的範圍翻轉：x' = w - x、y' = h - y
+    graph.matrix = matrix * QTransform(horizontal ? -1 : 1, 0, 0, vertical ? -1 : 1,
+                                       horizontal ? outputSize.width() : 0,
+                                       vertical ? outputSize.height() : 0);
+    return graph;
+}
+
+ImageGraph ImageGraph::rotated(qreal angle) const
+{
+    ImageGraph graph = *this;
+    QTransform rotation;
+    rotation.rotate(angle);
+    if (rotation.isIdentity())
+        return graph;
+    // 與 QImage::trueMatrix 相同：平移到包圍盒左上角為原點
+    const QRect aligned = rotation.mapRect(QRectF(QPointF(0, 0), QSizeF(outputSize))).toAlignedRect();
+    graph.matrix = matrix * rotation * QTransform::fromTranslate(-aligned.x(), -aligned.y());
+    graph.outputSize = aligned.size();
+    return graph;
+}
+
+ImageGraph ImageGraph::scaled(const QSize &size) const
+{
+    ImageGraph graph = *this;
+    if (size == outputSize || outputSize.isEmpty())
+        return graph;
+    graph.matrix = matrix * QTransform::fromScale(qreal(size.width()) / outputSize.width(),
+                                                  qreal(size.height()) / outputSize.height());
+    graph.outputSize = size;
+    return graph;
+}
+
+ImageGraph ImageGraph::cropped(const QRect &rect) const
+{
+    ImageGraph graph = *this;
+    const QRect area = rect.intersected(QRect(QPoint(0, 0), outputSize));
+    graph.matrix = matrix * QTransform::fromTranslate(-area.x(), -area.y());
+    graph.outputSize = area.size();
+    return graph;
+}
+
+ImageGraph ImageGraph::withFilter(Resampler::Filter kernel) const
+{
+    ImageGraph graph = *this;
+    graph.filter = kernel;
+    graph.hasFilter = true;
+    return graph;
+}
+
+QImage ImageGraph::render(const QRect &region, const Parallel::CancelCheck &isCancelled) const
+{
+    const QRect bounds(QPoint(0, 0), outputSize);
+    const QRect area = region.isNull() ? bounds : region.intersected(bounds);
+    if (src.isNull() || area.isEmpty())
+        return QImage();
+
+    if (matrix.m12() == 0 && matrix.m21() == 0)
+        return renderAxisAligned(area, isCancelled);
+    return renderWarped(area, isCancelled);
+}
+
+QImage ImageGraph::renderAxisAligned(const QRect &area, const Parallel::CancelCheck &isCancelled) const
+{
+    const qreal scaleX = qAbs(matrix.m11());
+    const qreal scaleY = qAbs(matrix.m22());
+    const bool flipX = matrix.m11() < 0;
+    const bool flipY = matrix.m22() < 0;
+    const QSize full(qRound(src.width() * scaleX), qRound(src.height() * scaleY));
+
+    // 未翻轉的縮放結果中對應 area 的範圍；翻轉時 x' = dx - x，輸出 [l, r) 對應 [dx - r, dx - l)
+    const int dx = qRound(matrix.dx());
+    const int dy = qRound(matrix.dy());
+    const int left = flipX ? dx - (area.left() + area.width()) : area.left() - dx;
+    const int top = flipY ? dy - (area.top() + area.height()) : area.top() - dy;
+    const QRect unflipped(qBound(0, left, qMax(0, full.width() - area.width())),
+                          qBound(0, top, qMax(0, full.height() - area.height())),
+                          area.width(), area.height());
+
+    if (full == src.size())
+    {
+        // 純裁切與鏡射不需要取樣，整張時與來源共用資料
+        const QImage part = unflipped == src.rect() ? src : src.copy(unflipped);
+        return (flipX || flipY) ? MirrorEngine::mirrored(part, flipX, flipY) : part;
+    }
+
+    const Resampler::Filter kernel = hasFilter ? filter : Resampler::defaultFilter(src.size(), full);
+    QImage result = Resampler::scaledRegion(src, full, unflipped, kernel, isCancelled);
+    if (!result.isNull() && (flipX || flipY))
+        MirrorEngine::mirrorInPlace(result, flipX, flipY);   // 結果只有這裡持有，不會複製
+    return result;
+}
+
+QImage ImageGraph::renderWarped(const QRect &area, const Parallel::CancelCheck &isCancelled) const
+{
+    const WarpEngine::Sampling sampling = hasFilter && filter == Resampler::Nearest ? WarpEngine::Nearest
+                                                                                    : WarpEngine::Bilinear;
+
+    // 恰好是 90/270 度旋轉（不含縮放）時走 WarpEngine 的純記憶體轉置，再裁出 area
+    const bool quarterTurn = matrix.m11() == 0 && matrix.m22() == 0 &&
+                             qAbs(matrix.m12()) == 1 && matrix.m21() == -matrix.m12();
+    if (quarterTurn)
+    {
+        const QTransform linear(matrix.m11(), matrix.m12(), matrix.m21(), matrix.m22(), 0, 0);
+        const QImage turned = WarpEngine::transformed(src, linear, sampling, isCancelled);
+        if (turned.isNull())
+            return QImage();
+        const QRect aligned = matrix.mapRect(QRectF(src.rect())).toAlignedRect();
+        const QRect part = area.translated(-aligned.topLeft());
+        return part == turned.rect() ? turned : turned.copy(part);
+    }
+
+    // 縮小超過一半時先降階：降階影像的座標乘 2 即為原座標
+    QImage source = src;
+    QTransform mat = matrix;
+    if (sampling == WarpEngine::Bilinear)
+    {
+        while (qSqrt(qAbs(mat.determinant())) < 0.5 && source.width() >= 2 && source.height() >= 2)
+        {
+            source = ImagePyramid::reduce(source, isCancelled);
+            if (source.isNull())
+                return QImage();
+            mat = QTransform::fromScale(2, 2) * mat;
+        }
+    }
+    return WarpEngine::transformedRegion(source, mat, area, sampling, isCancelled);
+}
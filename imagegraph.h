@@ -0,0 +1,49 @@
+#ifndef IMAGEGRAPH_H
+#define IMAGEGRAPH_H
+
+#include <QImage>
+#include <QRect>
+#include <QString>
+#include <QTransform>
+#include "parallelfor.h"
+#include "resampler.h"
+
+// 延遲求值的幾何運算鏈：鏡射、旋轉、縮放、裁切只記錄成一個「來源 → 輸出」的仿射矩陣，
+// 不產生中間影像；render 時才對要求的輸出範圍取樣一次，避免多次重新取樣累積的模糊。
+// 物件是不可變的值，每個運算回傳新的 ImageGraph，來源影像以隱式共享保存
+class ImageGraph
+{
+public:
+    ImageGraph();
+    explicit ImageGraph(const QImage &source);
+
+    bool isNull() const;
+    QImage source() const;
+    QSize size() const;                 // 目前運算鏈輸出的大小
+    QTransform transform() const;       // 來源座標到輸出座標的合成矩陣
+    QString key() const;                // 描述整條運算鏈的字串，可作為快取鍵
+
+    ImageGraph mirrored(bool horizontal, bool vertical) const;
+    ImageGraph rotated(qreal angle) const;          // 與 QImage::transformed 相同：輸出為旋轉後的包圍盒
+    ImageGraph scaled(const QSize &size) const;     // 不保持比例
+    ImageGraph cropped(const QRect &rect) const;    // rect 超出目前範圍的部分會被裁掉
+    ImageGraph withFilter(Resampler::Filter filter) const;  // 指定取樣核心；預設依縮放方向自動選擇
+
+    // 求值：只產生輸出座標中的 region（空矩形代表整張）。
+    // 只有縮放與鏡射時以 Resampler 取樣後原地鏡射；含旋轉時交給 WarpEngine 一次反向映射，
+    // 縮小超過一半時先以 2x2 平均降階，避免雙線性取樣產生疊頻
+    QImage render(const QRect &region = QRect(),
+                  const Parallel::CancelCheck &isCancelled = Parallel::CancelCheck()) const;
+
+private:
+    QImage renderAxisAligned(const QRect &area, const Parallel::CancelCheck &isCancelled) const;
+    QImage renderWarped(const QRect &area, const Parallel::CancelCheck &isCancelled) const;
+
+    QImage     src;
+    QTransform matrix;
+    QSize      outputSize;
+    Resampler::Filter filter;
+    bool       hasFilter;               // 是否以 withFilter 指定了核心
+};
+
+#endif // IMAGEGRAPH_H
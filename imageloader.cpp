@@ -0,0 +1,110 @@
+#include "imageloader.h"
+#include "pixelformats.h"
+#include "tiledimagestore.h"
+#include "tracer.h"
+#include <QFile>
+#include <QImageReader>
+
+namespace {
+
+// 讀檔時回報進度並檢查取消旗標的 QFile；
+// 被取消時 readData 回傳 -1，QImageReader 會當成讀取錯誤而停止解碼
+class CancellableFile : public QFile
+{
+public:
+    CancellableFile(const QString &name, LoadProgress *progress)
+        : QFile(name), progress(progress)
+    {
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override
+    {
+        if (progress->cancelled.loadRelaxed())
+            return -1;
+        const qint64 count = QFile::readData(data, maxSize);
+        if (count > 0)
+            progress->bytesRead.fetchAndAddRelaxed(count);
+        return count;
+    }
+
+private:
+    LoadProgress *progress;
+};
+
+}
+
+ImageLoader::Result ImageLoader::load(const QString &filename,
+                                      const QSharedPointer<LoadProgress> &progress,
+                                      int generation,
+                                      const QSize &previewBound)
+{
+    TRACE_SCOPE("ImageLoader::load");
+    Result result;
+    result.filename = filename;
+    result.generation = generation;
+
+    CancellableFile file(filename, progress.data());
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        result.error = file.errorString();
+        return result;
+    }
+    progress->totalBytes.storeRelaxed(file.size());
+
+    QImageReader reader(&file);
+    result.fullSize = reader.size();
+    // 不支援 ScaledSize 的格式（如 PNG）會先解完整張再縮，反而更慢，因此只對支援的格式縮小解碼
+    if (previewBound.isValid() && result.fullSize.isValid() &&
+        (result.fullSize.width() > previewBound.width() || result.fullSize.height() > previewBound.height()) &&
+        reader.supportsOption(QImageIOHandler::ScaledSize))
+    {
+        reader.setScaledSize(result.fullSize.scaled(previewBound, Qt::KeepAspectRatio));
+        result.preview = true;
+    }
+    result.image = reader.read();
+    if (!result.fullSize.isValid())
+        result.fullSize = result.image.size();
+    if (progress->cancelled.loadRelaxed())
+    {
+        result.image = QImage();
+        result.cancelled = true;
+    }
+    else if (result.image.isNull())
+    {
+        result.error = reader.errorString();
+    }
+    else
+    {
+        // 在工作執行緒中一次轉成正規格式，之後各核心都不必再轉換
+        result.image = PixelFormats::normalized(result.image);
+    }
+    return result;
+}
+
+ImageLoader::Result ImageLoader::expand(const QSharedPointer<TiledImageStore> &store,
+                                        const QSharedPointer<LoadProgress> &progress,
+                                        int generation)
+{
+    TRACE_SCOPE("ImageLoader::expand");
+    Result result;
+    result.generation = generation;
+    result.tiled = true;
+    result.fullSize = store->size();
+    progress->totalBytes.storeRelaxed(store->pixelBytes());
+
+    LoadProgress *state = progress.data();
+    result.image = store->readRegion(QRect(QPoint(0, 0), result.fullSize),
+                                     [state]() { return state->cancelled.loadRelaxed() != 0; },
+                                     &state->bytesRead);
+    if (progress->cancelled.loadRelaxed())
+    {
+        result.image = QImage();
+        result.cancelled = true;
+    }
+    else if (result.image.isNull())
+    {
+        result.error = QStringLiteral("記憶體不足，無法展開分塊影像");
+    }
+    return result;
+}
@@ -0,0 +1,50 @@
+#ifndef IMAGELOADER_H
+#define IMAGELOADER_H
+
+#include <QString>
+#include <QImage>
+#include <QSize>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QSharedPointer>
+
+class TiledImageStore;
+
+// 背景解碼的共用狀態：GUI 執行緒設定取消旗標並定時讀取進度，工作執行緒讀檔時更新
+struct LoadProgress
+{
+    QAtomicInt cancelled;               // 非 0 時下一次讀檔即失敗，解碼隨之中止
+    QAtomicInteger<qint64> bytesRead;   // 目前已從檔案讀出的位元組數
+    QAtomicInteger<qint64> totalBytes;  // 檔案大小，開檔前為 0
+};
+
+// 以 QImageReader 解碼影像檔或展開分塊檔，供 QtConcurrent::run 在背景執行緒呼叫
+class ImageLoader
+{
+public:
+    struct Result
+    {
+        QImage  image;
+        QString filename;
+        QString error;          // 失敗原因；被取消時為空字串
+        QSize   fullSize;       // 檔案的原始解析度
+        int     generation = 0; // 送出工作時的編號，用來丟棄過期結果
+        bool    cancelled = false;
+        bool    preview = false;    // image 是縮小解碼的預覽，不是原始解析度
+        bool    tiled = false;      // 由分塊檔展開，不是從影像檔解碼
+    };
+
+    // previewBound 有效且影像超過它時，請解碼器直接解出不大於 previewBound 的預覽
+    // （JPEG 在 DCT 階段就縮小）；格式不支援縮小解碼時照常解出原始解析度
+    static Result load(const QString &filename,
+                       const QSharedPointer<LoadProgress> &progress,
+                       int generation,
+                       const QSize &previewBound = QSize());
+
+    // 把整張分塊檔讀成一張影像，進度以展開的位元組數計算
+    static Result expand(const QSharedPointer<TiledImageStore> &store,
+                         const QSharedPointer<LoadProgress> &progress,
+                         int generation);
+};
+
+#endif // IMAGELOADER_H
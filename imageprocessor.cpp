@@ -6,22 +6,28 @@
 #include <QPixmap>
 #include <QPainter>
 #include <QInputDialog>
+#include <QScreen>
+#include <QtConcurrent/QtConcurrentRun>
 #include "imagetransform.h"
 #include "zoomwindow.h"
+#include "imagestore.h"
+#include "resampler.h"
+#include "pixelformats.h"
+#include "tracer.h"
 
 ImageProcessor::ImageProcessor(QWidget *parent)
-    : QMainWindow(parent), isSelecting(false)  // 初始化區域選取狀態
+    : QMainWindow(parent), pendingReceived(0), pendingEvents(0), isSelecting(false), displayedKey(0), loadGeneration(0)  // 初始化區域選取狀態
 {
     setWindowTitle(QStringLiteral("影像處理"));
     central = new QWidget();
     QHBoxLayout *mainLayout = new QHBoxLayout(central);
-    imgWin = new QLabel();
+    imgWin = new ImageViewport();
     QPixmap *initPixmap = new QPixmap(300,200);
     gWin = new ImageTransform();
     initPixmap->fill(QColor(255,255,255));
-    imgWin->resize(300,200);
-    imgWin->setScaledContents(true);
-    imgWin->setPixmap(*initPixmap);
+    imgWin->setImage(*initPixmap);
+    // 視窗大小、縮放或平移改變時換用合適的金字塔層級
+    connect(imgWin, &ImageViewport::viewChanged, this, &ImageProcessor::updateDisplayPixmap);
     mainLayout->addWidget(imgWin);
     setCentralWidget(central);
     createActions();
@@ -32,17 +38,66 @@ ImageProcessor::ImageProcessor(QWidget *parent)
     statusLabel->setFixedWidth(100);
     MousePosLabel = new QLabel;
     MousePosLabel->setText(tr(" "));
-    MousePosLabel->setFixedWidth(100);
+    MousePosLabel->setFixedWidth(140);
+    statsLabel = new QLabel;
+    neighborhoodSpin = new QSpinBox;
+    neighborhoodSpin->setRange(1, 101);
+    neighborhoodSpin->setSingleStep(2);
+    neighborhoodSpin->setValue(5);
+    neighborhoodSpin->setPrefix(QStringLiteral("N="));
+    neighborhoodSpin->setToolTip(QStringLiteral("游標附近統計範圍（N x N 像素）"));
+    loadProgressBar = new QProgressBar;
+    loadProgressBar->setFixedWidth(150);
+    loadProgressBar->setTextVisible(false);
+    loadProgressBar->hide();
+    cancelLoadButton = new QToolButton;
+    cancelLoadButton->setText(QStringLiteral("取消"));
+    cancelLoadButton->setToolTip(QStringLiteral("取消載入"));
+    cancelLoadButton->hide();
+    connect(cancelLoadButton, &QToolButton::clicked, this, [this]() {
+        cancelLoad();
+        statusBar()->showMessage(QStringLiteral("已取消載入"), 3000);
+    });
+    traceOverlay = new TraceOverlay;
+    statusBar()->addPermanentWidget(traceOverlay);
+    traceOverlay->setActive(Tracer::isEnabled());
+    traceAction->setChecked(Tracer::isEnabled());
+    latencyAction->setChecked(InputLatency::isEnabled());
+    statusBar()->addPermanentWidget(loadProgressBar);
+    statusBar()->addPermanentWidget(cancelLoadButton);
     statusBar()->addPermanentWidget(statusLabel);
     statusBar()->addPermanentWidget(MousePosLabel);
+    statusBar()->addPermanentWidget(statsLabel);
+    statusBar()->addPermanentWidget(neighborhoodSpin);
     setMouseTracking(true);
-    imgWin->setMouseTracking(true);
     central->setMouseTracking(true);
+    latency = new InputLatency(this);
+    frames = new FrameScheduler(this);
+    connect(frames, &FrameScheduler::frame, this, &ImageProcessor::updatePointer);
+
+    pyramidWatcher = new QFutureWatcher<ImagePyramid>(this);
+    connect(pyramidWatcher, &QFutureWatcher<ImagePyramid>::finished, this, &ImageProcessor::pyramidReady);
+
+    loadWatcher = new QFutureWatcher<ImageLoader::Result>(this);
+    connect(loadWatcher, &QFutureWatcher<ImageLoader::Result>::finished, this, &ImageProcessor::loadFinished);
+    loadProgressTimer = new QTimer(this);
+    loadProgressTimer->setInterval(100);
+    connect(loadProgressTimer, &QTimer::timeout, this, &ImageProcessor::updateLoadProgress);
+
+    lumaWatcher = new QFutureWatcher<LumaPlane>(this);
+    connect(lumaWatcher, &QFutureWatcher<LumaPlane>::finished, this, &ImageProcessor::lumaReady);
 }
 
 ImageProcessor::~ImageProcessor()
 {
-
+    // 建立工作仍持有 pyramidGeneration 的指標，先讓它失效並等待結束
+    pyramidGeneration.fetchAndAddOrdered(1);
+    pyramidWatcher->waitForFinished();
+    lumaWatcher->waitForFinished();
+    // 解碼工作只持有共用狀態，取消後等待結束即可
+    cancelLoad();
+    loadWatcher->waitForFinished();
+    delete gWin;
 }
 
 void ImageProcessor::createActions()
@@ -66,40 +121,104 @@ void ImageProcessor::createActions()
     zoomInAction = new QAction(QStringLiteral("放大(&+)"), this);
     zoomInAction->setShortcut(tr("Ctrl++"));
     connect(zoomInAction, &QAction::triggered, this, [=]() {
-
-        if (img.isNull()) return;
-
-        QImage result = img.scaled(
-            img.width() * 1.5,
-            img.height() * 1.5,
-            Qt::KeepAspectRatio,
-            Qt::SmoothTransformation
-            );
-
-        ImageProcessor *resultWin = new ImageProcessor();
-        resultWin->setWindowTitle(QStringLiteral("處理結果"));
-        resultWin->show();
-        resultWin->loadImage(result);
+        ensureFullImage([this]() {
+            TRACE_OPERATION("zoomIn");
+            // 同一張影像重複放大/縮小時直接取用倉庫中的結果，新視窗與倉庫共用同一塊緩衝
+            QImage result = ImageStore::instance().derived(ImageStore::derivedKey(img, "zoom:1.5"),
+                                                           [this]() { return zoomImage(img, 1.5); });
+
+            ImageProcessor *resultWin = new ImageProcessor();
+            resultWin->setAttribute(Qt::WA_DeleteOnClose);  // 關閉時釋放影像
+            resultWin->setWindowTitle(QStringLiteral("處理結果"));
+            resultWin->show();
+            resultWin->loadImage(result);
+        });
     });
 
     zoomOutAction = new QAction(QStringLiteral("縮小(&-)"), this);
     zoomOutAction->setShortcut(tr("Ctrl+-"));
     connect(zoomOutAction, &QAction::triggered, this, [=]() {
+        ensureFullImage([this]() {
+            TRACE_OPERATION("zoomOut");
+            // 同一張影像重複放大/縮小時直接取用倉庫中的結果，新視窗與倉庫共用同一塊緩衝
+            QImage result = ImageStore::instance().derived(ImageStore::derivedKey(img, "zoom:0.5"),
+                                                           [this]() { return zoomImage(img, 0.5); });
+
+            ImageProcessor *resultWin = new ImageProcessor();
+            resultWin->setAttribute(Qt::WA_DeleteOnClose);  // 關閉時釋放影像
+            resultWin->setWindowTitle(QStringLiteral("處理結果"));
+            resultWin->show();
+            resultWin->loadImage(result);
+        });
+    });
 
-        if (img.isNull()) return;
+    traceAction = new QAction(QStringLiteral("效能追蹤"), this);
+    traceAction->setCheckable(true);
+    traceAction->setStatusTip(QStringLiteral("記錄各項操作的耗時，並在狀態列顯示最近的延遲"));
+    connect(traceAction, &QAction::triggered, this, &ImageProcessor::setTracing);
 
-        QImage result = img.scaled(
-            img.width() * 0.5,
-            img.height() * 0.5,
-            Qt::KeepAspectRatio,
-            Qt::SmoothTransformation
-            );
+    exportTraceAction = new QAction(QStringLiteral("匯出追蹤..."), this);
+    exportTraceAction->setStatusTip(QStringLiteral("存成 Chrome / Perfetto 可開啟的 trace JSON"));
+    connect(exportTraceAction, &QAction::triggered, this, &ImageProcessor::exportTrace);
 
-        ImageProcessor *resultWin = new ImageProcessor();
-        resultWin->setWindowTitle(QStringLiteral("處理結果"));
-        resultWin->show();
-        resultWin->loadImage(result);
-    });
+    latencyAction = new QAction(QStringLiteral("輸入延遲分析"), this);
+    latencyAction->setCheckable(true);
+    latencyAction->setStatusTip(QStringLiteral("量測滑鼠讀值、選取框與畫筆從事件到畫面更新的延遲"));
+    connect(latencyAction, &QAction::triggered, this, &ImageProcessor::setLatencyProfiling);
+
+    latencyReportAction = new QAction(QStringLiteral("匯出延遲報告..."), this);
+    latencyReportAction->setStatusTip(QStringLiteral("存成含延遲直方圖與掉格統計的文字報告"));
+    connect(latencyReportAction, &QAction::triggered, this, &ImageProcessor::exportLatencyReport);
+}
+
+void ImageProcessor::setTracing(bool enabled)
+{
+    Tracer::setEnabled(enabled);
+    traceOverlay->setActive(enabled);
+}
+
+void ImageProcessor::exportTrace()
+{
+    const QString path = QFileDialog::getSaveFileName(this, QStringLiteral("匯出追蹤"), "trace.json",
+                                                      "Trace JSON (*.json)");
+    if (path.isEmpty())
+        return;
+    QString error;
+    if (Tracer::exportChromeTrace(path, &error))
+        statusBar()->showMessage(QStringLiteral("追蹤已匯出：") + path, 5000);
+    else
+        statusBar()->showMessage(QStringLiteral("無法寫入 ") + path + ": " + error);
+}
+
+void ImageProcessor::setLatencyProfiling(bool enabled)
+{
+    if (enabled)
+        InputLatency::clear();
+    InputLatency::setEnabled(enabled);
+    if (enabled)
+        statusBar()->showMessage(QStringLiteral("延遲分析中：移動滑鼠、Ctrl 拖曳選取或在放大視窗畫線"), 3000);
+}
+
+void ImageProcessor::exportLatencyReport()
+{
+    const QString path = QFileDialog::getSaveFileName(this, QStringLiteral("匯出延遲報告"), "latency.txt",
+                                                      "Text (*.txt)");
+    if (path.isEmpty())
+        return;
+    QString error;
+    if (InputLatency::saveReport(path, &error))
+        statusBar()->showMessage(QStringLiteral("延遲報告已匯出：") + path, 5000);
+    else
+        statusBar()->showMessage(QStringLiteral("無法寫入 ") + path + ": " + error);
+}
+
+QImage ImageProcessor::zoomImage(const QImage &image, double factor)
+{
+    // 放大用 Bicubic、縮小用面積平均，取代 QImage::scaled 的平滑縮放
+    const QSize target = image.size().scaled(image.width() * factor,
+                                             image.height() * factor,
+                                             Qt::KeepAspectRatio);
+    return Resampler::scaled(image, target, Resampler::defaultFilter(image.size(), target));
 }
 
 void ImageProcessor::createMenus()
@@ -112,6 +231,11 @@ void ImageProcessor::createMenus()
     fileMenu = menuBar()->addMenu(QStringLiteral("工具(&T)"));
     fileMenu->addAction(zoomInAction);
     fileMenu->addAction(zoomOutAction);
+    fileMenu->addSeparator();
+    fileMenu->addAction(traceAction);
+    fileMenu->addAction(exportTraceAction);
+    fileMenu->addAction(latencyAction);
+    fileMenu->addAction(latencyReportAction);
 }
 
 void ImageProcessor::createToolBars()
@@ -125,20 +249,314 @@ void ImageProcessor::createToolBars()
     fileTool->addAction(zoomOutAction);
 }
 
+// 在背景執行緒解碼；再次開檔時取消前一次尚未完成的載入
 void ImageProcessor::loadFile(QString filename)
 {
-    img.load(filename);
-    scaleFactor = 1.0;
-    imgWin->setPixmap(QPixmap::fromImage(img));
-    imgWin->adjustSize();
+    TRACE_OPERATION("loadFile");
+    cancelLoad();
+    if (TiledImageStore::isTiledFile(filename))
+    {
+        openTiledFile(filename);
+        return;
+    }
+    // 同一個檔案已在別的視窗開過時直接共用，不再解碼
+    const QImage cached = ImageStore::instance().source(filename);
+    if (!cached.isNull())
+    {
+        loadImage(cached);
+        return;
+    }
+    loadProgress = QSharedPointer<LoadProgress>::create();
+    const int generation = ++loadGeneration;
+    // 多數開檔只是檢視，先解出螢幕大小的預覽，原始解析度等到有運算需要時再解
+    QSize previewBound;
+    if (screen())
+        previewBound = screen()->availableGeometry().size() * screen()->devicePixelRatio();
+    loadWatcher->setFuture(QtConcurrent::run(ImageLoader::load, filename, loadProgress, generation, previewBound));
+    showLoadProgress(QStringLiteral("正在載入 ") + filename);
+    MousePosLabel->setText(tr(" "));
+}
+
+void ImageProcessor::showLoadProgress(const QString &message)
+{
+    loadProgressBar->setRange(0, 0);  // 檔案大小未知前顯示忙碌狀態
+    loadProgressBar->show();
+    cancelLoadButton->show();
+    loadProgressTimer->start();
+    statusBar()->showMessage(message);
 }
 
 void ImageProcessor::loadImage(const QImage &image)
 {
-    img = image;
+    cancelLoad();
+    img = PixelFormats::normalized(image);
+    previewImg = QImage();
+    previewSource.clear();
+    tiledStore.reset();
+    fullSize = image.size();
+    showNewImage();
+}
+
+void ImageProcessor::cancelLoad()
+{
+    pendingAction = nullptr;
+    if (!loadProgress)
+        return;
+    loadProgress->cancelled.storeRelaxed(1);
+    loadProgress.reset();
+    loadProgressTimer->stop();
+    loadProgressBar->hide();
+    cancelLoadButton->hide();
+}
+
+bool ImageProcessor::isLoading() const
+{
+    return !loadProgress.isNull();
+}
+
+void ImageProcessor::updateLoadProgress()
+{
+    if (!loadProgress)
+        return;
+    const qint64 total = loadProgress->totalBytes.loadRelaxed();
+    if (total <= 0)
+        return;
+    // 以千分比表示，避免大檔案超出 int 範圍
+    loadProgressBar->setRange(0, 1000);
+    loadProgressBar->setValue(int(loadProgress->bytesRead.loadRelaxed() * 1000 / total));
+}
+
+void ImageProcessor::loadFinished()
+{
+    TRACE_SCOPE("loadFinished");
+    const ImageLoader::Result result = loadWatcher->result();
+    // 已被新的載入取代或被取消
+    if (result.generation != loadGeneration || result.cancelled || !loadProgress)
+        return;
+    loadProgress.reset();
+    loadProgressTimer->stop();
+    loadProgressBar->hide();
+    cancelLoadButton->hide();
+    const std::function<void()> action = pendingAction;
+    pendingAction = nullptr;
+
+    if (result.image.isNull())
+    {
+        if (result.tiled)
+            statusBar()->showMessage(result.error);
+        else
+            statusBar()->showMessage(QStringLiteral("無法開啟 ") + result.filename + ": " + result.error);
+        return;
+    }
+    statusBar()->clearMessage();
+    tiledStore.reset();
+    if (result.preview)
+    {
+        img = QImage();
+        previewImg = result.image;
+        previewSource = result.filename;
+    }
+    else
+    {
+        // 展開的分塊檔沒有對應的影像檔，不放進倉庫
+        img = result.tiled ? result.image : ImageStore::instance().addSource(result.filename, result.image);
+        previewImg = QImage();
+        previewSource.clear();
+    }
+    fullSize = result.fullSize;
+    showNewImage();
+
+    // 為了這個動作才解出原始解析度的話，接著執行
+    if (action)
+        action();
+}
+
+bool ImageProcessor::hasImage() const
+{
+    return !img.isNull() || !previewImg.isNull();
+}
+
+const QImage &ImageProcessor::shownImage() const
+{
+    return img.isNull() ? previewImg : img;
+}
+
+// 預覽只夠顯示；幾何轉換、放大/縮小與放大視窗需要原始解析度時才解碼。
+// 與開檔相同在背景執行，視窗保持可操作，狀態列顯示進度並可取消，完成後由 loadFinished 執行 action
+void ImageProcessor::ensureFullImage(const std::function<void()> &action)
+{
+    if (!img.isNull())
+    {
+        action();
+        return;
+    }
+    if (isLoading())
+    {
+        // 原始解析度已在解碼中時，完成後改執行最後要求的動作；開新檔期間則忽略
+        if (pendingAction)
+            pendingAction = action;
+        return;
+    }
+
+    loadProgress = QSharedPointer<LoadProgress>::create();
+    const int generation = ++loadGeneration;
+    if (tiledStore)
+    {
+        // 分塊檔只有在放得進記憶體時才展開整張，否則只能對選取區域操作
+        if (tiledStore->pixelBytes() > MaxExpandedBytes)
+        {
+            loadProgress.reset();
+            statusBar()->showMessage(QStringLiteral("影像太大，無法整張載入；請框選區域後在放大視窗中操作"), 5000);
+            return;
+        }
+        loadWatcher->setFuture(QtConcurrent::run(ImageLoader::expand, tiledStore, loadProgress, generation));
+        showLoadProgress(QStringLiteral("正在展開分塊影像"));
+    }
+    else
+    {
+        if (previewSource.isEmpty())
+        {
+            loadProgress.reset();
+            return;
+        }
+        loadWatcher->setFuture(QtConcurrent::run(ImageLoader::load, previewSource, loadProgress, generation, QSize()));
+        showLoadProgress(QStringLiteral("正在載入原始解析度 ") + previewSource);
+    }
+    pendingAction = action;
+}
+
+// 分塊檔開檔只讀檔頭並映射檔案，畫面先用內嵌縮圖，與檔案大小無關
+bool ImageProcessor::openTiledFile(const QString &path)
+{
+    QSharedPointer<TiledImageStore> store = QSharedPointer<TiledImageStore>::create();
+    if (!store->open(path))
+    {
+        statusBar()->showMessage(QStringLiteral("無法開啟 ") + path + ": " + store->errorString());
+        return false;
+    }
+    tiledStore = store;
+    img = QImage();
+    previewImg = store->overview();
+    previewSource.clear();
+    fullSize = store->size();
+    showNewImage();
+    return true;
+}
+
+QImage ImageProcessor::regionImage(const QRect &rect) const
+{
+    if (!img.isNull())
+        return img.copy(rect);
+    if (tiledStore)
+        return tiledStore->readRegion(rect);
+    return QImage();
+}
+
+// 先以最近鄰快速縮出螢幕大小的暫時畫面，金字塔在背景建好後再換成正式層級
+void ImageProcessor::showNewImage()
+{
     scaleFactor = 1.0;
-    imgWin->setPixmap(QPixmap::fromImage(img));
-    imgWin->adjustSize();
+    pyramid = ImagePyramid();
+    displayedKey = 0;
+    luma = LumaPlane();
+    selectionStatsText.clear();
+    statsLabel->clear();
+    const int generation = pyramidGeneration.fetchAndAddOrdered(1) + 1;
+    const QImage shown = shownImage();
+    if (shown.isNull())
+        return;
+
+    // 原圖在記憶體中或開啟分塊檔時，放大超過畫面層級的部分由 detailRegion 逐塊提供
+    if (img.isNull() && !tiledStore)
+        imgWin->setDetailSource(ImageViewport::DetailSource());
+    else
+        imgWin->setDetailSource([this](const QRect &rect, int factor) { return detailRegion(rect, factor); });
+
+    QSize fit = shown.size();
+    if (screen())
+        fit = fit.boundedTo(screen()->availableGeometry().size());
+    {
+        TRACE_SCOPE("QPixmap::fromImage");
+        if (fit == shown.size())
+            imgWin->setImage(QPixmap::fromImage(shown), fullSize);
+        else
+            imgWin->setImage(QPixmap::fromImage(shown.scaled(fit, Qt::KeepAspectRatio, Qt::FastTransformation)),
+                             fullSize);
+    }
+    imgWin->resetView();
+    imgWin->setCrosshairEnabled(true);
+
+    const QAtomicInt *current = &pyramidGeneration;
+    pyramidWatcher->setFuture(QtConcurrent::run([current, generation](const QImage &image) {
+        return ImagePyramid(image, [current, generation]() {
+            return current->loadRelaxed() != generation;
+        });
+    }, shown));
+
+    // 亮度平面與直方圖只對原始解析度建立；預覽與分塊檔的讀值改從原始資料逐點取
+    histogram.setSource(img);
+    if (!img.isNull())
+    {
+        lumaWatcher->setFuture(QtConcurrent::run([current, generation](const QImage &image) {
+            return LumaPlane(image, [current, generation]() {
+                return current->loadRelaxed() != generation;
+            });
+        }, img));
+    }
+}
+
+void ImageProcessor::lumaReady()
+{
+    const LumaPlane result = lumaWatcher->result();
+    if (result.isNull() || result.sourceKey() != img.cacheKey())
+        return;
+    luma = result;
+}
+
+void ImageProcessor::pyramidReady()
+{
+    const ImagePyramid result = pyramidWatcher->result();
+    // 期間換過影像的話丟棄
+    if (result.isNull() || result.sourceKey() != shownImage().cacheKey())
+        return;
+    pyramid = result;
+    updateDisplayPixmap();
+}
+
+void ImageProcessor::updateDisplayPixmap()
+{
+    if (pyramid.isNull())
+        return;
+    // 原圖與分塊檔只放剛好放進元件的層級，放大後由 imgWin 逐塊向 detailRegion 取看得到的部分，
+    // 不把整張原圖轉成 pixmap；預覽本身不超過螢幕大小，照顯示解析度挑選
+    const bool hasDetail = !img.isNull() || tiledStore;
+    const QSize target = hasDetail ? imgWin->fitResolution() : imgWin->displayResolution();
+    const QImage level = pyramid.levelFor(target);
+    if (level.cacheKey() == displayedKey)
+        return;
+    displayedKey = level.cacheKey();
+    TRACE_SCOPE("QPixmap::fromImage");
+    imgWin->setImage(QPixmap::fromImage(level), fullSize);
+}
+
+// 分塊檔超過內嵌縮圖的解析度後，直接以顯示解析度讀取看得到的區塊。
+// 記憶體中的原圖：取樣倍率 factor 正好對應金字塔的第 log2(factor) 層，裁切該層即可；1:1 以上直接從原圖裁切
+QImage ImageProcessor::detailRegion(const QRect &rect, int factor) const
+{
+    if (tiledStore)
+        return tiledStore->readRegion(rect, factor);
+    if (factor == 1)
+        return img.copy(rect);
+    int index = 0;
+    while ((1 << index) < factor)
+        ++index;
+    if (pyramid.isNull() || index >= pyramid.levelCount())
+        return QImage();
+    const QImage level = pyramid.level(index);
+    const QRect part = QRect(rect.x() / factor, rect.y() / factor,
+                             (rect.width() + factor - 1) / factor, (rect.height() + factor - 1) / factor)
+                           .intersected(level.rect());
+    return part.isEmpty() ? QImage() : level.copy(part);
 }
 
 void ImageProcessor::showOpenFile()
@@ -146,17 +564,19 @@ void ImageProcessor::showOpenFile()
     filename = QFileDialog::getOpenFileName(this,
                                             QStringLiteral("開啟影像"),
                                             tr("."),
-                                            "bmp(*.bmp);;png(*.png);;jpeg(*.jpg)");
+                                            "bmp(*.bmp);;png(*.png);;jpeg(*.jpg);;tiles(*.iptiles)");
 
     if (!filename.isEmpty())
     {
-        if (img.isNull())
+        // 本視窗仍在載入時直接改載新檔，前一次載入會被取消
+        if (!hasImage())
         {
             loadFile(filename);
         }
         else
         {
             ImageProcessor *newIPWin = new ImageProcessor();
+            newIPWin->setAttribute(Qt::WA_DeleteOnClose);
             newIPWin->show();
             newIPWin->loadFile(filename);
         }
@@ -165,12 +585,10 @@ void ImageProcessor::showOpenFile()
 
 void ImageProcessor::showGeometryTransform()
 {
-    if(!img.isNull())
-    {
-        gWin->srcImg = img;
-        gWin->inWin->setPixmap(QPixmap::fromImage(gWin->srcImg));
+    ensureFullImage([this]() {
+        gWin->setSourceImage(img);
         gWin->show();
-    }
+    });
 }
 
 void ImageProcessor::mouseDoubleClickEvent(QMouseEvent * event)
@@ -181,31 +599,70 @@ void ImageProcessor::mouseDoubleClickEvent(QMouseEvent * event)
     qDebug()<< "雙擊";
 }
 
+// 只記下最新的位置，讀值與選取框在下一個畫面一次更新；高回報率的滑鼠不會讓每個事件都重算
 void ImageProcessor::mouseMoveEvent(QMouseEvent * event)
 {
-    int x = qRound(event->position().x());
-    int y = qRound(event->position().y());
+    if (!frames->isPending())
+    {
+        pendingReceived = InputLatency::timestamp();
+        pendingEvents = 0;
+    }
+    pendingPointer = event->position();
+    ++pendingEvents;
+    frames->requestFrame();
+}
+
+void ImageProcessor::updatePointer()
+{
+    const qint64 received = pendingReceived;
+    int x = qRound(pendingPointer.x());
+    int y = qRound(pendingPointer.y());
     QString str = "(" + QString::number(x) + ", " +
                   QString::number(y) + ")";
-    if (!img.isNull() && x >= 0 && x < img.width() && y >= 0 && y < img.height())
+    // 游標在影像上時改顯示原始解析度的座標與亮度；解碼完成前不讀取
+    const QPointF viewPos = imgWin->mapFrom(this, pendingPointer);
+    if (!isLoading() && hasImage() && imgWin->isOverImage(viewPos))
     {
-        int gray = qGray(img.pixel(x, y));
-        str += " = " + QString::number(gray);
+        const QPoint pos = imgWin->imagePixelAt(viewPos);
+        str = "(" + QString::number(pos.x()) + ", " + QString::number(pos.y()) + ")";
+        const int gray = grayAt(pos);
+        if (gray >= 0)
+            str += " = " + QString::number(gray);
+
+        if (!luma.isNull())
+        {
+            const int n = neighborhoodSpin->value();
+            const QRect around(pos.x() - n / 2, pos.y() - n / 2, n, n);
+            statsLabel->setText(QString("%1x%2 ").arg(n).arg(n) + statsText(luma.stats(around)) +
+                                selectionStatsText);
+        }
     }
 
+    // 讀值沒變時 QLabel 不會重繪，也就不列入延遲
+    if (str != MousePosLabel->text())
+        latency->inputReceived(InputLatency::PointerReadout, received, pendingEvents);
     MousePosLabel->setText(str);
     
     // 更新選取區域
     if (isSelecting)
     {
-        QPoint labelPos = imgWin->mapFrom(this, event->pos());
-        selectionEnd = labelPos;
-        update();  // 觸發重繪以顯示選取框
+        // 拖出影像外時停在邊緣像素；停在同一個像素時選取框不會重繪，也不列入延遲
+        const QPoint previousEnd = selectionEnd;
+        selectionEnd = imgWin->imagePixelAt(viewPos);
+        const QRect rect = QRect(selectionStart, selectionEnd).normalized();
+        // 拖曳中即時更新直方圖：只加減進出選取框的條帶，不必每次重算整個選取區域
+        if (histogram.hasSource())
+            statsLabel->setText(QString(QStringLiteral("選取 %1x%2 ")).arg(rect.width()).arg(rect.height()) +
+                                histogramText(histogram.update(rect)));
+        imgWin->setSelection(rect);  // 只重繪選取框新舊位置的邊線
+        if (selectionEnd != previousEnd)
+            latency->inputReceived(InputLatency::Selection, received, pendingEvents);
     }
 }
 
 void ImageProcessor::mousePressEvent(QMouseEvent * event)
 {
+    frames->flush();    // 先處理按下之前還在排隊的移動
     QString str = "(" + QString::number(qRound(event->position().x())) + ", " +
                   QString::number(qRound(event->position().y())) + ")";
     if (event->button() == Qt::LeftButton)
@@ -213,16 +670,18 @@ void ImageProcessor::mousePressEvent(QMouseEvent * event)
         statusBar()->showMessage(QStringLiteral("左鍵:") + str);
         
         // 開始區域選取（需按住 Ctrl 鍵）
-        if (event->modifiers() & Qt::ControlModifier && !img.isNull())
+        if (event->modifiers() & Qt::ControlModifier && hasImage())
         {
-            // 轉換座標到 label 座標
-            QPoint labelPos = imgWin->mapFrom(this, event->pos());
-            if (imgWin->rect().contains(labelPos))
+            // 以原始解析度座標記錄，縮放或平移畫面後選取範圍不變
+            const QPointF viewPos = imgWin->mapFrom(this, event->position());
+            if (imgWin->isOverImage(viewPos))
             {
                 isSelecting = true;
-                // 儲存 label 座標用於繪製選取框
-                selectionStart = labelPos;
-                selectionEnd = labelPos;
+                selectionStart = imgWin->imagePixelAt(viewPos);
+                selectionEnd = selectionStart;
+                imgWin->setSelection(QRect(selectionStart, selectionEnd));
+                if (histogram.hasSource())
+                    histogram.beginTracking(QRect());
                 statusBar()->showMessage(QStringLiteral("開始選取區域: ") + str);
             }
         }
@@ -236,6 +695,7 @@ void ImageProcessor::mousePressEvent(QMouseEvent * event)
 
 void ImageProcessor::mouseReleaseEvent(QMouseEvent * event)
 {
+    frames->flush();    // 選取框先更新到放開前最後的位置
     QString str = "(" + QString::number(qRound(event->position().x())) + ", " +
                   QString::number(qRound(event->position().y())) + ")";
     statusBar()->showMessage(QStringLiteral("釋放:")+str);
@@ -245,58 +705,40 @@ void ImageProcessor::mouseReleaseEvent(QMouseEvent * event)
     if (isSelecting && event->button() == Qt::LeftButton)
     {
         isSelecting = false;
-        
-        // 將 label 座標轉換為實際圖片座標
-        QPoint imgStart = labelToImageCoords(selectionStart);
-        QPoint imgEnd = labelToImageCoords(selectionEnd);
+        imgWin->setSelection(QRect());  // 清除選取框
         
         // 建立選取矩形（在圖片座標系統中）
-        QPoint topLeft(qMin(imgStart.x(), imgEnd.x()),
-                      qMin(imgStart.y(), imgEnd.y()));
-        QPoint bottomRight(qMax(imgStart.x(), imgEnd.x()),
-                          qMax(imgStart.y(), imgEnd.y()));
-        
-        selectionRect = QRect(topLeft, bottomRight);
+        selectionRect = QRect(selectionStart, selectionEnd).normalized();
         
         // 確保選取區域有效且在圖片範圍內
         if (selectionRect.width() > 10 && selectionRect.height() > 10)
         {
             // 限制在圖片範圍內
-            selectionRect = selectionRect.intersected(QRect(0, 0, img.width(), img.height()));
+            selectionRect = selectionRect.intersected(QRect(QPoint(0, 0), fullSize));
             
             if (!selectionRect.isEmpty())
             {
+                // 選取區域的統計只在選取改變時算一次，之後每次移動滑鼠都沿用
+                if (!luma.isNull())
+                {
+                    selectionStatsText = QString(QStringLiteral("  選取 %1x%2 "))
+                                             .arg(selectionRect.width()).arg(selectionRect.height()) +
+                                         statsText(luma.stats(selectionRect));
+                    if (histogram.hasSource())
+                        selectionStatsText += " " + histogramText(histogram.update(selectionRect));
+                    statsLabel->setText(selectionStatsText.trimmed());
+                }
                 statusBar()->showMessage(QStringLiteral("區域已選取，正在開啟放大視窗..."), 2000);
                 openZoomWindow();
             }
         }
-        update();  // 清除選取框
-    }
-}
-
-// 繪製選取框
-void ImageProcessor::paintEvent(QPaintEvent *event)
-{
-    QMainWindow::paintEvent(event);
-    
-    // 繪製選取框
-    if (isSelecting)
-    {
-        QPainter painter(this);
-        painter.setPen(QPen(Qt::blue, 2, Qt::DashLine));
-        
-        QPoint start = imgWin->mapTo(this, selectionStart);
-        QPoint end = imgWin->mapTo(this, selectionEnd);
-        
-        QRect rect(start, end);
-        painter.drawRect(rect.normalized());
     }
 }
 
 // 開啟放大視窗
 void ImageProcessor::openZoomWindow()
 {
-    if (img.isNull() || selectionRect.isEmpty())
+    if (selectionRect.isEmpty() || !hasImage())
     {
         return;
     }
@@ -310,37 +752,57 @@ void ImageProcessor::openZoomWindow()
     
     if (ok)
     {
-        // 建立並顯示放大視窗
-        ZoomWindow *zoomWin = new ZoomWindow(img, selectionRect, zoomFactor);
-        zoomWin->setAttribute(Qt::WA_DeleteOnClose);  // 關閉時自動刪除
-        zoomWin->show();
+        // 只取出選取範圍：分塊檔只會讀到範圍碰到的區塊；只有預覽時先在背景解出原始解析度
+        const QRect rect = selectionRect;
+        const auto showZoom = [this, rect, zoomFactor]() {
+            const QImage region = regionImage(rect);
+            if (region.isNull())
+                return;
+
+            // 建立並顯示放大視窗
+            ZoomWindow *zoomWin = new ZoomWindow(region, QRect(QPoint(0, 0), region.size()), zoomFactor);
+            zoomWin->setAttribute(Qt::WA_DeleteOnClose);  // 關閉時自動刪除
+            zoomWin->show();
+        };
+        if (img.isNull() && !tiledStore)
+            ensureFullImage(showZoom);
+        else
+            showZoom();
     }
 }
 
-// 將 label 座標轉換為實際圖片座標
-QPoint ImageProcessor::labelToImageCoords(const QPoint &labelPos)
+int ImageProcessor::grayAt(const QPoint &pos) const
 {
-    if (img.isNull() || !imgWin || imgWin->pixmap().isNull())
-        return labelPos;
-    
-    // 取得 label 和圖片的尺寸
-    QSize labelSize = imgWin->size();
-    QSize imgSize = img.size();
-    
-    // 因為使用 setScaledContents(true)，圖片會縮放以填滿 label
-    // 計算縮放比例
-    double scaleX = static_cast<double>(imgSize.width()) / labelSize.width();
-    double scaleY = static_cast<double>(imgSize.height()) / labelSize.height();
-    
-    // 轉換座標
-    int imgX = static_cast<int>(labelPos.x() * scaleX);
-    int imgY = static_cast<int>(labelPos.y() * scaleY);
-    
-    // 確保座標在圖片範圍內
-    imgX = qBound(0, imgX, img.width() - 1);
-    imgY = qBound(0, imgY, img.height() - 1);
-    
-    return QPoint(imgX, imgY);
+    if (!luma.isNull())
+        return luma.value(pos.x(), pos.y());
+    // 亮度平面還在建立時逐點讀原圖；分塊檔只讀游標所在的區塊
+    if (!img.isNull() && img.rect().contains(pos))
+        return qGray(img.pixel(pos));
+    if (tiledStore && QRect(QPoint(0, 0), fullSize).contains(pos))
+        return qGray(tiledStore->pixel(pos.x(), pos.y()));
+    return -1;
+}
+
+QString ImageProcessor::statsText(const LumaPlane::Stats &stats)
+{
+    if (!stats.isValid())
+        return QString();
+    return QString(QStringLiteral("平均 %1 最小 %2 最大 %3 標準差 %4"))
+        .arg(stats.mean, 0, 'f', 1).arg(stats.min).arg(stats.max).arg(stats.stdDev, 0, 'f', 1);
+}
+
+QString ImageProcessor::histogramText(const Histogram &histogram)
+{
+    if (!histogram.count())
+        return QString();
+    return QString(QStringLiteral("P5 %1 中位數 %2 P95 %3 熵 %4 位元 R/G/B 平均 %5/%6/%7"))
+        .arg(histogram.percentile(Histogram::Luma, 5))
+        .arg(histogram.percentile(Histogram::Luma, 50))
+        .arg(histogram.percentile(Histogram::Luma, 95))
+        .arg(histogram.entropy(Histogram::Luma), 0, 'f', 2)
+        .arg(histogram.mean(Histogram::Red), 0, 'f', 1)
+        .arg(histogram.mean(Histogram::Green), 0, 'f', 1)
+        .arg(histogram.mean(Histogram::Blue), 0, 'f', 1);
 }
 
 
@@ -9,7 +9,24 @@
 #include <QLabel>
 #include <QMouseEvent>
 #include <QStatusBar>
+#include <QFutureWatcher>
+#include <QAtomicInt>
+#include <QProgressBar>
+#include <QTimer>
+#include <QSharedPointer>
+#include <QSpinBox>
+#include <QToolButton>
+#include <functional>
 #include "imagetransform.h"
+#include "imagepyramid.h"
+#include "imageloader.h"
+#include "tiledimagestore.h"
+#include "lumaplane.h"
+#include "histogramengine.h"
+#include "traceoverlay.h"
+#include "inputlatency.h"
+#include "imageviewport.h"
+#include "framescheduler.h"
 
 // 前置宣告，避免循環包含
 class ZoomWindow;
@@ -27,42 +44,106 @@ public:
     void loadFile(QString filename);
     void loadImage(const QImage &image);
 
+    // 分塊檔展開成整張 QImage 的上限，超過時只能透過選取區域讀取
+    static const qint64 MaxExpandedBytes = qint64(1) << 30;
+
+    // 放大/縮小動作使用的縮放，也供不開視窗的批次模式使用
+    static QImage zoomImage(const QImage &image, double factor);
+
 protected:
     void mouseDoubleClickEvent(QMouseEvent * event);
     void mouseMoveEvent(QMouseEvent * event);
     void mousePressEvent(QMouseEvent * event);
     void mouseReleaseEvent(QMouseEvent * event);
-    void paintEvent(QPaintEvent *event);  // 繪製選取框
 
 private slots:
     void showOpenFile();
     void showGeometryTransform();
     void openZoomWindow();  // 開啟放大視窗
+    void pyramidReady();    // 背景的影像金字塔建好了
+    void loadFinished();    // 背景解碼完成（或被取消）
+    void updateLoadProgress();  // 定時把已讀取的位元組數反映到進度列
+    void lumaReady();       // 背景的亮度平面建好了
+    void setTracing(bool enabled);  // 開關效能追蹤與狀態列的延遲顯示
+    void exportTrace();     // 把追蹤到的事件存成 Chrome trace JSON
+    void setLatencyProfiling(bool enabled);     // 開關輸入到畫面的延遲分析
+    void exportLatencyReport();     // 把延遲直方圖與掉格統計存成文字報告
+    void updatePointer();   // 每個畫面一次：以最新的游標位置更新讀值、統計與選取框
 
 private:
     ImageTransform *gWin;
     QWidget   *central;
     QMenu     *fileMenu;
     QToolBar  *fileTool;
-    QImage    img;
+    QImage    img;          // 原始解析度影像；只有預覽時為空，需要時由 ensureFullImage 補解
+    QImage    previewImg;   // 開檔時直接縮小解碼的預覽，只供顯示
+    QString   previewSource;    // 預覽對應的檔名
+    QSize     fullSize;     // 原始解析度，選取與座標換算都以此為準
+    QSharedPointer<TiledImageStore> tiledStore;  // 開啟分塊檔時的來源，img 保持為空，只讀需要的區塊
     QString   filename;
-    QLabel    *imgWin;
+    ImageViewport *imgWin;  // 影像顯示，選取框與十字線是它的疊加層
     QAction   *openFileAction;
     QAction   *exitAction;
     QAction   *zoomInAction;
     QAction   *zoomOutAction;
     double scaleFactor = 1.0;
     QAction   *geometryAction;
+    QAction   *traceAction;         // 效能追蹤（可勾選）
+    QAction   *exportTraceAction;
+    TraceOverlay *traceOverlay;     // 狀態列上最近一次操作的延遲與 p50/p99
+    QAction   *latencyAction;       // 輸入延遲分析（可勾選）
+    QAction   *latencyReportAction;
+    InputLatency *latency;          // 滑鼠讀值與選取框從事件到畫面的延遲
+    FrameScheduler *frames;         // 滑鼠移動合併到每個畫面處理一次
+    QPointF pendingPointer;         // 還沒處理的最新游標位置（本視窗座標）
+    qint64 pendingReceived;         // 合併的移動事件中最早開始處理的時間
+    int pendingEvents;              // 合併了幾個移動事件
     QLabel    *statusLabel;
     QLabel    *MousePosLabel;
+    QLabel    *statsLabel;          // 游標附近 N x N 與選取區域的亮度統計
+    QSpinBox  *neighborhoodSpin;    // 統計範圍 N
     
     // 區域選取相關變數
     bool isSelecting;           // 是否正在選取區域
-    QPoint selectionStart;      // 選取起始點
-    QPoint selectionEnd;        // 選取結束點
+    QPoint selectionStart;      // 選取起始點（原始解析度座標）
+    QPoint selectionEnd;        // 選取結束點（原始解析度座標）
     QRect selectionRect;        // 選取的矩形區域
     
-    // 輔助方法：將 label 座標轉換為實際圖片座標
-    QPoint labelToImageCoords(const QPoint &labelPos);
+    // 顯示用影像金字塔：imgWin 只放與畫面大小相近的層級，不放整張原圖
+    ImagePyramid pyramid;
+    QFutureWatcher<ImagePyramid> *pyramidWatcher;
+    QAtomicInt pyramidGeneration;   // 換圖時遞增，讓舊的建立工作提早結束
+    qint64 displayedKey;            // imgWin 目前顯示層級的 cacheKey
+
+    // 背景載入：解碼期間視窗保持可操作，灰階讀值暫停
+    QFutureWatcher<ImageLoader::Result> *loadWatcher;
+    QSharedPointer<LoadProgress> loadProgress;  // 進行中載入的共用狀態，沒有載入時為空
+    int loadGeneration;             // 每次載入遞增，用來丟棄被取代的結果
+
+    // 亮度平面：原始解析度影像載入後在背景建立一次，讀值與統計都從這裡取
+    LumaPlane luma;
+    QFutureWatcher<LumaPlane> *lumaWatcher;
+    QString selectionStatsText;     // 目前選取區域的統計，選取改變時才重算
+    HistogramEngine histogram;      // 拖曳選取時增量更新的直方圖
+    QProgressBar *loadProgressBar;  // 狀態列上的載入進度
+    QToolButton *cancelLoadButton;  // 與進度列一起顯示，取消進行中的載入
+    std::function<void()> pendingAction;    // 等原始解析度解完才執行的動作，沒有時為空
+    QTimer *loadProgressTimer;      // 載入中定時更新進度列
+
+    void showNewImage();            // 載入新影像後更新顯示並開始建立金字塔
+    void updateDisplayPixmap();     // 依 imgWin 目前的顯示解析度挑選金字塔層級
+    QImage detailRegion(const QRect &rect, int factor) const;   // imgWin 放大後看得到的區塊
+    void cancelLoad();              // 取消進行中的背景載入
+    void showLoadProgress(const QString &message);  // 背景載入開始：狀態列顯示進度列與取消鈕
+    bool isLoading() const;
+    bool hasImage() const;          // 已有可顯示的影像（原圖或預覽）
+    // 需要原始解析度時才執行 action：只有預覽或分塊檔時先在背景解出整張，完成後才執行；失敗或取消時不執行
+    void ensureFullImage(const std::function<void()> &action);
+    const QImage &shownImage() const;   // 目前用來顯示的影像
+    bool openTiledFile(const QString &path);    // 開啟分塊檔：顯示內嵌縮圖，不展開整張
+    QImage regionImage(const QRect &rect) const;    // 原始解析度下 rect 範圍的影像，只有預覽時為空
+    int grayAt(const QPoint &pos) const;        // 原始解析度座標的亮度，無法讀取時回傳 -1
+    static QString statsText(const LumaPlane::Stats &stats);
+    static QString histogramText(const Histogram &histogram);
 };
 #endif // IMAGEPROCESSOR_H
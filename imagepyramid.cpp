@@ -0,0 +1,217 @@
+#include "imagepyramid.h"
+#include "pixelformats.h"
+#include "simdsupport.h"
+
+namespace {
+
+const int MinLevelSize = 32;    // 任一邊小於此值就不再往下建
+const int BandHeight = 64;      // 平行處理時每條帶的目的列數
+
+/*------------------------------ 純量核心 ------------------------------*/
+
+// 一列目的像素：r0、r1 為來源的相鄰兩列，每個通道為 (a+b+c+d+2) >> 2
+void reduceRow32Scalar(const uchar *r0, const uchar *r1, uchar *dst, int dstWidth)
+{
+    for (int i = 0; i < dstWidth; ++i)
+    {
+        const uchar *a = r0 + i * 8;
+        const uchar *b = r1 + i * 8;
+        for (int c = 0; c < 4; ++c)
+            dst[i * 4 + c] = uchar((a[c] + a[c + 4] + b[c] + b[c + 4] + 2) >> 2);
+    }
+}
+
+void reduceRow8Scalar(const uchar *r0, const uchar *r1, uchar *dst, int dstWidth)
+{
+    for (int i = 0; i < dstWidth; ++i)
+        dst[i] = uchar((r0[2 * i] + r0[2 * i + 1] + r1[2 * i] + r1[2 * i + 1] + 2) >> 2);
+}
+
+// 16 位元通道（RGBA64_Premultiplied），加總需要 32 位元
+void reduceRow64Scalar(const uchar *r0, const uchar *r1, uchar *dst, int dstWidth)
+{
+    const quint16 *a = reinterpret_cast<const quint16 *>(r0);
+    const quint16 *b = reinterpret_cast<const quint16 *>(r1);
+    quint16 *out = reinterpret_cast<quint16 *>(dst);
+    for (int i = 0; i < dstWidth * 4; ++i)
+    {
+        const int c = (i >> 2) * 8 + (i & 3);
+        out[i] = quint16((quint32(a[c]) + a[c + 4] + b[c] + b[c + 4] + 2) >> 2);
+    }
+}
+
+/*------------------------------ SSE2 核心 ------------------------------*/
+
+#if defined(IP_X86_SIMD)
+
+// 一次產生四個目的像素：兩列各讀八個來源像素，展開成 16 位元後相加
+IP_TARGET("sse2")
+void reduceRow32Sse2(const uchar *r0, const uchar *r1, uchar *dst, int dstWidth)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    int i = 0;
+    for (; i + 4 <= dstWidth; i += 4)
+    {
+        const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r0 + i * 8));
+        const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r0 + i * 8 + 16));
+        const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r1 + i * 8));
+        const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r1 + i * 8 + 16));
+        // 每個暫存器放兩個來源像素（上下兩列已相加）
+        const __m128i p01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+        const __m128i p23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+        const __m128i p45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+        const __m128i p67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+        // 左右兩像素相加：低 64 位元即為結果
+        const __m128i q0 = _mm_add_epi16(p01, _mm_srli_si128(p01, 8));
+        const __m128i q1 = _mm_add_epi16(p23, _mm_srli_si128(p23, 8));
+        const __m128i q2 = _mm_add_epi16(p45, _mm_srli_si128(p45, 8));
+        const __m128i q3 = _mm_add_epi16(p67, _mm_srli_si128(p67, 8));
+        const __m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(q0, q1), two), 2);
+        const __m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(q2, q3), two), 2);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), _mm_packus_epi16(lo, hi));
+    }
+    if (i < dstWidth)
+        reduceRow32Scalar(r0 + i * 8, r1 + i * 8, dst + i * 4, dstWidth - i);
+}
+
+// 一次產生十六個目的像素：偶數與奇數位元組分開取出後相加
+IP_TARGET("sse2")
+void reduceRow8Sse2(const uchar *r0, const uchar *r1, uchar *dst, int dstWidth)
+{
+    const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+    const __m128i two = _mm_set1_epi16(2);
+    int i = 0;
+    for (; i + 16 <= dstWidth; i += 16)
+    {
+        __m128i sums[2];
+        for (int half = 0; half < 2; ++half)
+        {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r0 + i * 2 + half * 16));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r1 + i * 2 + half * 16));
+            const __m128i pairsA = _mm_add_epi16(_mm_and_si128(a, lowBytes), _mm_srli_epi16(a, 8));
+            const __m128i pairsB = _mm_add_epi16(_mm_and_si128(b, lowBytes), _mm_srli_epi16(b, 8));
+            sums[half] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(pairsA, pairsB), two), 2);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(sums[0], sums[1]));
+    }
+    if (i < dstWidth)
+        reduceRow8Scalar(r0 + i * 2, r1 + i * 2, dst + i, dstWidth - i);
+}
+
+#endif // IP_X86_SIMD
+
+typedef void (*ReduceRow)(const uchar *r0, const uchar *r1, uchar *dst, int dstWidth);
+
+// 每種正規格式在編譯期決定核心；8 位元的兩種 32 位元格式共用同一個
+template<typename F>
+ReduceRow reduceRowFor()
+{
+    if constexpr (F::bytesPerPixel == 8)
+        return reduceRow64Scalar;
+#if defined(IP_X86_SIMD)
+    return F::isGray ? reduceRow8Sse2 : reduceRow32Sse2;
+#else
+    return F::isGray ? reduceRow8Scalar : reduceRow32Scalar;
+#endif
+}
+
+ReduceRow selectReduceRow(QImage::Format format)
+{
+    ReduceRow row = nullptr;
+    PixelFormats::dispatch(format, [&](auto f) { row = reduceRowFor<decltype(f)>(); });
+    return row;
+}
+
+}
+
+ImagePyramid::ImagePyramid()
+    : key(0)
+{
+}
+
+ImagePyramid::ImagePyramid(const QImage &image, const Parallel::CancelCheck &isCancelled)
+    : key(image.cacheKey())
+{
+    if (image.isNull())
+        return;
+    levels.append(image);
+
+    QImage current = image;
+    while (current.width() / 2 >= MinLevelSize && current.height() / 2 >= MinLevelSize)
+    {
+        current = reduce(current, isCancelled);
+        if (current.isNull())
+        {
+            levels.clear();
+            return;
+        }
+        levels.append(current);
+    }
+}
+
+bool ImagePyramid::isNull() const
+{
+    return levels.isEmpty();
+}
+
+int ImagePyramid::levelCount() const
+{
+    return levels.size();
+}
+
+QImage ImagePyramid::level(int index) const
+{
+    return levels.value(index);
+}
+
+QSize ImagePyramid::baseSize() const
+{
+    return levels.isEmpty() ? QSize() : levels.first().size();
+}
+
+qint64 ImagePyramid::sourceKey() const
+{
+    return key;
+}
+
+QImage ImagePyramid::levelFor(const QSize &target) const
+{
+    if (levels.isEmpty())
+        return QImage();
+    for (int i = levels.size() - 1; i > 0; --i)
+    {
+        const QImage &candidate = levels.at(i);
+        if (candidate.width() >= target.width() && candidate.height() >= target.height())
+            return candidate;
+    }
+    return levels.first();
+}
+
+QImage ImagePyramid::reduce(const QImage &src, const Parallel::CancelCheck &isCancelled)
+{
+    if (src.width() < 2 || src.height() < 2)
+        return QImage();
+
+    // 正規格式都可以直接逐通道平均（含透明度的格式都是 premultiplied，邊緣不會混出錯誤顏色）
+    const QImage source = PixelFormats::normalized(src);
+    QImage dst(source.width() / 2, source.height() / 2, source.format());
+    if (dst.isNull())
+        return QImage();
+
+    const ReduceRow reduceRow = selectReduceRow(source.format());
+    const uchar *srcBits = source.constBits();
+    const qsizetype srcBpl = source.bytesPerLine();
+    uchar *dstBits = dst.bits();
+    const qsizetype dstBpl = dst.bytesPerLine();
+    const int dstWidth = dst.width();
+
+    const bool done = Parallel::forEachBand(dst.height(), BandHeight, [&](int first, int last) {
+        for (int y = first; y < last; ++y)
+        {
+            const uchar *r0 = srcBits + qsizetype(2 * y) * srcBpl;
+            reduceRow(r0, r0 + srcBpl, dstBits + y * dstBpl, dstWidth);
+        }
+    }, isCancelled);
+    return done ? dst : QImage();
+}
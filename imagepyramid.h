@@ -0,0 +1,36 @@
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include <QImage>
+#include <QVector>
+#include "parallelfor.h"
+
+// 影像金字塔（mip-map）：第 0 層為原圖，之後每層以 2x2 平均縮成一半，
+// 顯示時取「不小於螢幕上大小」中最小的一層，避免每次重繪都縮放整張原圖
+class ImagePyramid
+{
+public:
+    ImagePyramid();
+    // 同步建立整個金字塔；呼叫端負責放到背景執行緒。被取消時得到空金字塔
+    explicit ImagePyramid(const QImage &image,
+                          const Parallel::CancelCheck &isCancelled = Parallel::CancelCheck());
+
+    bool isNull() const;
+    int levelCount() const;
+    QImage level(int index) const;
+    QSize baseSize() const;
+    qint64 sourceKey() const;   // 建立時原圖的 cacheKey，用來判斷是否仍對應目前的影像
+
+    // 兩個邊都不小於 target 的最小層級；沒有這樣的層級時回傳原圖
+    QImage levelFor(const QSize &target) const;
+
+    // 2x2 盒狀平均縮小一半（寬高向下取整），32 位元與 Grayscale8 走 SIMD
+    static QImage reduce(const QImage &src,
+                         const Parallel::CancelCheck &isCancelled = Parallel::CancelCheck());
+
+private:
+    QVector<QImage> levels;
+    qint64 key;
+};
+
+#endif // IMAGEPYRAMID_H
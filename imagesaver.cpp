@@ -0,0 +1,128 @@
+#include "imagesaver.h"
+#include "tracer.h"
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImageWriter>
+#include <QtConcurrent/QtConcurrentRun>
+
+ImageSaver::ImageSaver(QStatusBar *statusBar, QObject *parent)
+    : QObject(parent), statusBar(statusBar)
+{
+    progressBar = new QProgressBar;
+    progressBar->setFixedWidth(150);
+    progressBar->setTextVisible(false);
+    progressBar->hide();
+    statusBar->addPermanentWidget(progressBar);
+
+    progressTimer = new QTimer(this);
+    progressTimer->setInterval(100);
+    connect(progressTimer, &QTimer::timeout, this, &ImageSaver::updateProgress);
+
+    watcher = new QFutureWatcher<Result>(this);
+    connect(watcher, &QFutureWatcher<Result>::finished, this, &ImageSaver::saveFinished);
+}
+
+ImageSaver::~ImageSaver()
+{
+    // 視窗關閉時仍要把使用者要求的檔案寫完：等進行中的存檔，排隊中的直接在這裡寫
+    watcher->waitForFinished();
+    for (const Job &job : pending)
+        write(job.produce, job.filename, job.format, job.preset, QSharedPointer<SaveProgress>::create());
+}
+
+void ImageSaver::save(const QImage &image, const QString &filename, const QByteArray &format,
+                      PngEncoder::Preset preset)
+{
+    // 只持有共用的影像資料；視窗之後修改影像時會自行複製，不影響存檔
+    save([image]() { return image; }, filename, format, preset);
+}
+
+void ImageSaver::save(const Producer &produce, const QString &filename, const QByteArray &format,
+                      PngEncoder::Preset preset)
+{
+    pending.append({ produce, filename, format, preset });
+    if (!isSaving())
+        startNext();
+    else
+        statusBar->showMessage(QStringLiteral("已排入存檔佇列：") + filename, 3000);
+}
+
+bool ImageSaver::isSaving() const
+{
+    return !progress.isNull();
+}
+
+ImageSaver::Result ImageSaver::write(const Producer &produce, const QString &filename, const QByteArray &format,
+                                     PngEncoder::Preset preset, const QSharedPointer<SaveProgress> &progress)
+{
+    TRACE_SCOPE("ImageSaver::write");
+    Result result;
+    result.filename = filename;
+    QElapsedTimer timer;
+    timer.start();
+
+    const QImage image = produce();
+    if (image.isNull())
+    {
+        result.error = QStringLiteral("沒有可儲存的影像");
+        return result;
+    }
+
+    QByteArray type = format.toLower();
+    if (type.isEmpty())
+        type = QFileInfo(filename).suffix().toLower().toLatin1();
+    if (type.isEmpty() || type == "png")
+    {
+        result.ok = PngEncoder::save(image, filename, preset, progress.data(), &result.error);
+    }
+    else
+    {
+        QImageWriter writer(filename, type);
+        result.ok = writer.write(image);
+        if (!result.ok)
+            result.error = writer.errorString();
+    }
+    result.elapsedMs = timer.elapsed();
+    return result;
+}
+
+void ImageSaver::startNext()
+{
+    if (pending.isEmpty())
+        return;
+    const Job job = pending.takeFirst();
+    progress = QSharedPointer<SaveProgress>::create();
+    watcher->setFuture(QtConcurrent::run(ImageSaver::write, job.produce, job.filename, job.format, job.preset,
+                                         progress));
+
+    progressBar->setRange(0, 0);  // 影像產生完、開始編碼前顯示忙碌狀態
+    progressBar->show();
+    progressTimer->start();
+    statusBar->showMessage(QStringLiteral("正在存檔 ") + job.filename);
+}
+
+void ImageSaver::updateProgress()
+{
+    if (!progress)
+        return;
+    const int total = progress->totalRows.loadRelaxed();
+    if (total <= 0)
+        return;
+    // 以千分比表示，避免大影像超出 int 範圍
+    progressBar->setRange(0, 1000);
+    progressBar->setValue(int(qint64(progress->rowsDone.loadRelaxed()) * 1000 / total));
+}
+
+void ImageSaver::saveFinished()
+{
+    const Result result = watcher->result();
+    progress.reset();
+    progressTimer->stop();
+    progressBar->hide();
+
+    if (result.ok)
+        statusBar->showMessage(QStringLiteral("圖片已儲存：%1（%2 ms）").arg(result.filename).arg(result.elapsedMs), 5000);
+    else
+        statusBar->showMessage(QStringLiteral("儲存失敗：") + result.filename + ": " + result.error);
+    startNext();
+}
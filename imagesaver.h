@@ -0,0 +1,72 @@
+#ifndef IMAGESAVER_H
+#define IMAGESAVER_H
+
+#include <QObject>
+#include <QImage>
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QFutureWatcher>
+#include <QSharedPointer>
+#include <QTimer>
+#include <QProgressBar>
+#include <QStatusBar>
+#include <functional>
+#include "pngencoder.h"
+
+// 背景存檔：產生影像、編碼與寫檔都在工作執行緒進行，進度與結果顯示在視窗的狀態列。
+// 同一個視窗連續存檔時依序排隊；物件解構時會等所有存檔寫完，不會丟掉使用者要存的檔案
+class ImageSaver : public QObject
+{
+    Q_OBJECT
+
+public:
+    // 在工作執行緒呼叫，產生要存的影像（例如存檔時才合成的完整解析度結果）
+    typedef std::function<QImage()> Producer;
+
+    struct Result
+    {
+        QString filename;
+        QString error;
+        qint64  elapsedMs = 0;
+        bool    ok = false;
+    };
+
+    ImageSaver(QStatusBar *statusBar, QObject *parent = nullptr);
+    ~ImageSaver();
+
+    // format 為空時依副檔名決定；PNG 交給平行的 PngEncoder，其他格式以 QImageWriter 寫入
+    void save(const QImage &image, const QString &filename, const QByteArray &format,
+              PngEncoder::Preset preset);
+    void save(const Producer &produce, const QString &filename, const QByteArray &format,
+              PngEncoder::Preset preset);
+    bool isSaving() const;
+
+    // 存檔本體，供 QtConcurrent::run 在背景執行緒呼叫
+    static Result write(const Producer &produce, const QString &filename, const QByteArray &format,
+                        PngEncoder::Preset preset, const QSharedPointer<SaveProgress> &progress);
+
+private slots:
+    void updateProgress();  // 定時把編碼進度顯示在進度條
+    void saveFinished();    // 一個存檔完成，顯示結果並開始下一個
+
+private:
+    struct Job
+    {
+        Producer produce;
+        QString filename;
+        QByteArray format;
+        PngEncoder::Preset preset;
+    };
+
+    void startNext();
+
+    QStatusBar *statusBar;
+    QProgressBar *progressBar;
+    QTimer *progressTimer;
+    QFutureWatcher<Result> *watcher;
+    QSharedPointer<SaveProgress> progress;  // 進行中存檔的共用狀態，沒有存檔時為空
+    QList<Job> pending;                     // 排隊中的存檔
+};
+
+#endif // IMAGESAVER_H
@@ -0,0 +1,153 @@
+#include "imagestore.h"
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <utility>
+
+namespace {
+
+const qint64 DefaultBudgetMB = 2048;
+
+QString sourceKey(const QString &path)
+{
+    return QStringLiteral("file:") + QFileInfo(path).absoluteFilePath();
+}
+
+}
+
+ImageStore &ImageStore::instance()
+{
+    static ImageStore store;
+    return store;
+}
+
+ImageStore::ImageStore()
+    : clock(0)
+{
+    bool ok = false;
+    const qint64 megabytes = qEnvironmentVariableIntValue("IP_IMAGE_BUDGET_MB", &ok);
+    limit = (ok && megabytes > 0 ? megabytes : DefaultBudgetMB) * 1024 * 1024;
+}
+
+void ImageStore::setBudget(qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    limit = bytes;
+    trimLocked();
+}
+
+qint64 ImageStore::budget() const
+{
+    QMutexLocker locker(&mutex);
+    return limit;
+}
+
+qint64 ImageStore::usedBytes() const
+{
+    QMutexLocker locker(&mutex);
+    qint64 total = 0;
+    for (const Entry &entry : entries)
+        total += entry.image.sizeInBytes();
+    return total;
+}
+
+QImage ImageStore::source(const QString &path)
+{
+    const QFileInfo info(path);
+    QMutexLocker locker(&mutex);
+    auto it = entries.find(sourceKey(path));
+    if (it == entries.end())
+        return QImage();
+    // 檔案在磁碟上被改過，舊的解碼結果作廢
+    if (it->modified != info.lastModified() || it->fileSize != info.size())
+    {
+        entries.erase(it);
+        return QImage();
+    }
+    it->lastUse = ++clock;
+    return it->image;
+}
+
+QImage ImageStore::addSource(const QString &path, const QImage &image)
+{
+    if (image.isNull())
+        return image;
+    const QFileInfo info(path);
+    QMutexLocker locker(&mutex);
+    Entry &entry = entries[sourceKey(path)];
+    entry.image = image;
+    entry.modified = info.lastModified();
+    entry.fileSize = info.size();
+    entry.lastUse = ++clock;
+    entry.derived = false;
+    trimLocked();
+    return image;
+}
+
+QString ImageStore::derivedKey(const QImage &source, const QString &operation)
+{
+    return QString::number(source.cacheKey()) + QLatin1Char(':') + operation;
+}
+
+QImage ImageStore::derived(const QString &key)
+{
+    QMutexLocker locker(&mutex);
+    auto it = entries.find(key);
+    if (it == entries.end())
+        return QImage();
+    it->lastUse = ++clock;
+    return it->image;
+}
+
+QImage ImageStore::addDerived(const QString &key, const QImage &image)
+{
+    if (image.isNull())
+        return image;
+    QMutexLocker locker(&mutex);
+    Entry &entry = entries[key];
+    entry.image = image;
+    entry.lastUse = ++clock;
+    entry.derived = true;
+    trimLocked();
+    return image;
+}
+
+QImage ImageStore::derived(const QString &key, const std::function<QImage()> &generate)
+{
+    const QImage cached = derived(key);
+    if (!cached.isNull())
+        return cached;
+    // 產生時不持有鎖，其他執行緒仍可使用倉庫
+    return addDerived(key, generate());
+}
+
+void ImageStore::trim()
+{
+    QMutexLocker locker(&mutex);
+    trimLocked();
+}
+
+// isDetached() 為真代表只有倉庫自己持有這張影像，淘汰後記憶體才真的會釋放
+void ImageStore::trimLocked()
+{
+    qint64 total = 0;
+    for (const Entry &entry : std::as_const(entries))
+        total += entry.image.sizeInBytes();
+
+    while (total > limit)
+    {
+        auto victim = entries.end();
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (!it->image.isDetached())
+                continue;
+            if (victim == entries.end() ||
+                (it->derived && !victim->derived) ||
+                (it->derived == victim->derived && it->lastUse < victim->lastUse))
+                victim = it;
+        }
+        if (victim == entries.end())
+            break;
+        total -= victim->image.sizeInBytes();
+        entries.erase(victim);
+    }
+}
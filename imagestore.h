@@ -0,0 +1,60 @@
+#ifndef IMAGESTORE_H
+#define IMAGESTORE_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#include <functional>
+
+// 全程式共用的影像倉庫
+// 來源影像（從檔案解碼的原圖）同一個檔案只保留一份，各視窗拿到的 QImage 共用同一塊緩衝（copy-on-write）；
+// 衍生影像（縮放、旋轉等可以重算的結果）以「來源 cacheKey + 運算」為鍵快取。
+// 總量超過預算時先依 LRU 淘汰沒有視窗在用的衍生影像，其次才是沒有視窗在用的來源影像；
+// 仍被視窗持有的影像淘汰了也不會釋放記憶體，因此不動
+class ImageStore
+{
+public:
+    static ImageStore &instance();
+
+    // 位元組預算，預設 2 GB，可用環境變數 IP_IMAGE_BUDGET_MB 調整
+    void setBudget(qint64 bytes);
+    qint64 budget() const;
+    qint64 usedBytes() const;
+
+    // 來源影像：path 的大小與修改時間沒變時回傳先前解碼的影像，否則回傳空影像
+    QImage source(const QString &path);
+    // 登錄來源影像，回傳倉庫中的那一份（與傳入的共用緩衝）
+    QImage addSource(const QString &path, const QImage &image);
+
+    // 衍生影像的鍵：來源影像的 cacheKey 加上運算描述，例如 "zoom:1.5"
+    static QString derivedKey(const QImage &source, const QString &operation);
+    QImage derived(const QString &key);     // 沒有快取時回傳空影像
+    QImage addDerived(const QString &key, const QImage &image);
+    // 有快取就直接回傳，否則呼叫 generate 產生並登錄
+    QImage derived(const QString &key, const std::function<QImage()> &generate);
+
+    void trim();    // 超過預算時依序淘汰
+
+private:
+    ImageStore();
+
+    struct Entry
+    {
+        QImage    image;
+        QDateTime modified;     // 來源檔案的修改時間
+        qint64    fileSize = 0;
+        quint64   lastUse = 0;
+        bool      derived = false;
+    };
+
+    void trimLocked();
+
+    mutable QMutex mutex;
+    QHash<QString, Entry> entries;
+    quint64 clock;
+    qint64  limit;
+};
+
+#endif // IMAGESTORE_H
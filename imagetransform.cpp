@@ -4,11 +4,111 @@
 #include <QPainter>
 #include <QFileDialog>
 #include <QDebug>
+#include <QtConcurrent/QtConcurrentRun>
+#include "imagestore.h"
+#include "tracer.h"
+
+namespace {
+
+// 拖曳中停頓多久就改算完整解析度（毫秒）
+const int IdleFullResolutionDelay = 250;
+
+// 送給工作執行緒的旋轉要求
+struct RotateRequest
+{
+    QImage source;      // 完整解析度來源
+    QImage proxy;       // 預覽用代理影像，空影像代表需要重建
+    QSize  displaySize; // inWin 剛好放下影像時需要的裝置像素大小
+    int    angle;
+    bool   mirrorH;     // 旋轉前先套用的鏡射
+    bool   mirrorV;
+    bool   preview;
+};
+
+// ImageStore 中完整解析度結果的運算名稱
+QString transformOp(bool mirrorH, bool mirrorV, int angle)
+{
+    return QString("mirror:%1%2:rotate:%3").arg(int(mirrorH)).arg(int(mirrorV)).arg(angle);
+}
+
+// 顯示影像在倉庫中的名稱：以實際繪製的裝置像素大小區分，換到不同縮放比例的螢幕時不會拿到舊解析度
+QString displayKey(const QString &key, const QSize &displaySize)
+{
+    return key + QString(":display:%1x%2").arg(displaySize.width()).arg(displaySize.height());
+}
+
+// 代理影像大小：保持比例並剛好放進 inWin，來源較小時不放大
+QSize proxySizeFor(const QSize &imageSize, const QSize &displaySize)
+{
+    if (displaySize.isEmpty() ||
+        (imageSize.width() <= displaySize.width() && imageSize.height() <= displaySize.height()))
+        return imageSize;
+    return imageSize.scaled(displaySize, Qt::KeepAspectRatio);
+}
+
+// 在工作執行緒中旋轉影像；世代編號已過期時提早放棄，避免浪費運算
+RotateResult rotateInBackground(const RotateRequest &request,
+                                const QAtomicInt *generation, int myGeneration)
+{
+    TRACE_SCOPE("rotateInBackground");
+    RotateResult result;
+    result.angle = request.angle;
+    result.displaySize = request.displaySize;
+    result.generation = myGeneration;
+    result.preview = request.preview;
+    if (generation->loadRelaxed() != myGeneration)
+        return result;
+
+    auto isCancelled = [generation, myGeneration]() {
+        return generation->loadRelaxed() != myGeneration;
+    };
+
+    if (request.preview)
+    {
+        // 拖曳中只旋轉代理影像；代理影像只建一次，之後的預覽重複使用
+        QImage proxy = request.proxy;
+        if (proxy.isNull())
+        {
+            const QSize proxySize = proxySizeFor(request.source.size(), request.displaySize);
+            proxy = proxySize == request.source.size()
+                        ? request.source
+                        : ImageGraph(request.source).scaled(proxySize).render(QRect(), isCancelled);
+            result.proxy = proxy;
+            result.sourceKey = request.source.cacheKey();
+        }
+        result.image = ImageTransform::transformGraph(proxy, request.mirrorH, request.mirrorV, request.angle)
+                           .withFilter(Resampler::Bilinear)
+                           .render(QRect(), isCancelled);
+        result.display = result.image;
+        return result;
+    }
+
+    // 引擎在每個區塊之間檢查世代編號，過期時中途放棄
+    const ImageGraph graph = ImageTransform::transformGraph(request.source, request.mirrorH, request.mirrorV,
+                                                            request.angle);
+    result.image = graph.withFilter(Resampler::Nearest).render(QRect(), isCancelled);
+    if (isCancelled() || result.image.isNull())
+        return result;
+
+    // 顯示用影像直接由來源經同一條運算鏈縮到 inWin 大小，不必再縮放旋轉後的結果
+    if (request.displaySize.isEmpty() ||
+        (result.image.width() <= request.displaySize.width() && result.image.height() <= request.displaySize.height()))
+        result.display = result.image;
+    else
+        result.display = graph.scaled(result.image.size().scaled(request.displaySize, Qt::KeepAspectRatio))
+                             .render(QRect(), isCancelled);
+    return result;
+}
+
+}
 
 ImageTransform::ImageTransform(QWidget *parent)
-    : QWidget(parent)
+    : QWidget(parent), pendingAngle(0), pendingPreview(false), hasPendingAngle(false),
+      runningAngle(0), runningPreview(false), rotationStale(false), mirrorH(false), mirrorV(false)
 {
-    mainLayout = new QHBoxLayout(this);
+    QVBoxLayout *windowLayout = new QVBoxLayout(this);
+    mainLayout = new QHBoxLayout;
+    windowLayout -> addLayout(mainLayout);
     leftLayout = new QVBoxLayout(this);
     mirrorGroup = new QGroupBox(tr("鏡射"), this);
     groupLayout = new QVBoxLayout(mirrorGroup);
@@ -30,17 +130,21 @@ ImageTransform::ImageTransform(QWidget *parent)
 
     leftLayout -> addWidget(rotateDial);
     leftLayout -> addWidget(saveButton);
+    presetBox = new QComboBox(this);
+    for (PngEncoder::Preset preset : { PngEncoder::Fast, PngEncoder::Balanced, PngEncoder::Smallest })
+        presetBox -> addItem(PngEncoder::presetName(preset), int(preset));
+    presetBox -> setCurrentIndex(presetBox -> findData(int(PngEncoder::Balanced)));
+    presetBox -> setToolTip(tr("PNG 存檔的速度與檔案大小"));
+    leftLayout -> addWidget(presetBox);
     leftLayout -> addItem(vSpacer);
     mainLayout -> addLayout(leftLayout);
 
-    inWin = new QLabel(this);
-    inWin -> setScaledContents(true);
+    inWin = new ImageViewport(this);
     QPixmap *initPixmap = new QPixmap(300, 200);
     initPixmap -> fill(QColor(255, 255, 255));
 
 
-    inWin -> setPixmap(*initPixmap);
-    inWin -> setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+    inWin -> setImage(*initPixmap);
 
     // for test
     /*--------------------------------------------------*/
@@ -56,36 +160,204 @@ ImageTransform::ImageTransform(QWidget *parent)
         srcImg = initPixmap -> toImage();
     }
 
-    inWin -> setPixmap(*initPixmap);
+    inWin -> setImage(*initPixmap);
     mainLayout -> addWidget(inWin);
+    statusBar = new QStatusBar(this);
+    statusBar -> setSizeGripEnabled(false);
+    windowLayout -> addWidget(statusBar);
+    saver = new ImageSaver(statusBar, this);
     connect(mirrorButton, SIGNAL(clicked(bool)), this, SLOT(mirroredImage()));
     connect(rotateDial, SIGNAL(valueChanged(int)), this, SLOT(rotatedImage()));
     connect(saveButton, SIGNAL(clicked(bool)), this, SLOT(saveDstImage()));
+
+    rotateWatcher = new QFutureWatcher<RotateResult>(this);
+    connect(rotateWatcher, &QFutureWatcher<RotateResult>::finished, this, &ImageTransform::rotationFinished);
+
+    // 拖曳旋鈕時先顯示代理影像的預覽，放開或停頓後才算完整解析度
+    idleTimer = new QTimer(this);
+    idleTimer -> setSingleShot(true);
+    idleTimer -> setInterval(IdleFullResolutionDelay);
+    connect(idleTimer, &QTimer::timeout, this, &ImageTransform::finalizeRotation);
+    connect(rotateDial, &QDial::sliderReleased, this, &ImageTransform::finalizeRotation);
 }
 
 ImageTransform::~ImageTransform()
 {
+    // 讓進行中的工作失效並等待結束，工作執行緒仍持有 rotateGeneration 的指標
+    rotateGeneration.fetchAndAddOrdered(1);
+    rotateWatcher->waitForFinished();
+}
+
+void ImageTransform::setSourceImage(const QImage &image)
+{
+    cancelRotation();
+    srcImg = image;
+    proxyImg = QImage();
+    dstImg = QImage();
+    mirrorH = mirrorV = false;
+    TRACE_SCOPE("QPixmap::fromImage");
+    inWin -> setImage(QPixmap::fromImage(srcImg));
+    inWin -> resetView();
+}
+
+QImage ImageTransform::mirrorImage(const QImage &image, bool horizontal, bool vertical)
+{
+    return MirrorEngine::mirrored(image, horizontal, vertical);
+}
+
+QImage ImageTransform::rotateImage(const QImage &image, int angle, const WarpEngine::CancelCheck &isCancelled)
+{
+    return WarpEngine::rotated(image, angle, WarpEngine::Nearest, isCancelled);
+}
 
+ImageGraph ImageTransform::transformGraph(const QImage &image, bool horizontal, bool vertical, int angle)
+{
+    return ImageGraph(image).mirrored(horizontal, vertical).rotated(angle);
 }
 
 void ImageTransform::mirroredImage()
 {
+    TRACE_OPERATION("mirroredImage");
     bool H, V;
     //if (srcImg.isNull()) return;
     H = hCheckBox -> isChecked();
     V = vCheckBox -> isChecked();
-    dstImg = srcImg.mirrored(H, V);
-    inWin -> setPixmap(QPixmap::fromImage(dstImg));
+    mirrorH = H;
+    mirrorV = V;
+    // 鏡射會覆蓋 dstImg，之前送出的旋轉結果不再需要
+    cancelRotation();
+    if (rotateDial -> value() == 0)
+    {
+        // 沒有旋轉時大小與格式相同，直接覆寫 dstImg 的緩衝，連續按鏡射不會重新配置
+        MirrorEngine::mirror(srcImg, dstImg, H, V);
+        TRACE_SCOPE("QPixmap::fromImage");
+        inWin -> setImage(QPixmap::fromImage(dstImg));
+        return;
+    }
+    // 鏡射與目前的旋轉角度合成一次取樣，交給背景執行緒
+    rotationStale = true;
+    requestRotation(rotateDial -> value(), false);
 }
 
+// 旋鈕每次變動只記錄角度，實際旋轉交給背景執行緒；
+// 同一時間只有一個工作在跑，其間的刻度只保留最後一個。
+// 拖曳中旋轉代理影像，放開旋鈕或停頓後才算完整解析度的 dstImg
 void ImageTransform::rotatedImage()
 {
-    QTransform tran;
+    TRACE_OPERATION("rotatedImage");
     //if (srcImg.isNull()) return;
     int angle = rotateDial -> value();
-    tran.rotate(angle);
-    dstImg = srcImg.transformed(tran);
-    inWin -> setPixmap(QPixmap::fromImage(dstImg));
+    rotateGeneration.fetchAndAddOrdered(1);  // 進行中的工作已過期
+    rotationStale = true;
+    const bool preview = rotateDial -> isSliderDown();
+    if (preview)
+        idleTimer -> start();
+    else
+        idleTimer -> stop();
+    requestRotation(angle, preview);
+}
+
+void ImageTransform::finalizeRotation()
+{
+    idleTimer -> stop();
+    if (!rotationStale)
+        return;
+    const int angle = rotateDial -> value();
+    // 進行中的正好是這個角度的完整解析度工作，等它完成即可
+    if (rotateWatcher -> isRunning() && !hasPendingAngle && !runningPreview && runningAngle == angle)
+        return;
+    rotateGeneration.fetchAndAddOrdered(1);
+    requestRotation(angle, false);
+}
+
+void ImageTransform::requestRotation(int angle, bool preview)
+{
+    if (rotateWatcher -> isRunning())
+    {
+        pendingAngle = angle;
+        pendingPreview = preview;
+        hasPendingAngle = true;
+        return;
+    }
+    startRotation(angle, preview);
+}
+
+void ImageTransform::startRotation(int angle, bool preview)
+{
+    hasPendingAngle = false;
+    const QSize displaySize = inWin -> size() * inWin -> devicePixelRatioF();
+
+    // 這個角度的完整解析度結果還在倉庫中時不必重算
+    if (!preview)
+    {
+        const QString key = ImageStore::derivedKey(srcImg, transformOp(mirrorH, mirrorV, angle));
+        const QImage cached = ImageStore::instance().derived(key);
+        const QImage display = ImageStore::instance().derived(displayKey(key, displaySize));
+        if (!cached.isNull() && !display.isNull())
+        {
+            dstImg = cached;
+            rotationStale = false;
+            TRACE_SCOPE("QPixmap::fromImage");
+            inWin -> setImage(QPixmap::fromImage(display), cached.size());
+            return;
+        }
+    }
+
+    runningAngle = angle;
+    runningPreview = preview;
+
+    RotateRequest request;
+    request.source = srcImg;
+    request.displaySize = displaySize;
+    request.angle = angle;
+    request.mirrorH = mirrorH;
+    request.mirrorV = mirrorV;
+    request.preview = preview;
+    // inWin 大小改變後代理影像不再合適，交給工作執行緒重建
+    if (preview && !proxyImg.isNull() &&
+        proxyImg.size() == proxySizeFor(srcImg.size(), request.displaySize))
+        request.proxy = proxyImg;
+
+    const int generation = rotateGeneration.loadRelaxed();
+    rotateWatcher -> setFuture(QtConcurrent::run(rotateInBackground, request,
+                                                 static_cast<const QAtomicInt *>(&rotateGeneration),
+                                                 generation));
+}
+
+void ImageTransform::cancelRotation()
+{
+    rotateGeneration.fetchAndAddOrdered(1);
+    hasPendingAngle = false;
+    rotationStale = false;
+    idleTimer -> stop();
+}
+
+void ImageTransform::rotationFinished()
+{
+    TRACE_SCOPE("rotationFinished");
+    const RotateResult result = rotateWatcher -> result();
+    // 代理影像只要來源沒換就能沿用，即使這次的旋轉結果已過期
+    if (!result.proxy.isNull() && result.sourceKey == srcImg.cacheKey())
+        proxyImg = result.proxy;
+    if (hasPendingAngle)
+    {
+        startRotation(pendingAngle, pendingPreview);
+        return;
+    }
+    // 世代編號不符代表期間有新的要求，直接丟棄
+    if (result.generation != rotateGeneration.loadRelaxed() || result.image.isNull())
+        return;
+    if (!result.preview)
+    {
+        // 完整解析度結果可重算，交給倉庫快取，超過預算時最先被淘汰
+        const QString key = ImageStore::derivedKey(srcImg, transformOp(mirrorH, mirrorV, result.angle));
+        dstImg = ImageStore::instance().addDerived(key, result.image);
+        ImageStore::instance().addDerived(displayKey(key, result.displaySize), result.display);
+        rotationStale = false;
+    }
+    TRACE_SCOPE("QPixmap::fromImage");
+    // 完整解析度的顯示影像代表整張旋轉結果，座標範圍以結果大小為準
+    inWin -> setImage(QPixmap::fromImage(result.display), result.preview ? QSize() : result.image.size());
 }
 
 void ImageTransform::saveDstImage()
@@ -94,10 +366,17 @@ void ImageTransform::saveDstImage()
     filename = QFileDialog::getSaveFileName(this, "保存影像", "..\\..\\");
     if (filename.isEmpty())
         return;
-    bool ok;
-    if(dstImg.isNull())
-        ok = srcImg.save(filename, "PNG", 100);
-    else
-        ok = dstImg.save(filename, "PNG", 100);
-    qDebug() << filename << " " << ok;
+    TRACE_OPERATION("saveDstImage");   // 不含對話框的時間
+
+    // 編碼與寫檔都在背景進行；畫面上只有預覽或旋轉尚未完成時，
+    // 目前角度的完整解析度結果也在存檔的工作執行緒中算出，不必等背景旋轉
+    const PngEncoder::Preset preset = PngEncoder::Preset(presetBox -> currentData().toInt());
+    if (rotationStale)
+    {
+        const ImageGraph graph = transformGraph(srcImg, mirrorH, mirrorV, rotateDial -> value())
+                                     .withFilter(Resampler::Nearest);
+        saver -> save([graph]() { return graph.render(); }, filename, "PNG", preset);
+        return;
+    }
+    saver -> save(dstImg.isNull() ? srcImg : dstImg, filename, "PNG", preset);
 }
@@ -9,10 +9,33 @@
 #include <QCheckBox>
 #include <QPushButton>
 #include <QDial>
+#include <QComboBox>
+#include <QStatusBar>
 #include <QSpacerItem>
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 #include <QImage>
+#include <QFutureWatcher>
+#include <QAtomicInt>
+#include <QTimer>
+#include "warpengine.h"
+#include "mirrorengine.h"
+#include "imagegraph.h"
+#include "imagesaver.h"
+#include "imageviewport.h"
+
+// 背景旋轉的結果：旋轉後的影像與縮到 inWin 大小的顯示影像
+struct RotateResult
+{
+    QImage image;       // 旋轉後的影像（預覽時為代理影像的旋轉結果）
+    QImage display;     // 供 inWin 顯示的縮小影像，保持 image 的比例
+    QImage proxy;       // 工作中新建的代理影像，供之後的預覽重複使用
+    qint64 sourceKey = 0;   // 代理影像所屬來源的 cacheKey
+    QSize  displaySize; // display 依據的 inWin 裝置像素大小
+    int    angle = 0;   // 此結果對應的角度
+    int    generation = 0;  // 送出工作時的世代編號，用來丟棄過期結果
+    bool   preview = false; // 是否為拖曳中的低解析度預覽
+};
 
 class ImageTransform : public QWidget
 {
@@ -21,12 +44,21 @@ class ImageTransform : public QWidget
 public:
     ImageTransform(QWidget *parent = nullptr);
     ~ImageTransform();
-    QLabel        *inWin;
+    void setSourceImage(const QImage &image);  // 設定來源影像並丟棄進行中的旋轉
+
+    // 與鏡射按鈕、旋轉旋鈕相同的運算，也供不開視窗的批次模式使用
+    static QImage mirrorImage(const QImage &image, bool horizontal, bool vertical);
+    static QImage rotateImage(const QImage &image, int angle,
+                              const WarpEngine::CancelCheck &isCancelled = WarpEngine::CancelCheck());
+    // 先鏡射再旋轉的運算鏈；只記錄成一個矩陣，render 時整條只取樣一次
+    static ImageGraph transformGraph(const QImage &image, bool horizontal, bool vertical, int angle);
+    ImageViewport *inWin;           // 可縮放、平移的結果顯示
     QGroupBox     *mirrorGroup;
     QCheckBox     *hCheckBox;
     QCheckBox     *vCheckBox;
     QPushButton   *mirrorButton;
     QPushButton   *saveButton;
+    QComboBox     *presetBox;       // PNG 存檔的速度／大小取捨
     QDial         *rotateDial;
     QSpacerItem   *vSpacer;
     QHBoxLayout   *mainLayout;
@@ -39,6 +71,28 @@ private slots:
     void mirroredImage();
     void rotatedImage();
     void saveDstImage();
+    void rotationFinished();    // 背景旋轉完成
+    void finalizeRotation();    // 放開旋鈕或停頓時改算完整解析度
+
+private:
+    void requestRotation(int angle, bool preview);  // 送出或排隊一個旋轉要求
+    void startRotation(int angle, bool preview);    // 送出一個背景旋轉工作
+    void cancelRotation();                          // 丟棄進行中與等待中的旋轉
+
+    QFutureWatcher<RotateResult> *rotateWatcher;  // 監看背景旋轉工作
+    QAtomicInt    rotateGeneration; // 每次要求遞增，工作執行緒據此判斷是否已過期
+    int           pendingAngle;     // 工作進行中時最新要求的角度
+    bool          pendingPreview;   // 等待中的要求是否為預覽
+    bool          hasPendingAngle;  // 是否有等待中的角度
+    int           runningAngle;     // 進行中工作的角度
+    bool          runningPreview;   // 進行中工作是否為預覽
+    bool          rotationStale;    // dstImg 尚未跟上旋鈕角度（只顯示了預覽或仍在計算）
+    bool          mirrorH;          // 最近一次按「執行」時套用的鏡射，與旋鈕角度合成
+    bool          mirrorV;
+    QImage        proxyImg;         // 縮到 inWin 大小的代理影像，拖曳時以它旋轉
+    QTimer        *idleTimer;       // 拖曳中停頓一段時間即算完整解析度
+    QStatusBar    *statusBar;       // 顯示背景存檔的進度與結果
+    ImageSaver    *saver;           // 背景存檔，存檔時視窗不會停住
 };
 
 #endif // IMAGETRANSFORM_H
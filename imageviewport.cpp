@@ -0,0 +1,456 @@
+#include "imageviewport.h"
+#include <QPainter>
+#include <QtMath>
+#include "tracer.h"
+
+namespace {
+
+const double MaxPixelScale = 32;    // 最大放大到一個影像像素佔 32 個邏輯像素
+const double WheelStep = 1.25;      // 滾輪每一格的縮放倍率
+const int OverlayMargin = 2;        // 疊加層線條的半寬加上座標取整的餘裕
+const int DetailCacheKB = 96 * 1024;    // 放大區塊快取上限（KB），約 384 個 256x256 的 32 位元區塊
+
+// 矩形外框四條邊的範圍，內部不包含在內
+QRegion outline(const QRect &rect, int margin)
+{
+    if (rect.isEmpty())
+        return QRegion();
+    const QRect outer = rect.adjusted(-margin, -margin, margin, margin);
+    const QRect inner = rect.adjusted(margin, margin, -margin, -margin);
+    if (inner.isEmpty())
+        return QRegion(outer);
+    return QRegion(outer).subtracted(QRegion(inner));
+}
+
+}
+
+ImageViewport::ImageViewport(QWidget *parent)
+    : QWidget(parent), zoomFactor(1), crosshairEnabled(false), crosshairPixel(-1, -1), panning(false),
+      baseLayerValid(false), detailTiles(DetailCacheKB)
+{
+    // paintEvent 會填滿整個重繪範圍，不需要 Qt 先清除背景
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+    setMinimumSize(1, 1);
+    setMouseTracking(true);
+}
+
+void ImageViewport::setImage(const QPixmap &image, const QSize &imageSize)
+{
+    const QSize size = imageSize.isEmpty() ? (QSizeF(image.size()) / image.devicePixelRatio()).toSize() : imageSize;
+    const bool resized = size != logicalSize;
+    // 影像大小改變時（例如旋轉預覽換成完整結果）中心依比例換算，畫面停在同一個相對位置
+    if (resized && !logicalSize.isEmpty())
+        center = QPointF(center.x() * size.width() / logicalSize.width(),
+                         center.y() * size.height() / logicalSize.height());
+    else if (logicalSize.isEmpty())
+        center = QPointF(size.width() / 2.0, size.height() / 2.0);
+    const QSize oldHint = sizeHint();
+    pixmap = image;
+    logicalSize = size;
+    if (resized)
+        detailTiles.clear();
+    clampCenter();
+    if (sizeHint() != oldHint)
+        updateGeometry();
+    invalidateBaseLayer();
+    if (resized)
+        emit viewChanged();
+}
+
+void ImageViewport::setDetailSource(const DetailSource &source)
+{
+    detailSource = source;
+    detailTiles.clear();
+    invalidateBaseLayer();
+}
+
+QSize ImageViewport::imageSize() const
+{
+    return logicalSize;
+}
+
+void ImageViewport::resetView()
+{
+    zoomFactor = 1;
+    center = QPointF(logicalSize.width() / 2.0, logicalSize.height() / 2.0);
+    selection = QRect();
+    crosshairPixel = QPoint(-1, -1);
+    invalidateBaseLayer();
+    emit viewChanged();
+}
+
+double ImageViewport::fitScale() const
+{
+    if (logicalSize.isEmpty())
+        return 1;
+    return qMin(double(width()) / logicalSize.width(), double(height()) / logicalSize.height());
+}
+
+double ImageViewport::scale() const
+{
+    return fitScale() * zoomFactor;
+}
+
+double ImageViewport::maxZoom() const
+{
+    return qMax(1.0, MaxPixelScale / fitScale());
+}
+
+QTransform ImageViewport::imageToView() const
+{
+    // 位移取整數，縮放比例相同時影像像素的邊界每次都落在同樣的螢幕位置
+    const double s = scale();
+    return QTransform(s, 0, 0, s, qRound(width() / 2.0 - center.x() * s), qRound(height() / 2.0 - center.y() * s));
+}
+
+QPointF ImageViewport::mapToImage(const QPointF &viewPos) const
+{
+    const QTransform transform = imageToView();
+    return QPointF((viewPos.x() - transform.dx()) / transform.m11(), (viewPos.y() - transform.dy()) / transform.m22());
+}
+
+QPointF ImageViewport::mapFromImage(const QPointF &imagePos) const
+{
+    return imageToView().map(imagePos);
+}
+
+bool ImageViewport::isOverImage(const QPointF &viewPos) const
+{
+    const QPointF pos = mapToImage(viewPos);
+    return pos.x() >= 0 && pos.y() >= 0 && pos.x() < logicalSize.width() && pos.y() < logicalSize.height();
+}
+
+QPoint ImageViewport::imagePixelAt(const QPointF &viewPos) const
+{
+    if (logicalSize.isEmpty())
+        return QPoint();
+    const QPointF pos = mapToImage(viewPos);
+    return QPoint(qBound(0, qFloor(pos.x()), logicalSize.width() - 1),
+                  qBound(0, qFloor(pos.y()), logicalSize.height() - 1));
+}
+
+QSize ImageViewport::displayResolution() const
+{
+    const double s = scale() * devicePixelRatioF();
+    return QSize(qCeil(logicalSize.width() * s), qCeil(logicalSize.height() * s));
+}
+
+QSize ImageViewport::fitResolution() const
+{
+    const double s = fitScale() * devicePixelRatioF();
+    return QSize(qCeil(logicalSize.width() * s), qCeil(logicalSize.height() * s));
+}
+
+double ImageViewport::zoom() const
+{
+    return zoomFactor;
+}
+
+void ImageViewport::setZoom(double zoom, const QPointF &anchor)
+{
+    zoom = qBound(1.0, zoom, maxZoom());
+    if (qFuzzyCompare(zoom, zoomFactor) || logicalSize.isEmpty())
+        return;
+    const QPointF fixed = mapToImage(anchor);
+    zoomFactor = zoom;
+    // 讓 anchor 下仍是同一個影像位置
+    const double s = scale();
+    center = fixed - (anchor - QPointF(width() / 2.0, height() / 2.0)) / s;
+    clampCenter();
+    invalidateBaseLayer();
+    emit viewChanged();
+}
+
+void ImageViewport::panBy(const QPointF &delta)
+{
+    const QPointF before = center;
+    center -= delta / scale();
+    clampCenter();
+    if (center == before)
+        return;
+    invalidateBaseLayer();
+    emit viewChanged();
+}
+
+void ImageViewport::clampCenter()
+{
+    // 影像比元件小的方向置中；比元件大時不讓影像邊緣離開元件邊緣
+    const double s = scale();
+    const double halfWidth = width() / (2 * s);
+    const double halfHeight = height() / (2 * s);
+    if (logicalSize.width() <= 2 * halfWidth)
+        center.setX(logicalSize.width() / 2.0);
+    else
+        center.setX(qBound(halfWidth, center.x(), logicalSize.width() - halfWidth));
+    if (logicalSize.height() <= 2 * halfHeight)
+        center.setY(logicalSize.height() / 2.0);
+    else
+        center.setY(qBound(halfHeight, center.y(), logicalSize.height() - halfHeight));
+}
+
+void ImageViewport::setSelection(const QRect &imageRect)
+{
+    if (imageRect == selection)
+        return;
+    // 只重繪新舊兩個框的邊線，框內的影像不必重畫
+    const QRegion before = selectionRegion();
+    selection = imageRect;
+    update(before + selectionRegion());
+}
+
+void ImageViewport::setCrosshairEnabled(bool enabled)
+{
+    if (enabled == crosshairEnabled)
+        return;
+    update(crosshairRegion());
+    crosshairEnabled = enabled;
+    if (!enabled)
+        crosshairPixel = QPoint(-1, -1);
+}
+
+QRect ImageViewport::imageViewRect() const
+{
+    return imageToView().mapRect(QRectF(QPointF(0, 0), QSizeF(logicalSize))).toAlignedRect();
+}
+
+QRegion ImageViewport::selectionRegion() const
+{
+    if (selection.isEmpty())
+        return QRegion();
+    const QRectF rect(selection.topLeft(), QSizeF(selection.size()));
+    return outline(imageToView().mapRect(rect).toAlignedRect(), OverlayMargin);
+}
+
+QRegion ImageViewport::crosshairRegion() const
+{
+    if (!crosshairEnabled || crosshairPixel.x() < 0)
+        return QRegion();
+    const QPoint at = mapFromImage(QPointF(crosshairPixel) + QPointF(0.5, 0.5)).toPoint();
+    const QRect bounds = imageViewRect().intersected(rect());
+    QRegion region(QRect(bounds.left(), at.y() - OverlayMargin, bounds.width(), 2 * OverlayMargin + 1));
+    region += QRect(at.x() - OverlayMargin, bounds.top(), 2 * OverlayMargin + 1, bounds.height());
+    return region.intersected(bounds);
+}
+
+void ImageViewport::moveCrosshair(const QPointF &viewPos)
+{
+    if (!crosshairEnabled)
+        return;
+    const QPoint pixel = isOverImage(viewPos) ? imagePixelAt(viewPos) : QPoint(-1, -1);
+    // 同一個像素內移動不必重繪
+    if (pixel == crosshairPixel)
+        return;
+    const QRegion before = crosshairRegion();
+    crosshairPixel = pixel;
+    update(before + crosshairRegion());
+}
+
+QSize ImageViewport::sizeHint() const
+{
+    if (pixmap.isNull())
+        return QSize(300, 200);
+    return (QSizeF(pixmap.size()) / pixmap.devicePixelRatio()).toSize();
+}
+
+void ImageViewport::renderBaseLayer()
+{
+    TRACE_SCOPE("ImageViewport::renderBaseLayer");
+    const qreal ratio = devicePixelRatioF();
+    baseLayer = QPixmap(size() * ratio);
+    baseLayer.setDevicePixelRatio(ratio);
+    baseLayerValid = true;
+
+    QPainter painter(&baseLayer);
+    const QTransform view = imageToView();
+    const QRectF target = view.mapRect(QRectF(QPointF(0, 0), QSizeF(logicalSize)));
+
+    // 影像完全覆蓋的像素以外才填背景，邊緣被影像部分覆蓋的像素兩者都畫
+    const QRect covered(QPoint(qCeil(target.left()), qCeil(target.top())),
+                        QPoint(qFloor(target.right()) - 1, qFloor(target.bottom()) - 1));
+    const QRegion background = pixmap.isNull() ? QRegion(rect()) : QRegion(rect()).subtracted(QRegion(covered));
+    for (const QRect &area : background)
+        painter.fillRect(area, palette().window());
+    if (pixmap.isNull())
+        return;
+
+    // pixmap 可能是較小的金字塔層級，以個別的 x / y 比例精確對應到影像座標範圍
+    const QSizeF source = QSizeF(pixmap.size()) / pixmap.devicePixelRatio();
+    const double sx = view.m11() * logicalSize.width() / source.width();
+    const double sy = view.m22() * logicalSize.height() / source.height();
+    // 縮小時平滑取樣；放大到超過 pixmap 的解析度時維持方塊像素，方便逐點檢視
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, sx * ratio < 1);
+    painter.setTransform(QTransform(sx, 0, 0, sy, view.dx(), view.dy()));
+    painter.drawPixmap(QPointF(0, 0), pixmap);
+
+    // 需要的解析度超過 pixmap 時，只把看得到的區塊以足夠的解析度疊上去
+    const double deviceScale = view.m11() * ratio;  // 每個影像像素佔幾個裝置像素
+    if (detailSource && deviceScale > double(pixmap.width()) / logicalSize.width())
+        drawDetail(painter, view, deviceScale);
+}
+
+void ImageViewport::drawDetail(QPainter &painter, const QTransform &view, double deviceScale)
+{
+    // 取不低於螢幕解析度的最粗取樣：每個區塊像素代表 factor x factor 個影像像素
+    int level = 0;
+    while (level < 22 && deviceScale * (2 << level) <= 1)
+        ++level;
+    const int factor = 1 << level;
+    const qint64 span = qint64(DetailTileSize) * factor;   // 每個區塊涵蓋的影像像素
+
+    const QRectF imageRect(QPointF(0, 0), QSizeF(logicalSize));
+    const QRectF visible = QRectF(rect()).intersected(view.mapRect(imageRect));
+    if (visible.isEmpty())
+        return;
+    const QRectF area = view.inverted().mapRect(visible).intersected(imageRect);
+    const int firstColumn = int(qMax(0, qFloor(area.left())) / span);
+    const int lastColumn = int(qMin(logicalSize.width() - 1, qCeil(area.right()) - 1) / span);
+    const int firstRow = int(qMax(0, qFloor(area.top())) / span);
+    const int lastRow = int(qMin(logicalSize.height() - 1, qCeil(area.bottom()) - 1) / span);
+
+    // 區塊各自以同一個比例放到影像座標的位置，相鄰區塊的像素邊界與整張繪製時相同
+    const double tileScale = view.m11() * factor;
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, deviceScale * factor < 1);
+    for (int row = firstRow; row <= lastRow; ++row)
+    {
+        for (int column = firstColumn; column <= lastColumn; ++column)
+        {
+            const QPixmap tile = detailTile(level, column, row);
+            if (tile.isNull())
+                continue;
+            const QPointF origin = view.map(QPointF(column * span, row * span));
+            painter.setTransform(QTransform(tileScale, 0, 0, tileScale, origin.x(), origin.y()));
+            painter.drawPixmap(QPointF(0, 0), tile);
+        }
+    }
+}
+
+QPixmap ImageViewport::detailTile(int level, int column, int row)
+{
+    const quint64 key = (quint64(level) << 56) | (quint64(quint32(row)) << 28) | quint32(column);
+    if (QPixmap *cached = detailTiles.object(key))
+        return *cached;
+
+    const qint64 span = qint64(DetailTileSize) << level;
+    const QRect rect(QPoint(int(column * span), int(row * span)),
+                     QPoint(int(qMin<qint64>((column + 1) * span, logicalSize.width()) - 1),
+                            int(qMin<qint64>((row + 1) * span, logicalSize.height()) - 1)));
+    TRACE_SCOPE("ImageViewport::detailTile");
+    const QImage image = detailSource(rect, 1 << level);
+    // 來源還沒準備好時不放進快取，之後重繪再取
+    if (image.isNull())
+        return QPixmap();
+    QPixmap *pixmap = new QPixmap(QPixmap::fromImage(image));
+    const QPixmap result = *pixmap;
+    detailTiles.insert(key, pixmap, qMax(1, int(image.sizeInBytes() / 1024)));
+    return result;
+}
+
+void ImageViewport::invalidateBaseLayer()
+{
+    baseLayerValid = false;
+    update();
+}
+
+void ImageViewport::paintEvent(QPaintEvent *event)
+{
+    // 縮放後的影像在畫面快取中只算一次；疊加層移動時只把重繪範圍由快取原樣複製回來，
+    // 不再重新縮放取樣（裁切後重新縮放，像素邊界可能與整張繪製時差一格）
+    if (!baseLayerValid || baseLayer.devicePixelRatio() != devicePixelRatioF())
+        renderBaseLayer();
+
+    QPainter painter(this);
+    const QRegion damaged = event->region();
+    painter.setClipRegion(damaged);
+    painter.drawPixmap(0, 0, baseLayer);
+    if (pixmap.isNull())
+        return;
+
+    const QTransform view = imageToView();
+    if (!selection.isEmpty() && damaged.intersects(selectionRegion()))
+    {
+        painter.setPen(QPen(Qt::blue, 2, Qt::DashLine));
+        painter.drawRect(view.mapRect(QRectF(selection.topLeft(), QSizeF(selection.size()))));
+    }
+
+    if (crosshairEnabled && crosshairPixel.x() >= 0)
+    {
+        // 以差異混合畫白線，在亮暗背景上都看得到
+        const QPointF at = view.map(QPointF(crosshairPixel) + QPointF(0.5, 0.5));
+        const QRect bounds = imageViewRect().intersected(rect());
+        painter.setCompositionMode(QPainter::CompositionMode_Difference);
+        painter.setPen(QPen(Qt::white, 1));
+        painter.drawLine(QPointF(bounds.left(), at.y()), QPointF(bounds.right(), at.y()));
+        painter.drawLine(QPointF(at.x(), bounds.top()), QPointF(at.x(), bounds.bottom()));
+    }
+}
+
+void ImageViewport::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    clampCenter();
+    baseLayerValid = false;
+    emit viewChanged();
+}
+
+void ImageViewport::wheelEvent(QWheelEvent *event)
+{
+    if (logicalSize.isEmpty())
+    {
+        QWidget::wheelEvent(event);
+        return;
+    }
+    const double steps = event->angleDelta().y() / 120.0;
+    setZoom(zoomFactor * qPow(WheelStep, steps), event->position());
+    moveCrosshair(event->position());
+    event->accept();
+}
+
+void ImageViewport::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::MiddleButton || logicalSize.isEmpty())
+    {
+        QWidget::mousePressEvent(event);
+        return;
+    }
+    panning = true;
+    panOrigin = event->position();
+    setCursor(Qt::ClosedHandCursor);
+    event->accept();
+}
+
+void ImageViewport::mouseMoveEvent(QMouseEvent *event)
+{
+    if (panning)
+    {
+        panBy(event->position() - panOrigin);
+        panOrigin = event->position();
+        event->accept();
+        return;
+    }
+    moveCrosshair(event->position());
+    // 交給父視窗處理讀值與選取
+    QWidget::mouseMoveEvent(event);
+}
+
+void ImageViewport::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (!panning || event->button() != Qt::MiddleButton)
+    {
+        QWidget::mouseReleaseEvent(event);
+        return;
+    }
+    panning = false;
+    unsetCursor();
+    event->accept();
+}
+
+void ImageViewport::leaveEvent(QEvent *event)
+{
+    QWidget::leaveEvent(event);
+    if (crosshairPixel.x() >= 0)
+    {
+        update(crosshairRegion());
+        crosshairPixel = QPoint(-1, -1);
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef IMAGEVIEWPORT_H
+#define IMAGEVIEWPORT_H
+
+#include <QWidget>
+#include <QPixmap>
+#include <QTransform>
+#include <QRegion>
+#include <QPaintEvent>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QCache>
+#include <functional>
+
+class QPainter;
+
+// 影像檢視元件：取代 QLabel + setScaledContents。影像保持比例置中顯示，可用滾輪縮放、中鍵拖曳平移，
+// 影像與畫面之間只有一個精確的轉換（等比縮放加上整數位移），座標換算與繪製共用同一個轉換。
+//
+// 縮放後的影像只在轉換或影像改變時算一次並保留成畫面快取；選取框與十字線是疊在上面的圖層，
+// 不修改影像像素，移動時只重繪新舊位置的邊框與線條，由快取複製回底圖後再畫上圖層。
+// 放大到超過 pixmap 的解析度時，看得到的部分改由逐塊來源取樣，只有這些區塊會轉成 pixmap
+class ImageViewport : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit ImageViewport(QWidget *parent = nullptr);
+
+    // 顯示 pixmap；imageSize 是它代表的影像座標範圍（例如金字塔層級代表原始解析度），
+    // 空的時候等於 pixmap 大小。縮放倍率與畫面中心的相對位置保持不變，換成另一張影像時先呼叫 resetView
+    void setImage(const QPixmap &pixmap, const QSize &imageSize = QSize());
+    QSize imageSize() const;
+    void resetView();                           // 回到剛好放進元件的大小並置中
+
+    // 放大後的區塊來源：回傳影像座標 rect 中每 factor x factor 個像素取一個像素的內容
+    // （factor 為 2 的次方），左上角對齊 rect，右下邊緣可以比 rect 少；拿不到時回傳空影像，該處繼續顯示 pixmap。
+    // 換來源時清除已取樣的區塊
+    typedef std::function<QImage(const QRect &rect, int factor)> DetailSource;
+    void setDetailSource(const DetailSource &source);
+
+    // 影像座標與元件座標（邏輯像素）的換算
+    QTransform imageToView() const;
+    QPointF mapToImage(const QPointF &viewPos) const;
+    QPointF mapFromImage(const QPointF &imagePos) const;
+    bool isOverImage(const QPointF &viewPos) const;
+    QPoint imagePixelAt(const QPointF &viewPos) const;  // 所在的影像像素，影像外時取最近的邊緣像素
+
+    // 以目前縮放顯示整張影像需要的裝置像素大小，用來挑選金字塔層級
+    QSize displayResolution() const;
+    QSize fitResolution() const;                // 剛好放進元件時需要的裝置像素大小
+
+    double zoom() const;                        // 相對於剛好放進元件的倍率，1 為最小
+    void setZoom(double zoom, const QPointF &anchor);   // anchor（元件座標）下的影像位置保持不動
+    void panBy(const QPointF &delta);
+
+    // 以影像座標表示的選取框（含右下像素），空矩形時隱藏
+    void setSelection(const QRect &imageRect);
+    void setCrosshairEnabled(bool enabled);     // 游標在影像上時顯示對準像素中心的十字線
+
+    QSize sizeHint() const override;
+
+signals:
+    void viewChanged();     // 縮放、平移或元件大小改變，需要的顯示解析度可能不同
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void leaveEvent(QEvent *event) override;
+
+private:
+    static const int DetailTileSize = 256;      // 放大區塊的邊長（區塊像素）
+
+    double fitScale() const;                    // 影像剛好放進元件時的比例
+    double scale() const;                       // 每個影像像素佔幾個邏輯像素
+    double maxZoom() const;
+    void clampCenter();
+    QRect imageViewRect() const;                // 影像在元件上涵蓋的範圍
+    QRegion selectionRegion() const;            // 選取框邊線涵蓋的範圍
+    QRegion crosshairRegion() const;            // 十字線涵蓋的範圍
+    void moveCrosshair(const QPointF &viewPos);
+    void renderBaseLayer();                     // 依目前的轉換重建畫面快取
+    void invalidateBaseLayer();                 // 轉換或影像改變，整個元件重繪
+    void drawDetail(QPainter &painter, const QTransform &view, double deviceScale);
+    QPixmap detailTile(int level, int column, int row);     // 取快取中的區塊，沒有時向來源取樣
+
+    QPixmap pixmap;
+    QSize   logicalSize;            // 影像座標範圍
+    QPointF center;                 // 顯示在元件中心的影像座標
+    double  zoomFactor;
+    QRect   selection;
+    bool    crosshairEnabled;
+    QPoint  crosshairPixel;         // 十字線對準的影像像素，(-1, -1) 表示不顯示
+    bool    panning;
+    QPointF panOrigin;              // 上一次平移時的游標位置
+    QPixmap baseLayer;              // 背景與縮放後影像的畫面快取（裝置像素），不含疊加層
+    bool    baseLayerValid;
+    DetailSource detailSource;
+    QCache<quint64, QPixmap> detailTiles;   // 以 KB 計算成本的放大區塊快取，鍵含取樣層級
+};
+
+#endif // IMAGEVIEWPORT_H
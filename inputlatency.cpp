@@ -0,0 +1,223 @@
+#include "inputlatency.h"
+#include <QFile>
+#include <QScreen>
+#include <QSize>
+
+bool InputLatency::enabled = false;
+
+namespace {
+
+// 直方圖各格的上限（微秒），最後一格收超過 100 ms 的部分；16.7 / 33.3 ms 對應 60 Hz 的一、兩個畫面
+const qint64 BucketLimitsUs[] = { 1000, 2000, 4000, 8000, 12000, 16700, 25000, 33300, 50000, 100000 };
+const int BucketCount = int(sizeof(BucketLimitsUs) / sizeof(BucketLimitsUs[0])) + 1;
+
+const char *const PathNames[InputLatency::PathCount] = { "游標讀值", "選取框", "畫筆" };
+const char *const PathTraceNames[InputLatency::PathCount] = { "input->paint: readout", "input->paint: selection",
+                                                              "input->paint: painting" };
+
+struct Histogram
+{
+    quint64 buckets[BucketCount] = {};
+    quint64 count = 0;
+    qint64 total = 0;
+    qint64 longest = 0;
+
+    void add(qint64 ns)
+    {
+        const qint64 us = ns / 1000;
+        int bucket = 0;
+        while (bucket < BucketCount - 1 && us >= BucketLimitsUs[bucket])
+            ++bucket;
+        ++buckets[bucket];
+        ++count;
+        total += ns;
+        longest = qMax(longest, ns);
+    }
+
+    // 百分位數落在哪一格就回報該格的上限；落在最後一格時回報最長值
+    double percentileMs(int percent) const
+    {
+        const quint64 rank = (count * percent + 99) / 100;
+        quint64 seen = 0;
+        for (int bucket = 0; bucket < BucketCount - 1; ++bucket)
+        {
+            seen += buckets[bucket];
+            if (seen >= rank)
+                return BucketLimitsUs[bucket] / 1000.0;
+        }
+        return longest / 1e6;
+    }
+};
+
+struct PathStats
+{
+    Histogram latency;      // 每個畫面一筆：最早的輸入到畫面送出
+    quint64 events = 0;     // 收到的輸入事件數
+    quint64 dropped = 0;    // 延遲超過 k 個更新週期時記為掉了 k 個畫面
+};
+
+PathStats stats[InputLatency::PathCount];
+Histogram frameWork;        // 含待顯示輸入的畫面，同步重繪本身的耗時
+qint64 startedAt = 0;       // 啟用或清除的時間，早於此時的待顯示輸入直接捨棄
+QSize screenPixels;
+double refreshHz = 60;
+
+QString formatMs(qint64 ns)
+{
+    return QString::number(ns / 1e6, 'f', 1);
+}
+
+QString bucketLabel(int bucket)
+{
+    if (bucket == BucketCount - 1)
+        return QString(">= %1 ms").arg(BucketLimitsUs[bucket - 1] / 1000.0);
+    return QString("< %1 ms").arg(BucketLimitsUs[bucket] / 1000.0);
+}
+
+void appendHistogram(QString &text, const Histogram &histogram)
+{
+    quint64 largest = 1;
+    for (quint64 value : histogram.buckets)
+        largest = qMax(largest, value);
+    for (int bucket = 0; bucket < BucketCount; ++bucket)
+    {
+        const int bar = int(histogram.buckets[bucket] * 40 / largest);
+        text += QString("  %1 |%2 %3\n")
+                    .arg(bucketLabel(bucket), 12)
+                    .arg(QString(bar, QLatin1Char('#')), -40)
+                    .arg(histogram.buckets[bucket]);
+    }
+}
+
+void appendSummary(QString &text, const Histogram &histogram)
+{
+    if (histogram.count == 0)
+        return;
+    text += QString("  平均 %1 ms  p50 <= %2 ms  p99 <= %3 ms  最長 %4 ms\n")
+                .arg(formatMs(histogram.total / qint64(histogram.count)))
+                .arg(histogram.percentileMs(50))
+                .arg(histogram.percentileMs(99))
+                .arg(formatMs(histogram.longest));
+}
+
+}
+
+InputLatency::InputLatency(QWidget *window)
+    : QObject(window), window(window)
+{
+    window->installEventFilter(this);
+}
+
+void InputLatency::setEnabled(bool on)
+{
+    if (on && !enabled)
+        startedAt = Tracer::now();
+    enabled = on;
+}
+
+void InputLatency::clear()
+{
+    for (PathStats &path : stats)
+        path = PathStats();
+    frameWork = Histogram();
+    startedAt = Tracer::now();
+}
+
+void InputLatency::addInput(Path path, qint64 receivedAt, int events)
+{
+    Pending &input = pending[path];
+    // 停用期間留下的舊輸入不列入
+    if (input.firstInput < startedAt)
+        input = Pending();
+    if (input.firstInput < 0)
+        input.firstInput = receivedAt;
+    input.events += events;
+}
+
+bool InputLatency::eventFilter(QObject *watched, QEvent *event)
+{
+    if (!enabled || watched != window || event->type() != QEvent::UpdateRequest)
+        return QObject::eventFilter(watched, event);
+
+    bool waiting = false;
+    for (const Pending &input : pending)
+        waiting = waiting || input.firstInput >= startedAt;
+    if (!waiting)
+        return QObject::eventFilter(watched, event);
+
+    // UpdateRequest 會讓整個視窗同步重繪並送上螢幕；在這裡直接交給視窗處理，才能取得結束的時間
+    const qint64 frameStart = Tracer::now();
+    watched->event(event);
+    const qint64 presented = Tracer::now();
+    frameWork.add(presented - frameStart);
+    if (Tracer::isEnabled())
+        Tracer::record("frame", frameStart, presented - frameStart, false);
+
+    if (QScreen *screen = window->screen())
+    {
+        screenPixels = screen->size() * screen->devicePixelRatio();
+        if (screen->refreshRate() > 0)
+            refreshHz = screen->refreshRate();
+    }
+    const qint64 period = qint64(1e9 / refreshHz);
+
+    for (int path = 0; path < PathCount; ++path)
+    {
+        Pending &input = pending[path];
+        if (input.firstInput >= startedAt)
+        {
+            const qint64 latency = presented - input.firstInput;
+            stats[path].latency.add(latency);
+            stats[path].events += input.events;
+            stats[path].dropped += quint64(latency / period);
+            if (Tracer::isEnabled())
+                Tracer::record(PathTraceNames[path], input.firstInput, latency, false);
+        }
+        input = Pending();
+    }
+    return true;
+}
+
+QString InputLatency::report()
+{
+    const qint64 elapsed = Tracer::now() - startedAt;
+    QString text = QString("輸入延遲分析：螢幕 %1x%2 @ %3 Hz（更新週期 %4 ms），記錄 %5 s\n")
+                       .arg(screenPixels.width())
+                       .arg(screenPixels.height())
+                       .arg(refreshHz, 0, 'f', 0)
+                       .arg(1000 / refreshHz, 0, 'f', 1)
+                       .arg(elapsed / 1e9, 0, 'f', 1);
+    text += QString("\n[重繪] 含待顯示輸入的畫面 %1 個\n").arg(frameWork.count);
+    appendSummary(text, frameWork);
+
+    for (int path = 0; path < PathCount; ++path)
+    {
+        const PathStats &entry = stats[path];
+        const quint64 frames = entry.latency.count;
+        text += QString("\n[%1] 事件 %2（%3 Hz，每畫面平均 %4 個）  畫面 %5  掉格 %6\n")
+                    .arg(QString::fromUtf8(PathNames[path]))
+                    .arg(entry.events)
+                    .arg(elapsed > 0 ? entry.events * 1e9 / elapsed : 0.0, 0, 'f', 0)
+                    .arg(frames ? double(entry.events) / frames : 0.0, 0, 'f', 1)
+                    .arg(frames)
+                    .arg(entry.dropped);
+        if (frames == 0)
+            continue;
+        appendSummary(text, entry.latency);
+        appendHistogram(text, entry.latency);
+    }
+    return text;
+}
+
+bool InputLatency::saveReport(const QString &path, QString *error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text) ||
+        file.write(report().toUtf8()) < 0)
+    {
+        if (error)
+            *error = file.errorString();
+        return false;
+    }
+    return true;
+}
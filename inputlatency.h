@@ -0,0 +1,75 @@
+#ifndef INPUTLATENCY_H
+#define INPUTLATENCY_H
+
+#include <QObject>
+#include <QWidget>
+#include <QEvent>
+#include <QString>
+#include "tracer.h"
+
+// 輸入到畫面的延遲分析：記下每個會改變畫面的滑鼠事件交給視窗的時間，
+// 在頂層視窗下一次同步重繪（所有子元件畫完並送上螢幕）結束時結算，依路徑累積延遲直方圖，
+// 並以螢幕的更新週期估計掉了幾個畫面。
+//
+// 同一個畫面之前收到的多個事件合併結算：延遲以其中最早的事件為準，另外記錄每個畫面合併了幾個事件。
+// 時間從 Qt 把事件交給視窗開始算，不含作業系統與事件佇列之前的部分。只在 GUI 執行緒使用
+class InputLatency : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Path
+    {
+        PointerReadout,     // 游標移動時的座標、亮度與統計讀值
+        Selection,          // Ctrl 拖曳的選取框
+        Painting,           // 放大視窗的畫筆
+        PathCount
+    };
+
+    // 安裝在頂層視窗 window 上，由它的重繪結算收到的輸入
+    explicit InputLatency(QWidget *window);
+
+    static bool isEnabled()
+    {
+        return enabled;
+    }
+    static void setEnabled(bool on);
+    static void clear();                    // 捨棄目前為止的統計
+
+    // 事件處理一開始取得的時間；停用時回傳 0，不讀時鐘
+    static qint64 timestamp()
+    {
+        return enabled ? Tracer::now() : 0;
+    }
+
+    // 確定這個事件會更新畫面後呼叫，receivedAt 為事件開始處理時的 timestamp()；
+    // 多個事件合併處理時傳入其中最早的時間與合併的事件數
+    void inputReceived(Path path, qint64 receivedAt, int events = 1)
+    {
+        if (enabled)
+            addInput(path, receivedAt, events);
+    }
+
+    static QString report();                // 各路徑的直方圖、百分位數與掉格數（純文字）
+    static bool saveReport(const QString &path, QString *error = nullptr);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    // 上一個畫面之後收到、還沒顯示出來的輸入
+    struct Pending
+    {
+        qint64 firstInput = -1;
+        int events = 0;
+    };
+
+    void addInput(Path path, qint64 receivedAt, int events);
+
+    QWidget *window;
+    Pending pending[PathCount];
+
+    static bool enabled;
+};
+
+#endif // INPUTLATENCY_H
@@ -0,0 +1,249 @@
+#include "lumaplane.h"
+#include "pixelformats.h"
+#include "simdsupport.h"
+#include <QVector>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const int BandHeight = 64;      // 平行處理時每條帶的列數
+
+/*------------------------------ 亮度核心 ------------------------------*/
+
+// 32 位元像素在記憶體中為 B, G, R, A
+void lumaRow32Scalar(const uchar *src, uchar *dst, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        const uchar *p = src + i * 4;
+        dst[i] = uchar((p[2] * 11 + p[1] * 16 + p[0] * 5) >> 5);
+    }
+}
+
+#if defined(IP_X86_SIMD)
+
+// 一次 16 個像素：maddubs 得到 (b*5 + g*16) 與 (r*11) 兩段，hadd 相加後右移 5 位
+IP_TARGET("ssse3")
+void lumaRow32Ssse3(const uchar *src, uchar *dst, int count)
+{
+    const __m128i weights = _mm_setr_epi8(5, 16, 11, 0, 5, 16, 11, 0, 5, 16, 11, 0, 5, 16, 11, 0);
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i *p = reinterpret_cast<const __m128i *>(src + i * 4);
+        const __m128i s0 = _mm_maddubs_epi16(_mm_loadu_si128(p), weights);
+        const __m128i s1 = _mm_maddubs_epi16(_mm_loadu_si128(p + 1), weights);
+        const __m128i s2 = _mm_maddubs_epi16(_mm_loadu_si128(p + 2), weights);
+        const __m128i s3 = _mm_maddubs_epi16(_mm_loadu_si128(p + 3), weights);
+        const __m128i lo = _mm_srli_epi16(_mm_hadd_epi16(s0, s1), 5);
+        const __m128i hi = _mm_srli_epi16(_mm_hadd_epi16(s2, s3), 5);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    if (i < count)
+        lumaRow32Scalar(src + i * 4, dst + i, count - i);
+}
+
+#endif // IP_X86_SIMD
+
+typedef void (*LumaRow)(const uchar *src, uchar *dst, int count);
+
+LumaRow selectLumaRow()
+{
+#if defined(IP_X86_SIMD)
+    if (Simd::hasSsse3())
+        return lumaRow32Ssse3;
+#endif
+    return lumaRow32Scalar;
+}
+
+// 每種正規格式各產生一份：灰階直接複製，32 位元走選好的 SIMD 核心，64 位元逐像素
+template<typename F>
+void lumaRows(const QImage &image, QImage &result, int first, int last, LumaRow lumaRow32)
+{
+    const int width = image.width();
+    for (int y = first; y < last; ++y)
+    {
+        const uchar *src = image.constScanLine(y);
+        uchar *dst = result.scanLine(y);
+        if constexpr (F::isGray)
+            std::memcpy(dst, src, size_t(width));
+        else if constexpr (F::bytesPerPixel == 4)
+            lumaRow32(src, dst, width);
+        else
+            for (int x = 0; x < width; ++x)
+                dst[x] = uchar(F::luma(src + x * F::bytesPerPixel));
+    }
+}
+
+/*------------------------------ 統計核心 ------------------------------*/
+
+struct Accumulator
+{
+    quint64 sum = 0;
+    quint64 sumSquares = 0;
+    int min = 255;
+    int max = 0;
+};
+
+void accumulateRowScalar(const uchar *p, int count, Accumulator &acc)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        const int v = p[i];
+        acc.sum += quint64(v);
+        acc.sumSquares += quint64(v * v);
+        acc.min = qMin(acc.min, v);
+        acc.max = qMax(acc.max, v);
+    }
+}
+
+#if defined(IP_X86_SIMD)
+
+// 總和用 psadbw，平方和用 pmaddwd；32 位元的平方和每 4096 個區塊就併入 64 位元，不會溢位
+IP_TARGET("sse2")
+void accumulateRowSse2(const uchar *p, int count, Accumulator &acc)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = _mm_setzero_si128();
+    __m128i minV = _mm_set1_epi8(char(0xff));
+    __m128i maxV = _mm_setzero_si128();
+    int i = 0;
+    while (i + 16 <= count)
+    {
+        __m128i squares = _mm_setzero_si128();
+        const int chunkEnd = qMin(count - 15, i + 4096 * 16);
+        for (; i < chunkEnd; i += 16)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+            sum = _mm_add_epi64(sum, _mm_sad_epu8(v, zero));
+            minV = _mm_min_epu8(minV, v);
+            maxV = _mm_max_epu8(maxV, v);
+            const __m128i lo = _mm_unpacklo_epi8(v, zero);
+            const __m128i hi = _mm_unpackhi_epi8(v, zero);
+            squares = _mm_add_epi32(squares, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+        }
+        alignas(16) quint32 lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes), squares);
+        acc.sumSquares += quint64(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    }
+    alignas(16) quint64 sums[2];
+    _mm_store_si128(reinterpret_cast<__m128i *>(sums), sum);
+    acc.sum += sums[0] + sums[1];
+    alignas(16) uchar mins[16];
+    alignas(16) uchar maxs[16];
+    _mm_store_si128(reinterpret_cast<__m128i *>(mins), minV);
+    _mm_store_si128(reinterpret_cast<__m128i *>(maxs), maxV);
+    if (i > 0)
+    {
+        for (int k = 0; k < 16; ++k)
+        {
+            acc.min = qMin(acc.min, int(mins[k]));
+            acc.max = qMax(acc.max, int(maxs[k]));
+        }
+    }
+    if (i < count)
+        accumulateRowScalar(p + i, count - i, acc);
+}
+
+#endif // IP_X86_SIMD
+
+void accumulateRow(const uchar *p, int count, Accumulator &acc)
+{
+#if defined(IP_X86_SIMD)
+    accumulateRowSse2(p, count, acc);
+#else
+    accumulateRowScalar(p, count, acc);
+#endif
+}
+
+}
+
+LumaPlane::LumaPlane()
+    : key(0)
+{
+}
+
+LumaPlane::LumaPlane(const QImage &image, const Parallel::CancelCheck &isCancelled)
+    : key(image.cacheKey())
+{
+    if (image.isNull())
+        return;
+    QImage result(image.size(), QImage::Format_Grayscale8);
+    if (result.isNull())
+        return;
+
+    // 載入時已正規化的影像直接共用，不會複製
+    const QImage source = PixelFormats::normalized(image);
+    const LumaRow lumaRow = selectLumaRow();
+    const bool done = Parallel::forEachBand(source.height(), BandHeight, [&](int first, int last) {
+        PixelFormats::dispatch(source.format(), [&](auto format) {
+            lumaRows<decltype(format)>(source, result, first, last, lumaRow);
+        });
+    }, isCancelled);
+    if (done)
+        plane = result;
+}
+
+bool LumaPlane::isNull() const
+{
+    return plane.isNull();
+}
+
+QSize LumaPlane::size() const
+{
+    return plane.size();
+}
+
+qint64 LumaPlane::sourceKey() const
+{
+    return key;
+}
+
+const QImage &LumaPlane::image() const
+{
+    return plane;
+}
+
+int LumaPlane::value(int x, int y) const
+{
+    if (plane.isNull() || x < 0 || y < 0 || x >= plane.width() || y >= plane.height())
+        return -1;
+    return plane.constScanLine(y)[x];
+}
+
+LumaPlane::Stats LumaPlane::stats(const QRect &rect) const
+{
+    Stats result;
+    const QRect region = rect.intersected(plane.rect());
+    if (plane.isNull() || region.isEmpty())
+        return result;
+
+    // 小範圍（滑鼠附近）直接算；大範圍（選取區域）分帶平行後再合併
+    QVector<Accumulator> partials((region.height() + BandHeight - 1) / BandHeight);
+    auto accumulateBand = [&](int first, int last) {
+        Accumulator &acc = partials[first / BandHeight];
+        for (int y = first; y < last; ++y)
+            accumulateRow(plane.constScanLine(region.top() + y) + region.left(), region.width(), acc);
+    };
+    if (partials.size() == 1)
+        accumulateBand(0, region.height());
+    else
+        Parallel::forEachBand(region.height(), BandHeight, accumulateBand);
+
+    Accumulator total;
+    for (const Accumulator &acc : partials)
+    {
+        total.sum += acc.sum;
+        total.sumSquares += acc.sumSquares;
+        total.min = qMin(total.min, acc.min);
+        total.max = qMax(total.max, acc.max);
+    }
+    result.count = qint64(region.width()) * region.height();
+    result.mean = double(total.sum) / result.count;
+    result.min = total.min;
+    result.max = total.max;
+    const double variance = double(total.sumSquares) / result.count - result.mean * result.mean;
+    result.stdDev = std::sqrt(qMax(0.0, variance));
+    return result;
+}
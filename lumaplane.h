@@ -0,0 +1,42 @@
+#ifndef LUMAPLANE_H
+#define LUMAPLANE_H
+
+#include <QImage>
+#include <QRect>
+#include "parallelfor.h"
+
+// 8 位元亮度平面：每張影像只算一次，之後滑鼠讀值與區域統計都直接讀這個平面
+// 亮度與 qGray 相同：(r * 11 + g * 16 + b * 5) / 32，32 位元影像走 SSSE3 核心
+class LumaPlane
+{
+public:
+    // 區域統計；count 為 0 代表範圍內沒有像素
+    struct Stats
+    {
+        qint64 count = 0;
+        double mean = 0;
+        int    min = 0;
+        int    max = 0;
+        double stdDev = 0;
+        bool isValid() const { return count > 0; }
+    };
+
+    LumaPlane();
+    // 同步建立；呼叫端負責放到背景執行緒。被取消時得到空平面
+    explicit LumaPlane(const QImage &image,
+                       const Parallel::CancelCheck &isCancelled = Parallel::CancelCheck());
+
+    bool isNull() const;
+    QSize size() const;
+    qint64 sourceKey() const;   // 建立時原圖的 cacheKey
+    const QImage &image() const;    // Grayscale8 影像
+
+    int value(int x, int y) const;          // 超出範圍時回傳 -1
+    Stats stats(const QRect &rect) const;   // rect 會先裁到平面範圍內
+
+private:
+    QImage plane;
+    qint64 key;
+};
+
+#endif // LUMAPLANE_H
@@ -1,11 +1,42 @@
 #include "imageprocessor.h"
+#include "batchprocessor.h"
+#include "tracer.h"
+#include "inputlatency.h"
 
 #include <QApplication>
+#include <QCoreApplication>
 
 int main(int argc, char *argv[])
 {
-    QApplication a(argc, argv);
-    ImageProcessor w;
-    w.show();
-    return a.exec();
+    // 設定 IMAGEPROCESSOR_TRACE=<檔名> 時從啟動就開始追蹤，結束時匯出 trace JSON（批次模式也適用）
+    const QString tracePath = qEnvironmentVariable("IMAGEPROCESSOR_TRACE");
+    if (!tracePath.isEmpty())
+        Tracer::setEnabled(true);
+
+    int status;
+    // 帶 --batch 時不建立任何視窗，只用 QCoreApplication 跑批次處理
+    if (BatchProcessor::isBatchInvocation(argc, argv))
+    {
+        QCoreApplication a(argc, argv);
+        status = BatchProcessor::run(a.arguments());
+    }
+    else
+    {
+        // 設定 IMAGEPROCESSOR_LATENCY=<檔名> 時從啟動就開始延遲分析，結束時寫出報告
+        const QString latencyPath = qEnvironmentVariable("IMAGEPROCESSOR_LATENCY");
+        if (!latencyPath.isEmpty())
+            InputLatency::setEnabled(true);
+
+        QApplication a(argc, argv);
+        ImageProcessor w;
+        w.show();
+        status = a.exec();
+
+        if (!latencyPath.isEmpty())
+            InputLatency::saveReport(latencyPath);
+    }
+
+    if (!tracePath.isEmpty())
+        Tracer::exportChromeTrace(tracePath);
+    return status;
 }
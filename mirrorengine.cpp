@@ -0,0 +1,346 @@
+#include "mirrorengine.h"
+#include "parallelfor.h"
+#include "simdsupport.h"
+#include <cstring>
+
+namespace {
+
+const int BandHeight = 64;      // 平行處理時每條帶的列數（垂直鏡射時為列的對數）
+
+struct Pixel24
+{
+    uchar c[3];
+};
+
+/*------------------------------ 純量核心 ------------------------------*/
+
+// 所有鏡射都歸結為同一個運算：
+// outA[i] = b[width-1-i]、outB[width-1-i] = a[i]，i 屬於 [first, count)
+// 同一列水平鏡射時 a == b、outA == outB、count 為一半寬；兩列對調時 count 為整列寬。
+// 每一對先讀後寫，因此 out 與輸入相同（原地處理）也正確
+template <typename Pixel>
+inline void reversePairsScalar(const uchar *a, const uchar *b, uchar *outA, uchar *outB,
+                               int first, int count, int width)
+{
+    const Pixel *pa = reinterpret_cast<const Pixel *>(a);
+    const Pixel *pb = reinterpret_cast<const Pixel *>(b);
+    Pixel *qa = reinterpret_cast<Pixel *>(outA);
+    Pixel *qb = reinterpret_cast<Pixel *>(outB);
+    for (int i = first; i < count; ++i)
+    {
+        const Pixel left = pa[i];
+        const Pixel right = pb[width - 1 - i];
+        qa[i] = right;
+        qb[width - 1 - i] = left;
+    }
+}
+
+template <typename Pixel>
+void reversePairsPlain(const uchar *a, const uchar *b, uchar *outA, uchar *outB, int count, int width)
+{
+    reversePairsScalar<Pixel>(a, b, outA, outB, 0, count, width);
+}
+
+/*------------------------------ SSSE3 核心 ------------------------------*/
+
+#if defined(IP_X86_SIMD)
+
+// 每個 Block 一次處理兩段各 Pixels 個像素：兩段都讀進暫存器、在暫存器內反序後交叉寫出
+struct Block8
+{
+    typedef quint8 Pixel;
+    enum { Pixels = 16 };
+
+    IP_TARGET("ssse3")
+    static inline void reversePair(const uchar *a, const uchar *b, uchar *outA, uchar *outB)
+    {
+        const __m128i mask = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(outA), _mm_shuffle_epi8(vb, mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(outB), _mm_shuffle_epi8(va, mask));
+    }
+};
+
+struct Block16
+{
+    typedef quint16 Pixel;
+    enum { Pixels = 8 };
+
+    IP_TARGET("ssse3")
+    static inline void reversePair(const uchar *a, const uchar *b, uchar *outA, uchar *outB)
+    {
+        const __m128i mask = _mm_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(outA), _mm_shuffle_epi8(vb, mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(outB), _mm_shuffle_epi8(va, mask));
+    }
+};
+
+// 16 個 24 位元像素佔三個暫存器；每個輸出暫存器由兩到三個輸入暫存器 pshufb 後合併
+// （遮罩中的 -128 代表填 0）
+struct Block24
+{
+    typedef Pixel24 Pixel;
+    enum { Pixels = 16 };
+
+    IP_TARGET("ssse3")
+    static inline void reverse(const __m128i *in, __m128i *out)
+    {
+        const __m128i m01 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 14);
+        const __m128i m02 = _mm_setr_epi8(13, 14, 15, 10, 11, 12, 7, 8, 9, 4, 5, 6, 1, 2, 3, -128);
+        const __m128i m10 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 15, -128);
+        const __m128i m11 = _mm_setr_epi8(15, -128, 11, 12, 13, 8, 9, 10, 5, 6, 7, 2, 3, 4, -128, 0);
+        const __m128i m12 = _mm_setr_epi8(-128, 0, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+        const __m128i m20 = _mm_setr_epi8(-128, 12, 13, 14, 9, 10, 11, 6, 7, 8, 3, 4, 5, 0, 1, 2);
+        const __m128i m21 = _mm_setr_epi8(1, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+        out[0] = _mm_or_si128(_mm_shuffle_epi8(in[2], m02), _mm_shuffle_epi8(in[1], m01));
+        out[1] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(in[1], m11), _mm_shuffle_epi8(in[0], m10)),
+                              _mm_shuffle_epi8(in[2], m12));
+        out[2] = _mm_or_si128(_mm_shuffle_epi8(in[0], m20), _mm_shuffle_epi8(in[1], m21));
+    }
+
+    IP_TARGET("ssse3")
+    static inline void reversePair(const uchar *a, const uchar *b, uchar *outA, uchar *outB)
+    {
+        __m128i va[3], vb[3], ra[3], rb[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            va[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a) + k);
+            vb[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b) + k);
+        }
+        reverse(va, ra);
+        reverse(vb, rb);
+        for (int k = 0; k < 3; ++k)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(outA) + k, rb[k]);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(outB) + k, ra[k]);
+        }
+    }
+};
+
+// 32 與 64 位元只需 SSE2 的 pshufd
+struct Block32
+{
+    typedef quint32 Pixel;
+    enum { Pixels = 4 };
+
+    IP_TARGET("ssse3")
+    static inline void reversePair(const uchar *a, const uchar *b, uchar *outA, uchar *outB)
+    {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(outA), _mm_shuffle_epi32(vb, 0x1B));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(outB), _mm_shuffle_epi32(va, 0x1B));
+    }
+};
+
+struct Block64
+{
+    typedef quint64 Pixel;
+    enum { Pixels = 2 };
+
+    IP_TARGET("ssse3")
+    static inline void reversePair(const uchar *a, const uchar *b, uchar *outA, uchar *outB)
+    {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(outA), _mm_shuffle_epi32(vb, 0x4E));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(outB), _mm_shuffle_epi32(va, 0x4E));
+    }
+};
+
+// 以 Block 為單位處理 [0, count)，剩下不足一個 Block 的部分用純量核心
+template <typename Block>
+IP_TARGET("ssse3")
+void reversePairsSsse3(const uchar *a, const uchar *b, uchar *outA, uchar *outB, int count, int width)
+{
+    typedef typename Block::Pixel Pixel;
+    const int pixels = Block::Pixels;
+    int i = 0;
+    for (; i + pixels <= count; i += pixels)
+    {
+        const qsizetype front = qsizetype(i) * sizeof(Pixel);
+        const qsizetype back = qsizetype(width - i - pixels) * sizeof(Pixel);
+        Block::reversePair(a + front, b + back, outA + front, outB + back);
+    }
+    reversePairsScalar<Pixel>(a, b, outA, outB, i, count, width);
+}
+
+#endif // IP_X86_SIMD
+
+typedef void (*ReversePairs)(const uchar *a, const uchar *b, uchar *outA, uchar *outB, int count, int width);
+
+// SSSE3 幾乎所有 x86-64 CPU 都有，32/64 位元核心雖只用到 SSE2 也一併依此判斷
+ReversePairs selectReversePairs(int depth)
+{
+#if defined(IP_X86_SIMD)
+    if (Simd::hasSsse3())
+    {
+        switch (depth)
+        {
+        case 8:  return reversePairsSsse3<Block8>;
+        case 16: return reversePairsSsse3<Block16>;
+        case 24: return reversePairsSsse3<Block24>;
+        case 32: return reversePairsSsse3<Block32>;
+        case 64: return reversePairsSsse3<Block64>;
+        default: return nullptr;
+        }
+    }
+#endif
+    switch (depth)
+    {
+    case 8:  return reversePairsPlain<quint8>;
+    case 16: return reversePairsPlain<quint16>;
+    case 24: return reversePairsPlain<Pixel24>;
+    case 32: return reversePairsPlain<quint32>;
+    case 64: return reversePairsPlain<quint64>;
+    default: return nullptr;
+    }
+}
+
+// 兩列對調（只有垂直鏡射）：以堆疊上的小緩衝分段交換，不配置記憶體
+void swapRows(uchar *a, uchar *b, qsizetype bytes)
+{
+    uchar chunk[4096];
+    for (qsizetype offset = 0; offset < bytes; offset += qsizetype(sizeof(chunk)))
+    {
+        const size_t n = size_t(qMin<qsizetype>(sizeof(chunk), bytes - offset));
+        std::memcpy(chunk, a + offset, n);
+        std::memcpy(a + offset, b + offset, n);
+        std::memcpy(b + offset, chunk, n);
+    }
+}
+
+// 共用的鏡射流程：src 與 dst 可以是同一塊記憶體（原地處理）
+// 有垂直鏡射時以第 y 列與第 h-1-y 列成對處理，兩列各自只被一個執行緒碰到
+void mirrorBits(const uchar *srcBits, qsizetype srcBpl, uchar *dstBits, qsizetype dstBpl,
+                int width, int height, int depth, bool horizontal, bool vertical, ReversePairs reversePairs)
+{
+    const bool inPlace = srcBits == dstBits;
+    const qsizetype rowBytes = (qsizetype(width) * depth + 7) / 8;
+
+    if (!vertical)
+    {
+        Parallel::forEachBand(height, BandHeight, [&](int first, int last) {
+            for (int y = first; y < last; ++y)
+            {
+                const uchar *in = srcBits + y * srcBpl;
+                uchar *out = dstBits + y * dstBpl;
+                reversePairs(in, in, out, out, width / 2, width);
+                if (width % 2 && !inPlace)
+                    std::memcpy(out + qsizetype(width / 2) * depth / 8, in + qsizetype(width / 2) * depth / 8, size_t(depth / 8));
+            }
+        });
+        return;
+    }
+
+    Parallel::forEachBand(height / 2, BandHeight, [&](int first, int last) {
+        for (int y = first; y < last; ++y)
+        {
+            const int mirrorY = height - 1 - y;
+            const uchar *inTop = srcBits + y * srcBpl;
+            const uchar *inBottom = srcBits + mirrorY * srcBpl;
+            uchar *outTop = dstBits + y * dstBpl;
+            uchar *outBottom = dstBits + mirrorY * dstBpl;
+            if (horizontal)
+                reversePairs(inTop, inBottom, outTop, outBottom, width, width);
+            else if (inPlace)
+                swapRows(outTop, outBottom, rowBytes);
+            else
+            {
+                std::memcpy(outTop, inBottom, size_t(rowBytes));
+                std::memcpy(outBottom, inTop, size_t(rowBytes));
+            }
+        }
+    });
+
+    // 奇數高度時中間那一列只需水平鏡射
+    if (height % 2)
+    {
+        const int middle = height / 2;
+        const uchar *in = srcBits + middle * srcBpl;
+        uchar *out = dstBits + middle * dstBpl;
+        if (horizontal)
+        {
+            reversePairs(in, in, out, out, width / 2, width);
+            if (width % 2 && !inPlace)
+                std::memcpy(out + qsizetype(width / 2) * depth / 8, in + qsizetype(width / 2) * depth / 8, size_t(depth / 8));
+        }
+        else if (!inPlace)
+        {
+            std::memcpy(out, in, size_t(rowBytes));
+        }
+    }
+}
+
+void copyMetadata(const QImage &src, QImage &dst)
+{
+    dst.setColorTable(src.colorTable());
+    dst.setDotsPerMeterX(src.dotsPerMeterX());
+    dst.setDotsPerMeterY(src.dotsPerMeterY());
+    dst.setDevicePixelRatio(src.devicePixelRatio());
+}
+
+}
+
+void MirrorEngine::mirrorInPlace(QImage &image, bool horizontal, bool vertical)
+{
+    if (image.isNull() || (!horizontal && !vertical))
+        return;
+    const ReversePairs reversePairs = selectReversePairs(image.depth());
+    if (!reversePairs)
+    {
+        // 1 位元等不是整位元組的格式交給 Qt
+        image = image.mirrored(horizontal, vertical);
+        return;
+    }
+    uchar *bits = image.bits();
+    mirrorBits(bits, image.bytesPerLine(), bits, image.bytesPerLine(),
+               image.width(), image.height(), image.depth(), horizontal, vertical, reversePairs);
+}
+
+void MirrorEngine::mirror(const QImage &src, QImage &dst, bool horizontal, bool vertical)
+{
+    if (src.isNull())
+    {
+        dst = QImage();
+        return;
+    }
+    const ReversePairs reversePairs = selectReversePairs(src.depth());
+    if (!reversePairs)
+    {
+        dst = src.mirrored(horizontal, vertical);
+        return;
+    }
+
+    // dst 與別的 QImage 共用資料時 detach 會白白複製一次，不如直接配置新的；
+    // dst 就是 src 本身時則走 bits() 的 detach，之後等同原地處理
+    const bool reusable = dst.size() == src.size() && dst.format() == src.format() &&
+                          (dst.isDetached() || &dst == &src);
+    if (!reusable)
+        dst = QImage(src.size(), src.format());
+    if (dst.isNull())
+        return;
+    uchar *dstBits = dst.bits();
+    const uchar *srcBits = src.constBits();
+    copyMetadata(src, dst);
+
+    if (!horizontal && !vertical)
+    {
+        const qsizetype rowBytes = (qsizetype(src.width()) * src.depth() + 7) / 8;
+        for (int y = 0; y < src.height(); ++y)
+            std::memcpy(dstBits + y * dst.bytesPerLine(), srcBits + y * src.bytesPerLine(), size_t(rowBytes));
+        return;
+    }
+    mirrorBits(srcBits, src.bytesPerLine(), dstBits, dst.bytesPerLine(),
+               src.width(), src.height(), src.depth(), horizontal, vertical, reversePairs);
+}
+
+QImage MirrorEngine::mirrored(const QImage &src, bool horizontal, bool vertical)
+{
+    QImage dst;
+    mirror(src, dst, horizontal, vertical);
+    return dst;
+}
@@ -0,0 +1,22 @@
+#ifndef MIRRORENGINE_H
+#define MIRRORENGINE_H
+
+#include <QImage>
+
+// 鏡射引擎：取代 QImage::mirrored
+// 依像素大小（8/16/24/32/64 位元）特化的核心，水平鏡射在暫存器內以 SSSE3 反轉像素順序，
+// 垂直鏡射只是整列對調；可以原地處理，或寫進大小與格式相同、可重複使用的目的影像，不必每次配置
+class MirrorEngine
+{
+public:
+    // 原地鏡射（image 與其他 QImage 共用資料時會先 detach）
+    static void mirrorInPlace(QImage &image, bool horizontal, bool vertical);
+
+    // 把 src 鏡射到 dst；dst 的大小與格式與 src 相同時直接覆寫它的緩衝，否則重新配置
+    static void mirror(const QImage &src, QImage &dst, bool horizontal, bool vertical);
+
+    // 便利函式：回傳新的影像，結果與 QImage::mirrored 相同
+    static QImage mirrored(const QImage &src, bool horizontal, bool vertical);
+};
+
+#endif // MIRRORENGINE_H
@@ -0,0 +1,59 @@
+#ifndef PARALLELFOR_H
+#define PARALLELFOR_H
+
+#include <QRect>
+#include <QSize>
+#include <QVector>
+#include <QAtomicInt>
+#include <QtConcurrent/QtConcurrentMap>
+#include <functional>
+
+// 平行處理輔助：把影像切成區塊或水平條帶，交給全域 QThreadPool 的所有核心
+namespace Parallel {
+
+// 取消檢查；會在多個執行緒同時呼叫，必須是執行緒安全的
+typedef std::function<bool()> CancelCheck;
+
+// 把 size 切成 tileWidth x tileHeight 的區塊平行處理，被取消時回傳 false
+inline bool forEachTile(const QSize &size, int tileWidth, int tileHeight,
+                        const std::function<void(const QRect &)> &work,
+                        const CancelCheck &isCancelled = CancelCheck())
+{
+    QVector<QRect> tiles;
+    for (int y = 0; y < size.height(); y += tileHeight)
+        for (int x = 0; x < size.width(); x += tileWidth)
+            tiles.append(QRect(x, y, qMin(tileWidth, size.width() - x), qMin(tileHeight, size.height() - y)));
+
+    QAtomicInt cancelled(0);
+    auto runTile = [&](QRect &tile) {
+        if (cancelled.loadRelaxed())
+            return;
+        if (isCancelled && isCancelled())
+        {
+            cancelled.storeRelaxed(1);
+            return;
+        }
+        work(tile);
+    };
+
+    // 只有一塊時不必經過執行緒池
+    if (tiles.size() == 1)
+        runTile(tiles.first());
+    else
+        QtConcurrent::blockingMap(tiles, runTile);
+    return !cancelled.loadRelaxed();
+}
+
+// 以 bandHeight 列為一條帶平行處理 [0, height) 的列，work 收到的是 [first, last) 範圍
+inline bool forEachBand(int height, int bandHeight,
+                        const std::function<void(int first, int last)> &work,
+                        const CancelCheck &isCancelled = CancelCheck())
+{
+    return forEachTile(QSize(1, height), 1, qMax(1, bandHeight),
+                       [&](const QRect &band) { work(band.top(), band.bottom() + 1); },
+                       isCancelled);
+}
+
+}
+
+#endif // PARALLELFOR_H
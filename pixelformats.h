@@ -0,0 +1,148 @@
+#ifndef PIXELFORMATS_H
+#define PIXELFORMATS_H
+
+#include <QImage>
+#include <cstring>
+
+// 內部使用的正規像素格式：影像在載入時一次轉成其中之一，之後各核心不再自行轉換。
+//   Gray8    Grayscale8：灰階，以及色盤只有灰階的索引色／單色影像
+//   Rgb32    RGB32：不透明的 8 位元彩色，記憶體中為 B, G, R, 0xff
+//   Argb32Pm ARGB32_Premultiplied：含透明度的 8 位元彩色，記憶體中為 B, G, R, A
+//   Rgba64Pm RGBA64_Premultiplied：每通道超過 8 位元的影像（16 位元灰階、10/16 位元彩色），
+//            記憶體中為 16 位元的 R, G, B, A
+// 32 位元採用 Qt 原生的位元組順序，QPixmap::fromImage 與 QPainter 都不必重排通道。
+// 每個格式是一個編譯期的特性類別，核心以樣板針對各格式產生一份，內層迴圈不再判斷格式
+namespace PixelFormats {
+
+// 8 位元亮度，權重與 qGray 相同
+inline int lumaOf(int red, int green, int blue)
+{
+    return (red * 11 + green * 16 + blue * 5) >> 5;
+}
+
+struct Gray8
+{
+    static constexpr QImage::Format format = QImage::Format_Grayscale8;
+    static constexpr int bytesPerPixel = 1;
+    static constexpr bool hasAlpha = false;
+    static constexpr bool isGray = true;
+    static int red(const uchar *p)   { return p[0]; }
+    static int green(const uchar *p) { return p[0]; }
+    static int blue(const uchar *p)  { return p[0]; }
+    static int luma(const uchar *p)  { return p[0]; }
+};
+
+struct Rgb32
+{
+    static constexpr QImage::Format format = QImage::Format_RGB32;
+    static constexpr int bytesPerPixel = 4;
+    static constexpr bool hasAlpha = false;
+    static constexpr bool isGray = false;
+    static int red(const uchar *p)   { return p[2]; }
+    static int green(const uchar *p) { return p[1]; }
+    static int blue(const uchar *p)  { return p[0]; }
+    static int luma(const uchar *p)  { return lumaOf(p[2], p[1], p[0]); }
+};
+
+struct Argb32Pm
+{
+    static constexpr QImage::Format format = QImage::Format_ARGB32_Premultiplied;
+    static constexpr int bytesPerPixel = 4;
+    static constexpr bool hasAlpha = true;
+    static constexpr bool isGray = false;
+    static int red(const uchar *p)   { return p[2]; }
+    static int green(const uchar *p) { return p[1]; }
+    static int blue(const uchar *p)  { return p[0]; }
+    static int luma(const uchar *p)  { return lumaOf(p[2], p[1], p[0]); }
+};
+
+// 通道讀值取 16 位元的高 8 位元
+struct Rgba64Pm
+{
+    static constexpr QImage::Format format = QImage::Format_RGBA64_Premultiplied;
+    static constexpr int bytesPerPixel = 8;
+    static constexpr bool hasAlpha = true;
+    static constexpr bool isGray = false;
+    static int channel(const uchar *p, int index)
+    {
+        quint16 value;
+        std::memcpy(&value, p + index * 2, sizeof(value));
+        return value >> 8;
+    }
+    static int red(const uchar *p)   { return channel(p, 0); }
+    static int green(const uchar *p) { return channel(p, 1); }
+    static int blue(const uchar *p)  { return channel(p, 2); }
+    static int luma(const uchar *p)  { return lumaOf(red(p), green(p), blue(p)); }
+};
+
+// 每通道超過 8 位元的格式
+inline bool isDeepFormat(QImage::Format format)
+{
+    switch (format)
+    {
+    case QImage::Format_Grayscale16:
+    case QImage::Format_BGR30:
+    case QImage::Format_A2BGR30_Premultiplied:
+    case QImage::Format_RGB30:
+    case QImage::Format_A2RGB30_Premultiplied:
+        return true;
+    default:
+        return QImage::toPixelFormat(format).bitsPerPixel() >= 64;
+    }
+}
+
+inline bool isCanonical(QImage::Format format)
+{
+    return format == Gray8::format || format == Rgb32::format ||
+           format == Argb32Pm::format || format == Rgba64Pm::format;
+}
+
+// image 應該正規化成的格式
+inline QImage::Format canonicalFormat(const QImage &image)
+{
+    const QImage::Format format = image.format();
+    if (format == QImage::Format_Invalid || isCanonical(format))
+        return format;
+    if (isDeepFormat(format))
+        return Rgba64Pm::format;
+    // 索引色只需檢查色盤，不必逐像素
+    if ((format == QImage::Format_Indexed8 || format == QImage::Format_Mono || format == QImage::Format_MonoLSB) &&
+        !image.hasAlphaChannel() && image.allGray())
+        return Gray8::format;
+    return image.hasAlphaChannel() ? Argb32Pm::format : Rgb32::format;
+}
+
+// 已是正規格式時直接共用資料，否則只轉換這一次
+inline QImage normalized(const QImage &image)
+{
+    const QImage::Format format = canonicalFormat(image);
+    return format == image.format() ? image : image.convertToFormat(format);
+}
+
+// 依正規格式呼叫 fn(F())，F 為上面的特性類別，fn 通常是泛型 lambda；
+// format 不是正規格式時不呼叫並回傳 false
+template<typename Fn>
+bool dispatch(QImage::Format format, Fn &&fn)
+{
+    switch (format)
+    {
+    case QImage::Format_Grayscale8:
+        fn(Gray8());
+        return true;
+    case QImage::Format_RGB32:
+        fn(Rgb32());
+        return true;
+    case QImage::Format_ARGB32_Premultiplied:
+        fn(Argb32Pm());
+        return true;
+    case QImage::Format_RGBA64_Premultiplied:
+        fn(Rgba64Pm());
+        return true;
+    default:
+        return false;
+    }
+}
+
+}
+
+#endif // PIXELFORMATS_H
@@ -0,0 +1,387 @@
+#include "pngencoder.h"
+#include "parallelfor.h"
+#include "pixelformats.h"
+#include "tracer.h"
+#include <QSaveFile>
+#include <QVector>
+#include <QtEndian>
+#include <cstdlib>
+#include <cstring>
+#include <zlib.h>
+
+namespace {
+
+const int BandBytes = 1 << 20;      // 每條帶約有多少未壓縮的位元組
+const int MinBandRows = 8;
+const int WindowBytes = 32768;      // deflate 的回溯視窗，也是預設字典的長度
+const int MaxChunkBytes = 1 << 24;  // 單一 IDAT 區塊的上限
+
+struct Settings
+{
+    int level;          // zlib 壓縮等級
+    bool adaptive;      // 逐列挑選過濾器；否則固定用 Sub
+    uchar headerFlags;  // zlib 檔頭的 FLG，對應壓縮等級（FCHECK 已算好）
+};
+
+Settings settingsFor(PngEncoder::Preset preset)
+{
+    switch (preset)
+    {
+    case PngEncoder::Fast:
+        return { 1, false, 0x01 };
+    case PngEncoder::Smallest:
+        return { 9, true, 0xda };
+    case PngEncoder::Balanced:
+    default:
+        return { 6, true, 0x9c };
+    }
+}
+
+// 寫進檔案的像素排列；rowFormat 是轉換後的 QImage 格式，16 位元時還要轉成 big-endian
+struct Layout
+{
+    QImage::Format rowFormat;
+    uchar colorType;
+    uchar bitDepth;
+    int bytesPerPixel;
+};
+
+Layout layoutFor(QImage::Format format)
+{
+    switch (format)
+    {
+    case QImage::Format_Grayscale8:
+        return { QImage::Format_Grayscale8, 0, 8, 1 };
+    case QImage::Format_RGB32:
+        return { QImage::Format_RGB888, 2, 8, 3 };
+    case QImage::Format_RGBA64_Premultiplied:
+        return { QImage::Format_RGBA64, 6, 16, 8 };
+    case QImage::Format_ARGB32_Premultiplied:
+    default:
+        return { QImage::Format_RGBA8888, 6, 8, 4 };
+    }
+}
+
+/*------------------------------ 過濾器 ------------------------------*/
+
+inline int paeth(int a, int b, int c)
+{
+    const int p = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+// 以指定過濾器處理一列（不含開頭的類型位元組）；prev 為上一列，第一列時為全 0
+void applyFilter(int type, const uchar *row, const uchar *prev, int bytes, int bpp, uchar *out)
+{
+    switch (type)
+    {
+    case 0:
+        std::memcpy(out, row, size_t(bytes));
+        break;
+    case 1:
+        for (int i = 0; i < bytes; ++i)
+            out[i] = uchar(row[i] - (i >= bpp ? row[i - bpp] : 0));
+        break;
+    case 2:
+        for (int i = 0; i < bytes; ++i)
+            out[i] = uchar(row[i] - prev[i]);
+        break;
+    case 3:
+        for (int i = 0; i < bytes; ++i)
+            out[i] = uchar(row[i] - (((i >= bpp ? row[i - bpp] : 0) + prev[i]) >> 1));
+        break;
+    default:
+        for (int i = 0; i < bytes; ++i)
+            out[i] = uchar(row[i] - (i >= bpp ? paeth(row[i - bpp], prev[i], prev[i - bpp]) : prev[i]));
+        break;
+    }
+}
+
+// 過濾器好壞的估計：位元組視為有號數時的絕對值和（libpng 的做法）
+quint64 filterCost(const uchar *data, int bytes)
+{
+    quint64 sum = 0;
+    for (int i = 0; i < bytes; ++i)
+        sum += quint64(std::abs(int(static_cast<signed char>(data[i]))));
+    return sum;
+}
+
+// 過濾一列並在 out 前面寫入類型位元組；out 需有 bytes + 1 個位元組，scratch 需有 bytes 個
+void filterRow(const uchar *row, const uchar *prev, int bytes, int bpp, bool adaptive,
+               uchar *out, uchar *scratch)
+{
+    if (!adaptive)
+    {
+        out[0] = 1;
+        applyFilter(1, row, prev, bytes, bpp, out + 1);
+        return;
+    }
+    out[0] = 0;
+    applyFilter(0, row, prev, bytes, bpp, out + 1);
+    quint64 best = filterCost(out + 1, bytes);
+    for (int type = 1; type <= 4; ++type)
+    {
+        applyFilter(type, row, prev, bytes, bpp, scratch);
+        const quint64 cost = filterCost(scratch, bytes);
+        if (cost < best)
+        {
+            best = cost;
+            out[0] = uchar(type);
+            std::memcpy(out + 1, scratch, size_t(bytes));
+        }
+    }
+}
+
+// 把 [first, last) 列轉成檔案的像素排列；與來源格式相同時直接共用來源記憶體
+QImage rowsFor(const QImage &image, const Layout &layout, int first, int last)
+{
+    const QImage view(image.constScanLine(first), image.width(), last - first, image.bytesPerLine(),
+                      image.format());
+    if (view.format() == layout.rowFormat)
+        return view;
+    QImage rows = view.convertToFormat(layout.rowFormat);
+    if (layout.bitDepth == 16 && Q_BYTE_ORDER == Q_LITTLE_ENDIAN)
+    {
+        for (int y = 0; y < rows.height(); ++y)
+        {
+            quint16 *p = reinterpret_cast<quint16 *>(rows.scanLine(y));
+            for (int i = 0; i < rows.width() * 4; ++i)
+                p[i] = qbswap(p[i]);
+        }
+    }
+    return rows;
+}
+
+// 過濾 [first, last) 列，輸出為每列 1 + rowBytes 個位元組
+QByteArray filterRows(const QImage &image, const Layout &layout, bool adaptive, int first, int last)
+{
+    const int rowBytes = image.width() * layout.bytesPerPixel;
+    const int start = qMax(0, first - 1);   // 多轉一列作為第一列的上一列
+    const QImage rows = rowsFor(image, layout, start, last);
+    QByteArray filtered(qsizetype(last - first) * (rowBytes + 1), Qt::Uninitialized);
+    QByteArray zeros(rowBytes + 1, '\0');
+    QByteArray scratch(rowBytes + 1, Qt::Uninitialized);
+    uchar *out = reinterpret_cast<uchar *>(filtered.data());
+    for (int y = first; y < last; ++y, out += rowBytes + 1)
+    {
+        const uchar *prev = y > 0 ? rows.constScanLine(y - 1 - start)
+                                  : reinterpret_cast<const uchar *>(zeros.constData());
+        filterRow(rows.constScanLine(y - start), prev, rowBytes, layout.bytesPerPixel, adaptive,
+                  out, reinterpret_cast<uchar *>(scratch.data()));
+    }
+    return filtered;
+}
+
+// 以 raw deflate 壓縮一條帶；不是最後一條時以 Z_SYNC_FLUSH 結束在位元組邊界
+bool deflateBand(const QByteArray &input, const QByteArray &dictionary, int level, bool last,
+                 QByteArray &output)
+{
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    if (!dictionary.isEmpty() &&
+        deflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(dictionary.constData()),
+                             uInt(dictionary.size())) != Z_OK)
+    {
+        deflateEnd(&stream);
+        return false;
+    }
+
+    output.resize(qsizetype(deflateBound(&stream, uLong(input.size()))) + 16);
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.constData()));
+    stream.avail_in = uInt(input.size());
+    stream.next_out = reinterpret_cast<Bytef *>(output.data());
+    stream.avail_out = uInt(output.size());
+    const int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+    for (;;)
+    {
+        const int status = deflate(&stream, flush);
+        if (status == Z_STREAM_ERROR)
+        {
+            deflateEnd(&stream);
+            return false;
+        }
+        if (last ? status == Z_STREAM_END : stream.avail_out != 0)
+            break;
+        // 輸出空間用完：加大後繼續
+        const qsizetype used = output.size() - stream.avail_out;
+        output.resize(output.size() * 2);
+        stream.next_out = reinterpret_cast<Bytef *>(output.data()) + used;
+        stream.avail_out = uInt(output.size() - used);
+    }
+    output.resize(output.size() - stream.avail_out);
+    deflateEnd(&stream);
+    return true;
+}
+
+/*------------------------------ 檔案結構 ------------------------------*/
+
+bool writeChunk(QIODevice *device, const char *type, const char *data, qsizetype size)
+{
+    uchar header[8];
+    qToBigEndian<quint32>(quint32(size), header);
+    std::memcpy(header + 4, type, 4);
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, header + 4, 4);
+    if (size > 0)
+        crc = crc32(crc, reinterpret_cast<const Bytef *>(data), uInt(size));
+    uchar trailer[4];
+    qToBigEndian<quint32>(quint32(crc), trailer);
+    return device->write(reinterpret_cast<const char *>(header), 8) == 8 &&
+           (size == 0 || device->write(data, size) == size) &&
+           device->write(reinterpret_cast<const char *>(trailer), 4) == 4;
+}
+
+// IDAT 的切法不影響內容；過長的資料分成多個區塊
+bool writeData(QIODevice *device, const QByteArray &data)
+{
+    for (qsizetype offset = 0; offset < data.size(); offset += MaxChunkBytes)
+    {
+        if (!writeChunk(device, "IDAT", data.constData() + offset, qMin<qsizetype>(MaxChunkBytes, data.size() - offset)))
+            return false;
+    }
+    return true;
+}
+
+}
+
+QString PngEncoder::presetName(Preset preset)
+{
+    switch (preset)
+    {
+    case Fast:
+        return QStringLiteral("快速");
+    case Smallest:
+        return QStringLiteral("最小檔案");
+    case Balanced:
+    default:
+        return QStringLiteral("平衡");
+    }
+}
+
+bool PngEncoder::write(const QImage &src, QIODevice *device, Preset preset,
+                       SaveProgress *progress, QString *error)
+{
+    TRACE_SCOPE("PngEncoder::write");
+    const QImage image = PixelFormats::normalized(src);
+    if (image.isNull())
+    {
+        if (error)
+            *error = QStringLiteral("影像是空的");
+        return false;
+    }
+    const Settings settings = settingsFor(preset);
+    const Layout layout = layoutFor(image.format());
+    const int rowBytes = image.width() * layout.bytesPerPixel;
+    const int bandRows = qMax(MinBandRows, BandBytes / (rowBytes + 1));
+    const int bandCount = (image.height() + bandRows - 1) / bandRows;
+    // 預設字典需要的列數：涵蓋前一條帶最後 32 KB 的過濾資料
+    const int dictionaryRows = qMin(bandRows, (WindowBytes + rowBytes) / (rowBytes + 1));
+    if (progress)
+        progress->totalRows.storeRelaxed(image.height());
+
+    QVector<QByteArray> compressed(bandCount);
+    QVector<uLong> checksums(bandCount);
+    QVector<qint64> lengths(bandCount);
+    // 各條帶只寫自己的元素；先取出指標，工作執行緒中不經過 QVector 的 detach 檢查
+    QByteArray *compressedBands = compressed.data();
+    uLong *bandChecksums = checksums.data();
+    qint64 *bandLengths = lengths.data();
+    QAtomicInt failed(0);
+    const bool done = Parallel::forEachBand(image.height(), bandRows, [&](int first, int last) {
+        TRACE_SCOPE("PngEncoder band");
+        const int band = first / bandRows;
+        const QByteArray filtered = filterRows(image, layout, settings.adaptive, first, last);
+        QByteArray dictionary;
+        if (first > 0)
+        {
+            // 與前一條帶同樣的過濾結果（過濾只看來源像素，結果必然一致）
+            const QByteArray previous = filterRows(image, layout, settings.adaptive,
+                                                   first - dictionaryRows, first);
+            dictionary = previous.right(WindowBytes);
+        }
+        if (!deflateBand(filtered, dictionary, settings.level, band == bandCount - 1, compressedBands[band]))
+            failed.storeRelaxed(1);
+        bandChecksums[band] = adler32(adler32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(filtered.constData()),
+                                  uInt(filtered.size()));
+        bandLengths[band] = filtered.size();
+        if (progress)
+            progress->rowsDone.fetchAndAddRelaxed(last - first);
+    }, [progress]() { return progress && progress->cancelled.loadRelaxed(); });
+    if (!done || failed.loadRelaxed())
+    {
+        if (error)
+            *error = done ? QStringLiteral("壓縮失敗") : QStringLiteral("已取消");
+        return false;
+    }
+
+    // 條帶的 adler32 依序合併成整條串流的檢查碼
+    uLong adler = adler32(0L, Z_NULL, 0);
+    for (int band = 0; band < bandCount; ++band)
+        adler = adler32_combine(adler, checksums[band], z_off_t(lengths[band]));
+
+    static const char signature[8] = { '\x89', 'P', 'N', 'G', '\r', '\n', '\x1a', '\n' };
+    uchar header[13];
+    qToBigEndian<quint32>(quint32(image.width()), header);
+    qToBigEndian<quint32>(quint32(image.height()), header + 4);
+    header[8] = layout.bitDepth;
+    header[9] = layout.colorType;
+    header[10] = 0;     // deflate
+    header[11] = 0;     // 標準過濾方式
+    header[12] = 0;     // 不交錯
+    bool ok = device->write(signature, 8) == 8 &&
+              writeChunk(device, "IHDR", reinterpret_cast<const char *>(header), 13);
+    if (ok && image.dotsPerMeterX() > 0 && image.dotsPerMeterY() > 0)
+    {
+        uchar physical[9];
+        qToBigEndian<quint32>(quint32(image.dotsPerMeterX()), physical);
+        qToBigEndian<quint32>(quint32(image.dotsPerMeterY()), physical + 4);
+        physical[8] = 1;    // 單位為公尺
+        ok = writeChunk(device, "pHYs", reinterpret_cast<const char *>(physical), 9);
+    }
+
+    // zlib 檔頭接在第一條帶前，adler32 接在最後一條帶後
+    compressed.first().prepend(QByteArray("\x78") + char(settings.headerFlags));
+    uchar trailer[4];
+    qToBigEndian<quint32>(quint32(adler), trailer);
+    compressed.last().append(reinterpret_cast<const char *>(trailer), 4);
+    for (int band = 0; ok && band < bandCount; ++band)
+    {
+        ok = writeData(device, compressed[band]);
+        compressed[band] = QByteArray();    // 寫出後即釋放
+    }
+    ok = ok && writeChunk(device, "IEND", nullptr, 0);
+    if (!ok && error)
+        *error = device->errorString();
+    return ok;
+}
+
+bool PngEncoder::save(const QImage &image, const QString &path, Preset preset,
+                      SaveProgress *progress, QString *error)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        if (error)
+            *error = file.errorString();
+        return false;
+    }
+    if (!write(image, &file, preset, progress, error))
+    {
+        file.cancelWriting();
+        return false;
+    }
+    if (!file.commit())
+    {
+        if (error)
+            *error = file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef PNGENCODER_H
+#define PNGENCODER_H
+
+#include <QImage>
+#include <QIODevice>
+#include <QString>
+#include <QAtomicInt>
+
+// 背景存檔的共用狀態：GUI 執行緒設定取消旗標並定時讀取進度，編碼的工作執行緒更新
+struct SaveProgress
+{
+    QAtomicInt cancelled;   // 非 0 時尚未開始的條帶不再編碼，存檔失敗
+    QAtomicInt rowsDone;    // 已過濾並壓縮完成的列數
+    QAtomicInt totalRows;   // 影像高度，開始編碼前為 0
+};
+
+// 平行的 PNG 編碼器
+//
+// 影像切成約 1 MB 的水平條帶，每條帶在不同執行緒獨立過濾與 deflate：
+// 條帶以 Z_SYNC_FLUSH 結尾（最後一條為 Z_FINISH），壓縮資料對齊位元組邊界，
+// 依序串接後就是一條合法的 zlib 串流，adler32 以 adler32_combine 合併。
+// 每條帶以前一條帶最後 32 KB 的過濾資料作為預設字典，壓縮率與單執行緒幾乎相同
+class PngEncoder
+{
+public:
+    // 速度與檔案大小的取捨
+    enum Preset
+    {
+        Fast,       // 固定 Sub 過濾器、zlib 等級 1
+        Balanced,   // 逐列挑選過濾器、zlib 等級 6
+        Smallest,   // 逐列挑選過濾器、zlib 等級 9
+    };
+
+    static QString presetName(Preset preset);
+
+    // 灰階寫成 8 位元灰階、RGB32 寫成 RGB、含透明度的寫成 RGBA，
+    // 每通道超過 8 位元的影像寫成 16 位元 RGBA；progress 可為 nullptr
+    static bool write(const QImage &image, QIODevice *device, Preset preset = Balanced,
+                      SaveProgress *progress = nullptr, QString *error = nullptr);
+
+    // 以 QSaveFile 寫入，失敗或被取消時不會留下寫到一半的檔案
+    static bool save(const QImage &image, const QString &path, Preset preset = Balanced,
+                     SaveProgress *progress = nullptr, QString *error = nullptr);
+};
+
+#endif // PNGENCODER_H
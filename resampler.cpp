@@ -0,0 +1,639 @@
+#include "resampler.h"
+#include "simdsupport.h"
+#include "pixelformats.h"
+#include <QByteArray>
+#include <QVarLengthArray>
+#include <QVector>
+#include <QtMath>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const int WeightBits = 14;                      // 定點權重的小數位數，每組權重總和為 1 << 14
+const int WeightHalf = 1 << (WeightBits - 1);   // 右移前加上的捨入量
+const int BandHeight = 64;                      // 平行處理時每條帶的目的列數
+const int AlphaChannel64 = 6;                   // RGBA64 的 alpha 從第 6 個位元組開始
+
+// 一個方向的取樣表：目的座標 i 的結果為 sum(src[first[i] + k] * weights[i * taps + k])
+// 所有目的座標使用相同的 taps，不足的部分權重為 0，內層迴圈因此沒有分支
+struct WeightTable
+{
+    int taps = 0;
+    QVector<int> first;
+    QVector<qint16> weights;
+};
+
+/*------------------------------ 濾波核心 ------------------------------*/
+
+double sinc(double x)
+{
+    if (x == 0.0)
+        return 1.0;
+    x *= M_PI;
+    return std::sin(x) / x;
+}
+
+// 放大時的核心半徑（來源像素）；縮小時再乘上縮小倍率
+double filterRadius(Resampler::Filter filter)
+{
+    switch (filter)
+    {
+    case Resampler::Bilinear:
+        return 1.0;
+    case Resampler::Bicubic:
+        return 2.0;
+    case Resampler::Lanczos3:
+        return 3.0;
+    default:
+        return 0.5;
+    }
+}
+
+double filterValue(Resampler::Filter filter, double x)
+{
+    x = std::fabs(x);
+    switch (filter)
+    {
+    case Resampler::Bilinear:
+        return x < 1.0 ? 1.0 - x : 0.0;
+    case Resampler::Bicubic:
+    {
+        const double a = -0.5;
+        if (x < 1.0)
+            return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+        if (x < 2.0)
+            return (((x - 5.0) * x + 8.0) * x - 4.0) * a;
+        return 0.0;
+    }
+    case Resampler::Lanczos3:
+        return x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+    default:
+        return x < 0.5 ? 1.0 : 0.0;
+    }
+}
+
+bool hasNegativeLobes(Resampler::Filter filter)
+{
+    return filter == Resampler::Bicubic || filter == Resampler::Lanczos3;
+}
+
+// 把 srcLength 縮放到 dstLength，只建立 [dstFirst, dstFirst + count) 這段目的座標的表格。
+// 超出邊界的來源夾到邊緣像素，權重正規化後轉成定點數，捨入誤差補在最大的權重上
+WeightTable buildTable(Resampler::Filter filter, int srcLength, int dstLength, int dstFirst, int count)
+{
+    const double scale = double(dstLength) / srcLength;
+    const double filterScale = qMax(1.0, 1.0 / scale);     // 縮小時把核心拉寬，同時當作低通濾波
+    const double support = filterRadius(filter) * filterScale;
+    const int window = int(std::ceil(2.0 * support)) + 3;   // 單一目的座標最多用到的來源數
+
+    QVector<double> raw(qsizetype(count) * window, 0.0);
+    QVector<int> lows(count);
+    QVector<int> spans(count);
+    int taps = 1;
+
+    for (int i = 0; i < count; ++i)
+    {
+        const double lower = (dstFirst + i) / scale;        // 目的像素在來源上覆蓋的範圍
+        const double upper = (dstFirst + i + 1) / scale;
+        const double center = (lower + upper) * 0.5;
+        double *w = raw.data() + qsizetype(i) * window;
+
+        int from, to;
+        if (filter == Resampler::Nearest)
+        {
+            from = to = qBound(0, int(std::floor(center)), srcLength - 1);
+            w[0] = 1.0;
+        }
+        else if (filter == Resampler::Area)
+        {
+            const int jLow = int(std::floor(lower));
+            const int jHigh = qMax(jLow, int(std::ceil(upper)) - 1);
+            from = qBound(0, jLow, srcLength - 1);
+            to = qBound(0, jHigh, srcLength - 1);
+            for (int j = jLow; j <= jHigh; ++j)
+            {
+                const double coverage = qMin(upper, j + 1.0) - qMax(lower, double(j));
+                if (coverage > 0.0)
+                    w[qBound(0, j, srcLength - 1) - from] += coverage;
+            }
+        }
+        else
+        {
+            // 來源像素 j 的中心在 j + 0.5
+            const int jLow = int(std::floor(center - support - 0.5));
+            const int jHigh = int(std::ceil(center + support - 0.5));
+            from = qBound(0, jLow, srcLength - 1);
+            to = qBound(0, jHigh, srcLength - 1);
+            for (int j = jLow; j <= jHigh; ++j)
+                w[qBound(0, j, srcLength - 1) - from] += filterValue(filter, (j + 0.5 - center) / filterScale);
+        }
+
+        // 去掉兩端權重為 0 的來源，讓 taps 盡量小
+        while (to > from && w[to - from] == 0.0)
+            --to;
+        int skip = 0;
+        while (from + skip < to && w[skip] == 0.0)
+            ++skip;
+        if (skip > 0)
+        {
+            std::memmove(w, w + skip, sizeof(double) * (to - from - skip + 1));
+            from += skip;
+        }
+        lows[i] = from;
+        spans[i] = to - from + 1;
+        taps = qMax(taps, spans[i]);
+    }
+
+    WeightTable table;
+    table.taps = qMin(taps, srcLength);
+    table.first.resize(count);
+    table.weights.fill(0, qsizetype(count) * table.taps);
+
+    for (int i = 0; i < count; ++i)
+    {
+        const double *w = raw.constData() + qsizetype(i) * window;
+        double sum = 0.0;
+        for (int k = 0; k < spans[i]; ++k)
+            sum += w[k];
+        if (sum == 0.0)
+            sum = 1.0;
+
+        // 讓整組權重不超出來源範圍
+        const int first = qMin(lows[i], srcLength - table.taps);
+        const int offset = lows[i] - first;
+        qint16 *fixed = table.weights.data() + qsizetype(i) * table.taps + offset;
+        int total = 0;
+        int largest = 0;
+        for (int k = 0; k < spans[i]; ++k)
+        {
+            fixed[k] = qint16(qRound(w[k] / sum * (1 << WeightBits)));
+            total += fixed[k];
+            if (fixed[k] > fixed[largest])
+                largest = k;
+        }
+        fixed[largest] = qint16(fixed[largest] + (1 << WeightBits) - total);
+        table.first[i] = first;
+    }
+    return table;
+}
+
+/*------------------------------ 純量核心 ------------------------------*/
+
+inline uchar clampPixel(int sum)
+{
+    const int value = sum >> WeightBits;
+    return uchar(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+void horizontal32Scalar(const uchar *src, uchar *dst, const WeightTable &table)
+{
+    const int count = table.first.size();
+    const int taps = table.taps;
+    for (int i = 0; i < count; ++i)
+    {
+        const uchar *p = src + table.first[i] * 4;
+        const qint16 *w = table.weights.constData() + qsizetype(i) * taps;
+        int sum[4] = { WeightHalf, WeightHalf, WeightHalf, WeightHalf };
+        for (int k = 0; k < taps; ++k)
+            for (int c = 0; c < 4; ++c)
+                sum[c] += p[k * 4 + c] * w[k];
+        for (int c = 0; c < 4; ++c)
+            dst[i * 4 + c] = clampPixel(sum[c]);
+    }
+}
+
+void horizontal8Scalar(const uchar *src, uchar *dst, const WeightTable &table)
+{
+    const int count = table.first.size();
+    const int taps = table.taps;
+    for (int i = 0; i < count; ++i)
+    {
+        const uchar *p = src + table.first[i];
+        const qint16 *w = table.weights.constData() + qsizetype(i) * taps;
+        int sum = WeightHalf;
+        for (int k = 0; k < taps; ++k)
+            sum += p[k] * w[k];
+        dst[i] = clampPixel(sum);
+    }
+}
+
+// RGBA64：每個通道 16 位元，權重總和為 1 << 14，累加不會超出 32 位元
+inline quint16 clampPixel16(int sum)
+{
+    const int value = sum >> WeightBits;
+    return quint16(value < 0 ? 0 : (value > 65535 ? 65535 : value));
+}
+
+void horizontal64Scalar(const uchar *src, uchar *dst, const WeightTable &table)
+{
+    const quint16 *in = reinterpret_cast<const quint16 *>(src);
+    quint16 *out = reinterpret_cast<quint16 *>(dst);
+    const int count = table.first.size();
+    const int taps = table.taps;
+    for (int i = 0; i < count; ++i)
+    {
+        const quint16 *p = in + table.first[i] * 4;
+        const qint16 *w = table.weights.constData() + qsizetype(i) * taps;
+        int sum[4] = { WeightHalf, WeightHalf, WeightHalf, WeightHalf };
+        for (int k = 0; k < taps; ++k)
+            for (int c = 0; c < 4; ++c)
+                sum[c] += p[k * 4 + c] * w[k];
+        for (int c = 0; c < 4; ++c)
+            out[i * 4 + c] = clampPixel16(sum[c]);
+    }
+}
+
+// 垂直方向與通道無關：rows[k] 的第 x 個位元組乘上 weights[k]，處理 [begin, end) 的位元組
+void verticalScalar(const uchar *const *rows, const qint16 *weights, int taps, uchar *dst, int begin, int end)
+{
+    for (int x = begin; x < end; ++x)
+    {
+        int sum = WeightHalf;
+        for (int k = 0; k < taps; ++k)
+            sum += rows[k][x] * weights[k];
+        dst[x] = clampPixel(sum);
+    }
+}
+
+// 16 位元版：[begin, end) 為位元組範圍，兩個位元組一個通道
+void vertical16Scalar(const uchar *const *rows, const qint16 *weights, int taps, uchar *dst, int begin, int end)
+{
+    quint16 *out = reinterpret_cast<quint16 *>(dst);
+    for (int x = begin / 2; x < end / 2; ++x)
+    {
+        int sum = WeightHalf;
+        for (int k = 0; k < taps; ++k)
+            sum += reinterpret_cast<const quint16 *>(rows[k])[x] * weights[k];
+        out[x] = clampPixel16(sum);
+    }
+}
+
+// premultiplied 格式在負瓣核心下可能算出大於 alpha 的顏色，夾回合法範圍
+void clampToAlphaScalar(uchar *pixels, int count, int alphaByte)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        uchar *p = pixels + i * 4;
+        const uchar alpha = p[alphaByte];
+        for (int c = 0; c < 4; ++c)
+            if (c != alphaByte && p[c] > alpha)
+                p[c] = alpha;
+    }
+}
+
+// RGBA64_Premultiplied 的記憶體順序為 R, G, B, A
+void clampToAlpha64(uchar *pixels, int count)
+{
+    quint16 *p = reinterpret_cast<quint16 *>(pixels);
+    for (int i = 0; i < count; ++i, p += 4)
+        for (int c = 0; c < 3; ++c)
+            if (p[c] > p[3])
+                p[c] = p[3];
+}
+
+/*------------------------------ SSE2 / AVX2 核心 ------------------------------*/
+
+#if defined(IP_X86_SIMD)
+
+// pmaddwd 需要的 (w0, w1) 16 位元權重對
+inline int weightPair(qint16 w0, qint16 w1)
+{
+    return int(quint32(quint16(w0)) | (quint32(quint16(w1)) << 16));
+}
+
+inline int load32(const uchar *p)
+{
+    int value;
+    std::memcpy(&value, p, 4);
+    return value;
+}
+
+// 每次累加兩個來源像素：交錯成 (r0 r1 g0 g1 b0 b1 a0 a1) 後與 (w0 w1) 做 pmaddwd
+IP_TARGET("sse2")
+void horizontal32Sse2(const uchar *src, uchar *dst, const WeightTable &table)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi32(WeightHalf);
+    const int count = table.first.size();
+    const int taps = table.taps;
+    for (int i = 0; i < count; ++i)
+    {
+        const uchar *p = src + table.first[i] * 4;
+        const qint16 *w = table.weights.constData() + qsizetype(i) * taps;
+        __m128i sum = half;
+        int k = 0;
+        for (; k + 2 <= taps; k += 2)
+        {
+            const __m128i pair = _mm_unpacklo_epi8(_mm_cvtsi32_si128(load32(p + k * 4)),
+                                                   _mm_cvtsi32_si128(load32(p + k * 4 + 4)));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi8(pair, zero),
+                                                    _mm_set1_epi32(weightPair(w[k], w[k + 1]))));
+        }
+        if (k < taps)
+        {
+            const __m128i single = _mm_unpacklo_epi8(_mm_cvtsi32_si128(load32(p + k * 4)), zero);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi16(single, zero),
+                                                    _mm_set1_epi32(weightPair(w[k], 0))));
+        }
+        const __m128i packed = _mm_packs_epi32(_mm_srai_epi32(sum, WeightBits), zero);
+        const int pixel = _mm_cvtsi128_si32(_mm_packus_epi16(packed, zero));
+        std::memcpy(dst + i * 4, &pixel, 4);
+    }
+}
+
+// 一次處理 16 個位元組：相鄰兩列交錯後與 (wk, wk+1) 做 pmaddwd
+IP_TARGET("sse2")
+void verticalSse2(const uchar *const *rows, const qint16 *weights, int taps, uchar *dst, int begin, int end)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi32(WeightHalf);
+    int x = begin;
+    for (; x + 16 <= end; x += 16)
+    {
+        __m128i sum0 = half, sum1 = half, sum2 = half, sum3 = half;
+        for (int k = 0; k < taps; k += 2)
+        {
+            const bool pair = k + 1 < taps;
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[k] + x));
+            const __m128i b = pair ? _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[k + 1] + x)) : zero;
+            const __m128i w = _mm_set1_epi32(weightPair(weights[k], pair ? weights[k + 1] : 0));
+            const __m128i lo = _mm_unpacklo_epi8(a, b);
+            const __m128i hi = _mm_unpackhi_epi8(a, b);
+            sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), w));
+            sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), w));
+            sum2 = _mm_add_epi32(sum2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), w));
+            sum3 = _mm_add_epi32(sum3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), w));
+        }
+        const __m128i p0 = _mm_packs_epi32(_mm_srai_epi32(sum0, WeightBits), _mm_srai_epi32(sum1, WeightBits));
+        const __m128i p1 = _mm_packs_epi32(_mm_srai_epi32(sum2, WeightBits), _mm_srai_epi32(sum3, WeightBits));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), _mm_packus_epi16(p0, p1));
+    }
+    if (x < end)
+        verticalScalar(rows, weights, taps, dst, x, end);
+}
+
+// 與 SSE2 版相同的步驟，每個 128 位元通道各自處理 16 個位元組
+IP_TARGET("avx2")
+void verticalAvx2(const uchar *const *rows, const qint16 *weights, int taps, uchar *dst, int begin, int end)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i half = _mm256_set1_epi32(WeightHalf);
+    int x = begin;
+    for (; x + 32 <= end; x += 32)
+    {
+        __m256i sum0 = half, sum1 = half, sum2 = half, sum3 = half;
+        for (int k = 0; k < taps; k += 2)
+        {
+            const bool pair = k + 1 < taps;
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows[k] + x));
+            const __m256i b = pair ? _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows[k + 1] + x)) : zero;
+            const __m256i w = _mm256_set1_epi32(weightPair(weights[k], pair ? weights[k + 1] : 0));
+            const __m256i lo = _mm256_unpacklo_epi8(a, b);
+            const __m256i hi = _mm256_unpackhi_epi8(a, b);
+            sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, zero), w));
+            sum1 = _mm256_add_epi32(sum1, _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, zero), w));
+            sum2 = _mm256_add_epi32(sum2, _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, zero), w));
+            sum3 = _mm256_add_epi32(sum3, _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, zero), w));
+        }
+        const __m256i p0 = _mm256_packs_epi32(_mm256_srai_epi32(sum0, WeightBits), _mm256_srai_epi32(sum1, WeightBits));
+        const __m256i p1 = _mm256_packs_epi32(_mm256_srai_epi32(sum2, WeightBits), _mm256_srai_epi32(sum3, WeightBits));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x), _mm256_packus_epi16(p0, p1));
+    }
+    if (x < end)
+        verticalSse2(rows, weights, taps, dst, x, end);
+}
+
+// 16 位元通道沒有無號的 pmaddwd：先減去 32768 變成有號數再累加，
+// 因為每組權重總和固定為 1 << 14，最後加回 32768 << 14 即可
+const int Bias16 = 32768 << WeightBits;
+
+// 累加值右移後夾到 0..65535：先減 32768 以有號飽和打包，再翻轉最高位元
+IP_TARGET("sse2")
+inline __m128i packPixels16(__m128i lo, __m128i hi)
+{
+    const __m128i offset = _mm_set1_epi32(32768);
+    const __m128i packed = _mm_packs_epi32(_mm_sub_epi32(_mm_srai_epi32(lo, WeightBits), offset),
+                                           _mm_sub_epi32(_mm_srai_epi32(hi, WeightBits), offset));
+    return _mm_xor_si128(packed, _mm_set1_epi16(qint16(0x8000)));
+}
+
+// 每次累加兩個來源像素：交錯成 (r0 r1 g0 g1 b0 b1 a0 a1) 後與 (w0 w1) 做 pmaddwd
+IP_TARGET("sse2")
+void horizontal64Sse2(const uchar *src, uchar *dst, const WeightTable &table)
+{
+    const __m128i sign = _mm_set1_epi16(qint16(0x8000));
+    const __m128i start = _mm_set1_epi32(WeightHalf + Bias16);
+    const int count = table.first.size();
+    const int taps = table.taps;
+    for (int i = 0; i < count; ++i)
+    {
+        const uchar *p = src + table.first[i] * 8;
+        const qint16 *w = table.weights.constData() + qsizetype(i) * taps;
+        __m128i sum = start;
+        for (int k = 0; k < taps; k += 2)
+        {
+            const bool pair = k + 1 < taps;
+            const __m128i a = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p + k * 8));
+            const __m128i b = pair ? _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p + k * 8 + 8)) : a;
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_xor_si128(_mm_unpacklo_epi16(a, b), sign),
+                                                    _mm_set1_epi32(weightPair(w[k], pair ? w[k + 1] : 0))));
+        }
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i * 8), packPixels16(sum, sum));
+    }
+}
+
+// 一次處理 8 個通道（16 個位元組），相鄰兩列交錯後與 (wk, wk+1) 做 pmaddwd
+IP_TARGET("sse2")
+void vertical16Sse2(const uchar *const *rows, const qint16 *weights, int taps, uchar *dst, int begin, int end)
+{
+    const __m128i sign = _mm_set1_epi16(qint16(0x8000));
+    const __m128i start = _mm_set1_epi32(WeightHalf + Bias16);
+    int x = begin;
+    for (; x + 16 <= end; x += 16)
+    {
+        __m128i lo = start, hi = start;
+        for (int k = 0; k < taps; k += 2)
+        {
+            const bool pair = k + 1 < taps;
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[k] + x));
+            const __m128i b = pair ? _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[k + 1] + x)) : a;
+            const __m128i w = _mm_set1_epi32(weightPair(weights[k], pair ? weights[k + 1] : 0));
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_xor_si128(_mm_unpacklo_epi16(a, b), sign), w));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_xor_si128(_mm_unpackhi_epi16(a, b), sign), w));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), packPixels16(lo, hi));
+    }
+    if (x < end)
+        vertical16Scalar(rows, weights, taps, dst, x, end);
+}
+
+// alpha 在每個像素的第 4 個位元組：把 alpha 複製到四個位元組後取逐位元組最小值
+IP_TARGET("sse2")
+void clampToAlphaSse2(uchar *pixels, int count)
+{
+    const __m128i alphaMask = _mm_set1_epi32(int(0xff000000u));
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i *p = reinterpret_cast<__m128i *>(pixels + i * 4);
+        const __m128i v = _mm_loadu_si128(p);
+        __m128i alpha = _mm_and_si128(v, alphaMask);
+        alpha = _mm_or_si128(alpha, _mm_srli_epi32(alpha, 8));
+        alpha = _mm_or_si128(alpha, _mm_srli_epi32(alpha, 16));
+        _mm_storeu_si128(p, _mm_min_epu8(v, alpha));
+    }
+    if (i < count)
+        clampToAlphaScalar(pixels + i * 4, count - i, 3);
+}
+
+#endif // IP_X86_SIMD
+
+typedef void (*HorizontalKernel)(const uchar *src, uchar *dst, const WeightTable &table);
+typedef void (*VerticalKernel)(const uchar *const *rows, const qint16 *weights, int taps,
+                               uchar *dst, int begin, int end);
+
+HorizontalKernel selectHorizontal(int bytesPerPixel)
+{
+    if (bytesPerPixel == 1)
+        return horizontal8Scalar;
+    if (bytesPerPixel == 8)
+#if defined(IP_X86_SIMD)
+        return horizontal64Sse2;
+#else
+        return horizontal64Scalar;
+#endif
+#if defined(IP_X86_SIMD)
+    return horizontal32Sse2;
+#else
+    return horizontal32Scalar;
+#endif
+}
+
+VerticalKernel selectVertical(int bytesPerPixel)
+{
+    if (bytesPerPixel == 8)
+#if defined(IP_X86_SIMD)
+        return vertical16Sse2;
+#else
+        return vertical16Scalar;
+#endif
+#if defined(IP_X86_SIMD)
+    return Simd::hasAvx2() ? verticalAvx2 : verticalSse2;
+#else
+    return verticalScalar;
+#endif
+}
+
+void clampToAlpha(uchar *pixels, int count, int alphaByte)
+{
+    if (alphaByte == AlphaChannel64)
+    {
+        clampToAlpha64(pixels, count);
+        return;
+    }
+#if defined(IP_X86_SIMD)
+    if (alphaByte == 3)
+    {
+        clampToAlphaSse2(pixels, count);
+        return;
+    }
+#endif
+    clampToAlphaScalar(pixels, count, alphaByte);
+}
+
+// 可以直接處理的格式：正規格式（含 16 位元的 RGBA64）與另外兩種 8 位元 RGBA 排列；
+// 其餘先轉成 8 位元，正規化過的影像不會走到這一步
+bool isDirectFormat(QImage::Format format)
+{
+    if (PixelFormats::dispatch(format, [](auto) {}))
+        return true;
+    return format == QImage::Format_RGBX8888 || format == QImage::Format_RGBA8888_Premultiplied;
+}
+
+int bytesPerPixelOf(QImage::Format format)
+{
+    int bytes = 4;
+    PixelFormats::dispatch(format, [&](auto traits) { bytes = decltype(traits)::bytesPerPixel; });
+    return bytes;
+}
+
+// premultiplied 格式中 alpha 所在的位元組；RGBA64 回傳 AlphaChannel64，沒有 alpha 時回傳 -1
+int premultipliedAlphaByte(QImage::Format format)
+{
+    if (format == PixelFormats::Rgba64Pm::format)
+        return AlphaChannel64;
+    if (format == QImage::Format_RGBA8888_Premultiplied)
+        return 3;
+    if (format == QImage::Format_ARGB32_Premultiplied)
+        return Q_BYTE_ORDER == Q_LITTLE_ENDIAN ? 3 : 0;
+    return -1;
+}
+
+}
+
+QImage Resampler::scaled(const QImage &src, const QSize &size, Filter filter,
+                         const Parallel::CancelCheck &isCancelled)
+{
+    return scaledRegion(src, size, QRect(QPoint(0, 0), size), filter, isCancelled);
+}
+
+QImage Resampler::scaledRegion(const QImage &src, const QSize &size, const QRect &region, Filter filter,
+                               const Parallel::CancelCheck &isCancelled)
+{
+    const QRect area = region.intersected(QRect(QPoint(0, 0), size));
+    if (src.isNull() || area.isEmpty())
+        return QImage();
+
+    const QImage source = isDirectFormat(src.format())
+                              ? src
+                              : src.convertToFormat(src.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied
+                                                                          : QImage::Format_RGB32);
+    const int bytesPerPixel = bytesPerPixelOf(source.format());
+
+    const WeightTable columns = buildTable(filter, source.width(), size.width(), area.left(), area.width());
+    const WeightTable rows = buildTable(filter, source.height(), size.height(), area.top(), area.height());
+
+    QImage dst(area.size(), source.format());
+    if (dst.isNull())
+        return QImage();
+
+    const HorizontalKernel horizontal = selectHorizontal(bytesPerPixel);
+    const VerticalKernel vertical = selectVertical(bytesPerPixel);
+    const int alphaByte = hasNegativeLobes(filter) ? premultipliedAlphaByte(source.format()) : -1;
+
+    const uchar *srcBits = source.constBits();
+    const qsizetype srcBpl = source.bytesPerLine();
+    uchar *dstBits = dst.bits();
+    const qsizetype dstBpl = dst.bytesPerLine();
+    const int rowBytes = area.width() * bytesPerPixel;
+
+    const bool done = Parallel::forEachBand(area.height(), BandHeight, [&](int firstRow, int lastRow) {
+        // 先把這條帶用到的來源列做水平縮放，放在帶自己的暫存區
+        const int srcFirst = rows.first[firstRow];
+        const int srcLast = rows.first[lastRow - 1] + rows.taps;
+        QByteArray buffer(qsizetype(srcLast - srcFirst) * rowBytes, Qt::Uninitialized);
+        uchar *bufferBits = reinterpret_cast<uchar *>(buffer.data());
+        for (int y = srcFirst; y < srcLast; ++y)
+            horizontal(srcBits + y * srcBpl, bufferBits + qsizetype(y - srcFirst) * rowBytes, columns);
+
+        QVarLengthArray<const uchar *, 64> taps(rows.taps);
+        for (int y = firstRow; y < lastRow; ++y)
+        {
+            const int base = rows.first[y] - srcFirst;
+            for (int k = 0; k < rows.taps; ++k)
+                taps[k] = bufferBits + qsizetype(base + k) * rowBytes;
+            uchar *out = dstBits + y * dstBpl;
+            vertical(taps.constData(), rows.weights.constData() + qsizetype(y) * rows.taps, rows.taps,
+                     out, 0, rowBytes);
+            if (alphaByte >= 0)
+                clampToAlpha(out, area.width(), alphaByte);
+        }
+    }, isCancelled);
+    return done ? dst : QImage();
+}
+
+Resampler::Filter Resampler::defaultFilter(const QSize &from, const QSize &to)
+{
+    return to.width() < from.width() && to.height() < from.height() ? Area : Bicubic;
+}
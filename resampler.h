@@ -0,0 +1,39 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <QImage>
+#include <QRect>
+#include "parallelfor.h"
+
+// 可分離的重新取樣器：取代 QImage::scaled 的平滑縮放路徑
+// 先水平後垂直兩趟，每個目的列/欄的來源範圍與權重事先算成 14 位元定點數表格；
+// 內層迴圈以 SSE2/AVX2 的 pmaddwd 一次累加兩個來源，輸出分成列帶平行處理。
+// 正規格式（Grayscale8、RGB32、ARGB32_Premultiplied、16 位元的 RGBA64_Premultiplied）
+// 與 RGBX8888/RGBA8888_Premultiplied 直接處理，結果保持來源格式；其餘格式先轉成 ARGB32_Premultiplied 或 RGB32。
+// 分塊呼叫時每次只讀取這一塊用到的來源，不會轉換整張來源
+class Resampler
+{
+public:
+    enum Filter
+    {
+        Nearest,    // 最近鄰
+        Bilinear,   // 三角形核心，縮小時會拉寬成低通濾波
+        Bicubic,    // Keys 三次卷積（a = -0.5）
+        Lanczos3,   // 三瓣 Lanczos，最銳利但可能有輕微振鈴
+        Area        // 面積平均：每個目的像素為其覆蓋範圍內來源像素的加權平均，適合縮小
+    };
+
+    // 縮放整張影像到 size（不保持比例）；被取消時回傳空影像
+    static QImage scaled(const QImage &src, const QSize &size, Filter filter,
+                         const Parallel::CancelCheck &isCancelled = Parallel::CancelCheck());
+
+    // 只產生「縮放到 size 後」的 region 範圍，結果大小為 region.size()；
+    // 同一張影像分塊取得的結果與整張縮放後再裁切逐像素相同
+    static QImage scaledRegion(const QImage &src, const QSize &size, const QRect &region, Filter filter,
+                               const Parallel::CancelCheck &isCancelled = Parallel::CancelCheck());
+
+    // 兩個方向都縮小時用 Area，否則用 Bicubic
+    static Filter defaultFilter(const QSize &from, const QSize &to);
+};
+
+#endif // RESAMPLER_H
@@ -0,0 +1,595 @@
+#include "rowdecoder.h"
+#include "tracer.h"
+#include <QFile>
+#include <QVector>
+#include <climits>
+#include <csetjmp>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <png.h>
+#include <tiffio.h>
+#include <jpeglib.h>
+#include <jerror.h>
+
+namespace {
+
+const qint64 MaxChunkBytes = qint64(256) << 20;    // TIFF 一個條帶或一列區塊展開後的上限
+
+QString outOfMemory()
+{
+    return QStringLiteral("記憶體不足");
+}
+
+// libpng 的錯誤以 longjmp 回到 setjmp 的位置，呼叫 libpng 的函式裡不放需要解構的區域變數
+class PngRowDecoder : public RowDecoder
+{
+public:
+    PngRowDecoder() : png(nullptr), info(nullptr), rowFormat(QImage::Format_Invalid) {}
+    ~PngRowDecoder() override
+    {
+        if (png)
+            png_destroy_read_struct(&png, info ? &info : nullptr, nullptr);
+    }
+
+    bool open(const QString &path);
+    QImage readRows(int count) override;
+
+private:
+    static void readData(png_structp png, png_bytep data, png_size_t length);
+    static void raiseError(png_structp png, png_const_charp message);
+    static void ignoreWarning(png_structp, png_const_charp) {}
+
+    QFile file;
+    png_structp png;
+    png_infop info;
+    QImage::Format rowFormat;       // readRows 回傳的排列
+};
+
+void PngRowDecoder::readData(png_structp png, png_bytep data, png_size_t length)
+{
+    PngRowDecoder *decoder = static_cast<PngRowDecoder *>(png_get_io_ptr(png));
+    if (decoder->file.read(reinterpret_cast<char *>(data), qint64(length)) != qint64(length))
+        png_error(png, "unexpected end of file");
+}
+
+void PngRowDecoder::raiseError(png_structp png, png_const_charp message)
+{
+    static_cast<PngRowDecoder *>(png_get_error_ptr(png))->error = QString::fromLatin1(message);
+    png_longjmp(png, 1);
+}
+
+bool PngRowDecoder::open(const QString &path)
+{
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        error = file.errorString();
+        return false;
+    }
+    png = png_create_read_struct(PNG_LIBPNG_VER_STRING, this, raiseError, ignoreWarning);
+    if (png)
+        info = png_create_info_struct(png);
+    if (!info)
+    {
+        error = outOfMemory();
+        return false;
+    }
+    png_set_read_fn(png, this, readData);
+    // 拼接影像常超過 libpng 預設的 100 萬像素寬高上限
+    png_set_user_limits(png, PNG_UINT_31_MAX, PNG_UINT_31_MAX);
+    if (setjmp(png_jmpbuf(png)))
+        return false;
+
+    png_read_info(png, info);
+    png_uint_32 width = 0;
+    png_uint_32 height = 0;
+    int bitDepth = 0;
+    int colorType = 0;
+    int interlace = 0;
+    png_get_IHDR(png, info, &width, &height, &bitDepth, &colorType, &interlace, nullptr, nullptr);
+    if (interlace != PNG_INTERLACE_NONE)
+    {
+        error = QStringLiteral("交錯式 PNG 必須整張解碼，無法逐列轉換");
+        return false;
+    }
+
+    // 調色盤轉 RGB、低位元灰階轉 8 位元、tRNS 轉成 alpha 通道；分塊檔每通道只存 8 位元
+    const bool alpha = (colorType & PNG_COLOR_MASK_ALPHA) || png_get_valid(png, info, PNG_INFO_tRNS);
+    png_set_expand(png);
+    png_set_strip_16(png);
+    if (!(colorType & PNG_COLOR_MASK_COLOR) && !alpha)
+    {
+        rowFormat = QImage::Format_Grayscale8;
+    }
+    else
+    {
+        if (!(colorType & PNG_COLOR_MASK_COLOR))
+            png_set_gray_to_rgb(png);
+        // 排成與 QImage 32 位元格式相同的 0xAARRGGBB
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        png_set_bgr(png);
+        if (!alpha)
+            png_set_filler(png, 0xff, PNG_FILLER_AFTER);
+#else
+        if (alpha)
+            png_set_swap_alpha(png);
+        else
+            png_set_filler(png, 0xff, PNG_FILLER_BEFORE);
+#endif
+        rowFormat = alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32;
+    }
+    png_read_update_info(png, info);
+    if (png_get_rowbytes(png, info) != png_size_t(width) * (rowFormat == QImage::Format_Grayscale8 ? 1 : 4))
+    {
+        error = QStringLiteral("不支援的 PNG 像素格式");
+        return false;
+    }
+    imageSize = QSize(int(width), int(height));
+    imageFormat = rowFormat;
+    return true;
+}
+
+QImage PngRowDecoder::readRows(int count)
+{
+    if (count <= 0 || nextRow + count > imageSize.height())
+        return QImage();
+    QImage band(imageSize.width(), count, rowFormat);
+    if (band.isNull())
+    {
+        error = outOfMemory();
+        return QImage();
+    }
+    if (setjmp(png_jmpbuf(png)))
+        return QImage();
+    for (int y = 0; y < count; ++y)
+        png_read_row(png, band.scanLine(y), nullptr);
+    nextRow += count;
+    return band;
+}
+
+// 從 QFile 分段讀取的資料來源，檔案不必整個映射或讀進記憶體
+struct JpegSource
+{
+    jpeg_source_mgr manager;
+    QFile *file;
+    JOCTET buffer[64 * 1024];
+};
+
+struct JpegErrors
+{
+    jpeg_error_mgr manager;
+    std::jmp_buf jump;
+};
+
+class JpegRowDecoder : public RowDecoder
+{
+public:
+    JpegRowDecoder() : created(false), rowFormat(QImage::Format_Invalid) {}
+    ~JpegRowDecoder() override
+    {
+        if (created)
+            jpeg_destroy_decompress(&decoder);
+    }
+
+    bool open(const QString &path);
+    QImage readRows(int count) override;
+
+private:
+    static void initSource(j_decompress_ptr) {}
+    static boolean fillInputBuffer(j_decompress_ptr info);
+    static void skipInputData(j_decompress_ptr info, long count);
+    static void termSource(j_decompress_ptr) {}
+    static void raiseError(j_common_ptr info);
+    static void ignoreMessage(j_common_ptr) {}
+    void storeError();
+
+    QFile file;
+    jpeg_decompress_struct decoder;
+    JpegErrors errors;
+    JpegSource source;
+    bool created;
+    QImage::Format rowFormat;
+};
+
+boolean JpegRowDecoder::fillInputBuffer(j_decompress_ptr info)
+{
+    JpegSource *source = reinterpret_cast<JpegSource *>(info->src);
+    const qint64 count = source->file->read(reinterpret_cast<char *>(source->buffer), sizeof(source->buffer));
+    // 檔案提前結束視為錯誤，不像 libjpeg 內建的來源補上 EOI 後以灰色填滿剩下的列
+    if (count <= 0)
+        ERREXIT(info, JERR_INPUT_EOF);
+    source->manager.next_input_byte = source->buffer;
+    source->manager.bytes_in_buffer = size_t(count);
+    return TRUE;
+}
+
+void JpegRowDecoder::skipInputData(j_decompress_ptr info, long count)
+{
+    if (count <= 0)
+        return;
+    jpeg_source_mgr *manager = info->src;
+    while (count > long(manager->bytes_in_buffer))
+    {
+        count -= long(manager->bytes_in_buffer);
+        fillInputBuffer(info);
+    }
+    manager->next_input_byte += count;
+    manager->bytes_in_buffer -= size_t(count);
+}
+
+void JpegRowDecoder::raiseError(j_common_ptr info)
+{
+    std::longjmp(reinterpret_cast<JpegErrors *>(info->err)->jump, 1);
+}
+
+void JpegRowDecoder::storeError()
+{
+    char message[JMSG_LENGTH_MAX];
+    (*errors.manager.format_message)(reinterpret_cast<j_common_ptr>(&decoder), message);
+    error = QString::fromLatin1(message);
+}
+
+bool JpegRowDecoder::open(const QString &path)
+{
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        error = file.errorString();
+        return false;
+    }
+    decoder.err = jpeg_std_error(&errors.manager);
+    errors.manager.error_exit = raiseError;
+    errors.manager.output_message = ignoreMessage;
+    if (setjmp(errors.jump))
+    {
+        storeError();
+        return false;
+    }
+    jpeg_create_decompress(&decoder);
+    created = true;
+
+    source.file = &file;
+    source.manager.init_source = initSource;
+    source.manager.fill_input_buffer = fillInputBuffer;
+    source.manager.skip_input_data = skipInputData;
+    source.manager.resync_to_restart = jpeg_resync_to_restart;
+    source.manager.term_source = termSource;
+    source.manager.next_input_byte = nullptr;
+    source.manager.bytes_in_buffer = 0;
+    decoder.src = &source.manager;
+
+    jpeg_read_header(&decoder, TRUE);
+    if (decoder.jpeg_color_space == JCS_CMYK || decoder.jpeg_color_space == JCS_YCCK)
+    {
+        error = QStringLiteral("CMYK JPEG 無法逐列轉換");
+        return false;
+    }
+    // 漸進式 JPEG 要等所有掃描都讀完才能輸出第一列，解碼器會保留整張的 DCT 係數
+    if (decoder.progressive_mode)
+    {
+        error = QStringLiteral("漸進式 JPEG 必須整張解碼，無法逐列轉換");
+        return false;
+    }
+    const bool gray = decoder.jpeg_color_space == JCS_GRAYSCALE;
+    decoder.out_color_space = gray ? JCS_GRAYSCALE : JCS_RGB;
+    jpeg_start_decompress(&decoder);
+    rowFormat = gray ? QImage::Format_Grayscale8 : QImage::Format_RGB888;
+    imageFormat = gray ? QImage::Format_Grayscale8 : QImage::Format_RGB32;
+    imageSize = QSize(int(decoder.output_width), int(decoder.output_height));
+    return true;
+}
+
+QImage JpegRowDecoder::readRows(int count)
+{
+    if (count <= 0 || nextRow + count > imageSize.height())
+        return QImage();
+    QImage band(imageSize.width(), count, rowFormat);
+    if (band.isNull())
+    {
+        error = outOfMemory();
+        return QImage();
+    }
+    if (setjmp(errors.jump))
+    {
+        storeError();
+        return QImage();
+    }
+    for (int y = 0; y < count; ++y)
+    {
+        JSAMPROW row = band.scanLine(y);
+        jpeg_read_scanlines(&decoder, &row, 1);
+    }
+    nextRow += count;
+    return band;
+}
+
+// libtiff 的錯誤處理函式是整個程式共用的，批次轉檔會在多個執行緒同時解碼，訊息存在各自的執行緒
+thread_local QString tiffError;
+
+void storeTiffError(const char *, const char *format, va_list args)
+{
+    char message[1024];
+    std::vsnprintf(message, sizeof(message), format, args);
+    tiffError = QString::fromLocal8Bit(message);
+}
+
+// 以 libtiff 的 RGBA 介面逐個條帶或逐列區塊解碼，各種位元深度、色彩空間與壓縮都轉成 8 位元預乘 RGBA
+class TiffRowDecoder : public RowDecoder
+{
+public:
+    TiffRowDecoder() : tiff(nullptr), tiled(false), tileWidth(0), chunkHeight(0), chunkTop(0) {}
+    ~TiffRowDecoder() override
+    {
+        if (tiff)
+            TIFFClose(tiff);
+    }
+
+    bool open(const QString &path);
+    QImage readRows(int count) override;
+
+private:
+    bool decodeChunk();             // 解出從 chunkTop 開始的下一個條帶或一列區塊
+    QString lastError(const QString &fallback) const;
+
+    TIFF *tiff;
+    bool tiled;
+    int tileWidth;
+    int chunkHeight;                // 每個條帶的列數或區塊的高度
+    int chunkTop;                   // chunk 第一列的影像座標
+    QVector<quint32> raster;        // libtiff 輸出的 RGBA，原點在左下角
+    QImage chunk;                   // 目前解出的條帶或一列區塊，由上而下
+};
+
+QString TiffRowDecoder::lastError(const QString &fallback) const
+{
+    return tiffError.isEmpty() ? fallback : tiffError;
+}
+
+bool TiffRowDecoder::open(const QString &path)
+{
+    static const bool handlersInstalled = []() {
+        TIFFSetErrorHandler(storeTiffError);
+        TIFFSetWarningHandler(nullptr);
+        return true;
+    }();
+    Q_UNUSED(handlersInstalled);
+    tiffError.clear();
+
+#ifdef Q_OS_WIN
+    tiff = TIFFOpenW(reinterpret_cast<const wchar_t *>(path.utf16()), "r");
+#else
+    tiff = TIFFOpen(QFile::encodeName(path).constData(), "r");
+#endif
+    if (!tiff)
+    {
+        error = lastError(QStringLiteral("無法開啟 TIFF"));
+        return false;
+    }
+    char message[1024];
+    if (!TIFFRGBAImageOK(tiff, message))
+    {
+        error = QString::fromLocal8Bit(message);
+        return false;
+    }
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
+    if (width == 0 || height == 0 || width > INT_MAX || height > INT_MAX)
+    {
+        error = QStringLiteral("TIFF 影像大小無效");
+        return false;
+    }
+
+    uint16_t samples = 1;
+    uint16_t photometric = PHOTOMETRIC_MINISBLACK;
+    uint16_t extraCount = 0;
+    uint16_t *extra = nullptr;
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &samples);
+    TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &photometric);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_EXTRASAMPLES, &extraCount, &extra);
+    const bool alpha = extraCount > 0 &&
+                       (extra[0] == EXTRASAMPLE_ASSOCALPHA || extra[0] == EXTRASAMPLE_UNASSALPHA);
+    const bool gray = samples - extraCount == 1 && !alpha &&
+                      (photometric == PHOTOMETRIC_MINISBLACK || photometric == PHOTOMETRIC_MINISWHITE);
+
+    tiled = TIFFIsTiled(tiff);
+    qint64 rasterPixels = 0;
+    if (tiled)
+    {
+        uint32_t tw = 0;
+        uint32_t th = 0;
+        TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &tw);
+        TIFFGetField(tiff, TIFFTAG_TILELENGTH, &th);
+        if (tw == 0 || th == 0 || qint64(tw) * th * 4 > MaxChunkBytes)
+        {
+            error = QStringLiteral("TIFF 區塊大小無效");
+            return false;
+        }
+        tileWidth = int(tw);
+        chunkHeight = int(th);
+        rasterPixels = qint64(tw) * th;
+    }
+    else
+    {
+        uint32_t rowsPerStrip = height;
+        TIFFGetFieldDefaulted(tiff, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+        chunkHeight = int(qMin(qMax<uint32_t>(rowsPerStrip, 1), height));
+        rasterPixels = qint64(width) * chunkHeight;
+    }
+    // 整張存成一個條帶的檔案無法分段解碼
+    if (qint64(width) * qMin<qint64>(chunkHeight, height) * 4 > MaxChunkBytes)
+    {
+        error = QStringLiteral("TIFF 的條帶太大（每條 %1 列），無法逐段轉換").arg(chunkHeight);
+        return false;
+    }
+    raster.resize(int(rasterPixels));
+    imageSize = QSize(int(width), int(height));
+    imageFormat = gray ? QImage::Format_Grayscale8
+                       : (alpha ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+    return true;
+}
+
+bool TiffRowDecoder::decodeChunk()
+{
+    const int rows = qMin(chunkHeight, imageSize.height() - chunkTop);
+    chunk = QImage(imageSize.width(), rows, QImage::Format_ARGB32_Premultiplied);
+    if (chunk.isNull())
+    {
+        error = outOfMemory();
+        return false;
+    }
+
+    // RGBA 介面的輸出原點在左下角：條帶的第 r 列在 raster 倒數第 r + 1 列，
+    // 區塊的第 r 列在整個區塊高度的倒數第 r + 1 列（邊緣區塊也一樣）
+    if (tiled)
+    {
+        for (int x = 0; x < imageSize.width(); x += tileWidth)
+        {
+            if (!TIFFReadRGBATile(tiff, uint32_t(x), uint32_t(chunkTop), raster.data()))
+            {
+                error = lastError(QStringLiteral("TIFF 區塊解碼失敗"));
+                return false;
+            }
+            const int columns = qMin(tileWidth, imageSize.width() - x);
+            for (int r = 0; r < rows; ++r)
+            {
+                const quint32 *src = raster.constData() + qint64(chunkHeight - 1 - r) * tileWidth;
+                QRgb *dst = reinterpret_cast<QRgb *>(chunk.scanLine(r)) + x;
+                for (int i = 0; i < columns; ++i)
+                    dst[i] = qRgba(TIFFGetR(src[i]), TIFFGetG(src[i]), TIFFGetB(src[i]), TIFFGetA(src[i]));
+            }
+        }
+    }
+    else
+    {
+        if (!TIFFReadRGBAStrip(tiff, uint32_t(chunkTop), raster.data()))
+        {
+            error = lastError(QStringLiteral("TIFF 條帶解碼失敗"));
+            return false;
+        }
+        for (int r = 0; r < rows; ++r)
+        {
+            const quint32 *src = raster.constData() + qint64(rows - 1 - r) * imageSize.width();
+            QRgb *dst = reinterpret_cast<QRgb *>(chunk.scanLine(r));
+            for (int i = 0; i < imageSize.width(); ++i)
+                dst[i] = qRgba(TIFFGetR(src[i]), TIFFGetG(src[i]), TIFFGetB(src[i]), TIFFGetA(src[i]));
+        }
+    }
+    return true;
+}
+
+QImage TiffRowDecoder::readRows(int count)
+{
+    if (count <= 0 || nextRow + count > imageSize.height())
+        return QImage();
+    QImage band(imageSize.width(), count, QImage::Format_ARGB32_Premultiplied);
+    if (band.isNull())
+    {
+        error = outOfMemory();
+        return QImage();
+    }
+    tiffError.clear();
+    for (int y = 0; y < count; ++y, ++nextRow)
+    {
+        // 條帶或區塊列用完了才解下一個，每個只解一次
+        if (chunk.isNull() || nextRow >= chunkTop + chunk.height())
+        {
+            chunkTop = chunk.isNull() ? 0 : chunkTop + chunk.height();
+            if (!decodeChunk())
+                return QImage();
+        }
+        std::memcpy(band.scanLine(y), chunk.constScanLine(nextRow - chunkTop), size_t(imageSize.width()) * 4);
+    }
+    return band;
+}
+
+enum class Container { Unknown, Png, Tiff, Jpeg };
+
+// 依檔頭判斷容器格式，不看副檔名
+Container containerOf(const QString &path)
+{
+    QFile probe(path);
+    if (!probe.open(QIODevice::ReadOnly))
+        return Container::Unknown;
+    const QByteArray head = probe.read(8);
+    if (head.startsWith("\x89PNG\r\n\x1a\n"))
+        return Container::Png;
+    // 一般 TIFF 與 BigTIFF，兩種位元組順序
+    if (head.startsWith(QByteArray("II*\0", 4)) || head.startsWith(QByteArray("MM\0*", 4)) ||
+        head.startsWith(QByteArray("II+\0", 4)) || head.startsWith(QByteArray("MM\0+", 4)))
+        return Container::Tiff;
+    if (head.startsWith("\xff\xd8\xff"))
+        return Container::Jpeg;
+    return Container::Unknown;
+}
+
+}
+
+RowDecoder::RowDecoder()
+    : imageFormat(QImage::Format_Invalid), nextRow(0)
+{
+}
+
+RowDecoder::~RowDecoder()
+{
+}
+
+std::unique_ptr<RowDecoder> RowDecoder::open(const QString &path, QString *error)
+{
+    TRACE_SCOPE("RowDecoder::open");
+    std::unique_ptr<RowDecoder> decoder;
+    bool ok = false;
+    switch (containerOf(path))
+    {
+    case Container::Png:
+    {
+        PngRowDecoder *png = new PngRowDecoder;
+        decoder.reset(png);
+        ok = png->open(path);
+        break;
+    }
+    case Container::Tiff:
+    {
+        TiffRowDecoder *tiff = new TiffRowDecoder;
+        decoder.reset(tiff);
+        ok = tiff->open(path);
+        break;
+    }
+    case Container::Jpeg:
+    {
+        JpegRowDecoder *jpeg = new JpegRowDecoder;
+        decoder.reset(jpeg);
+        ok = jpeg->open(path);
+        break;
+    }
+    case Container::Unknown:
+        if (error)
+            *error = QStringLiteral("只有 PNG、TIFF 與 JPEG 能逐列轉換");
+        return nullptr;
+    }
+    if (!ok)
+    {
+        if (error)
+            *error = decoder->errorString();
+        return nullptr;
+    }
+    return decoder;
+}
+
+QSize RowDecoder::size() const
+{
+    return imageSize;
+}
+
+QImage::Format RowDecoder::format() const
+{
+    return imageFormat;
+}
+
+QString RowDecoder::errorString() const
+{
+    return error;
+}
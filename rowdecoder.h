@@ -0,0 +1,38 @@
+#ifndef ROWDECODER_H
+#define ROWDECODER_H
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include <memory>
+
+// 由上而下逐列解碼影像檔，供轉成分塊檔時處理放不進記憶體的拼接影像。
+// 整個檔案只依序解碼一次，記憶體只需要目前這段列（TIFF 另加一個條帶或一列區塊）。
+//
+// PNG 以 libpng（不支援交錯式）、TIFF 以 libtiff（條帶或區塊皆可）、JPEG 以 libjpeg 解碼；
+// 其他格式無法逐列解碼，open 直接失敗，不退回整張讀取
+class RowDecoder
+{
+public:
+    virtual ~RowDecoder();
+
+    // 依檔頭選擇解碼器，失敗時回傳空指標並設定 error
+    static std::unique_ptr<RowDecoder> open(const QString &path, QString *error = nullptr);
+
+    QSize size() const;
+    QImage::Format format() const;  // 內容是灰階、不透明或含透明度；readRows 的結果可能是另一種排列
+    QString errorString() const;
+
+    // 接著解出 count 列，失敗或超出影像範圍時回傳空影像
+    virtual QImage readRows(int count) = 0;
+
+protected:
+    RowDecoder();
+
+    QSize imageSize;
+    QImage::Format imageFormat;
+    int nextRow;                    // 下一個要解出的列
+    QString error;
+};
+
+#endif // ROWDECODER_H
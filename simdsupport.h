@@ -0,0 +1,76 @@
+#ifndef SIMDSUPPORT_H
+#define SIMDSUPPORT_H
+
+// SIMD 支援：編譯期判斷平台、執行期偵測 CPU 指令集
+// 各運算核心以 IP_TARGET("avx2") 等屬性編譯單一函式，
+// 再依 Simd::hasAvx2() 等結果在執行期挑選實作，不需改動整個專案的編譯旗標
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#  define IP_X86_SIMD 1
+#  include <immintrin.h>
+#  if defined(_MSC_VER) && !defined(__clang__)
+#    include <intrin.h>
+#  endif
+#endif
+
+#if defined(IP_X86_SIMD) && (defined(__GNUC__) || defined(__clang__))
+#  define IP_TARGET(features) __attribute__((target(features)))
+#else
+#  define IP_TARGET(features)
+#endif
+
+namespace Simd {
+
+#if defined(IP_X86_SIMD)
+namespace Detail {
+
+struct CpuFeatures
+{
+    bool ssse3 = false;
+    bool sse41 = false;
+    bool avx2 = false;
+
+    CpuFeatures()
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_cpu_init();
+        ssse3 = __builtin_cpu_supports("ssse3");
+        sse41 = __builtin_cpu_supports("sse4.1");
+        avx2 = __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        const int maxLeaf = info[0];
+        __cpuid(info, 1);
+        ssse3 = (info[2] & (1 << 9)) != 0;
+        sse41 = (info[2] & (1 << 19)) != 0;
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        if (maxLeaf >= 7 && osxsave && (_xgetbv(0) & 0x6) == 0x6)
+        {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+#endif
+    }
+};
+
+inline const CpuFeatures &cpuFeatures()
+{
+    static const CpuFeatures features;
+    return features;
+}
+
+}
+
+inline bool hasSsse3() { return Detail::cpuFeatures().ssse3; }
+inline bool hasSse41() { return Detail::cpuFeatures().sse41; }
+inline bool hasAvx2()  { return Detail::cpuFeatures().avx2; }
+#else
+inline bool hasSsse3() { return false; }
+inline bool hasSse41() { return false; }
+inline bool hasAvx2()  { return false; }
+#endif
+
+}
+
+#endif // SIMDSUPPORT_H
@@ -0,0 +1,103 @@
+#include "sparselayer.h"
+
+SparseLayer::SparseLayer()
+    : columns(0)
+{
+}
+
+void SparseLayer::reset(const QSize &size)
+{
+    tiles.clear();
+    layerSize = size;
+    columns = (size.width() + TileSize - 1) / TileSize;
+}
+
+QSize SparseLayer::size() const
+{
+    return layerSize;
+}
+
+bool SparseLayer::isEmpty() const
+{
+    return tiles.isEmpty();
+}
+
+QImage SparseLayer::tile(int index) const
+{
+    return tiles.value(index);
+}
+
+void SparseLayer::setTile(int index, const QImage &image)
+{
+    if (image.isNull())
+        tiles.remove(index);
+    else
+        tiles.insert(index, image);
+}
+
+QImage &SparseLayer::tileForEdit(int index)
+{
+    QImage &image = tiles[index];
+    if (image.isNull())
+    {
+        image = QImage(tileRect(index).size(), QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+    }
+    return image;
+}
+
+QVector<int> SparseLayer::tileIndexes() const
+{
+    return tiles.keys();
+}
+
+QRect SparseLayer::tileRect(int index) const
+{
+    if (columns <= 0)
+        return QRect();
+    const int column = index % columns;
+    const int row = index / columns;
+    return QRect(column * TileSize, row * TileSize, TileSize, TileSize)
+        .intersected(QRect(QPoint(0, 0), layerSize));
+}
+
+QVector<int> SparseLayer::tilesIn(const QRect &rect) const
+{
+    QVector<int> indexes;
+    const QRect area = rect.intersected(QRect(QPoint(0, 0), layerSize));
+    if (area.isEmpty())
+        return indexes;
+
+    const int firstColumn = area.left() / TileSize;
+    const int lastColumn = area.right() / TileSize;
+    const int firstRow = area.top() / TileSize;
+    const int lastRow = area.bottom() / TileSize;
+    for (int row = firstRow; row <= lastRow; ++row)
+        for (int column = firstColumn; column <= lastColumn; ++column)
+            indexes.append(row * columns + column);
+    return indexes;
+}
+
+void SparseLayer::paint(const QRect &area, const std::function<void(QPainter &)> &draw)
+{
+    for (int index : tilesIn(area))
+    {
+        const QRect rect = tileRect(index);
+        QImage &image = tileForEdit(index);
+
+        // 區塊若仍與歷史共用，QPainter 開始時會先分離出自己的一份
+        QPainter painter(&image);
+        painter.translate(-rect.topLeft());
+        draw(painter);
+    }
+}
+
+void SparseLayer::drawOnto(QPainter &painter, const QRect &rect) const
+{
+    for (int index : tilesIn(rect))
+    {
+        const auto it = tiles.constFind(index);
+        if (it != tiles.cend())
+            painter.drawImage(tileRect(index).topLeft(), it.value());
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef SPARSELAYER_H
+#define SPARSELAYER_H
+
+#include <QImage>
+#include <QRect>
+#include <QHash>
+#include <QVector>
+#include <QPainter>
+#include <functional>
+
+// 稀疏的透明繪圖圖層：切成 64x64 的 ARGB32_Premultiplied 區塊，只有畫過的地方才配置記憶體。
+// 區塊是隱式共享的 QImage，復原歷史可以直接保存參照，繪製時 QPainter 會自動分離
+class SparseLayer
+{
+public:
+    static const int TileSize = 64;
+
+    SparseLayer();
+
+    void reset(const QSize &size);      // 清空所有區塊並設定圖層大小
+    QSize size() const;
+    bool isEmpty() const;               // 沒有任何已配置的區塊
+
+    QImage tile(int index) const;       // 未配置時回傳空影像（代表完全透明）
+    void setTile(int index, const QImage &image);   // image 為空影像時移除該區塊
+    // 直接修改像素用：未配置時建立透明區塊；仍與歷史共用時由呼叫端寫入前的 bits() 分離
+    QImage &tileForEdit(int index);
+    QVector<int> tileIndexes() const;
+    QRect tileRect(int index) const;
+    QVector<int> tilesIn(const QRect &rect) const;  // 與 rect 相交的所有區塊編號
+
+    // 在 area 範圍內繪製：依需要建立透明區塊，draw 收到的畫筆座標為圖層座標
+    void paint(const QRect &area, const std::function<void(QPainter &)> &draw);
+
+    // 把 rect 範圍內已配置的區塊疊到 painter 上（painter 座標即圖層座標）
+    void drawOnto(QPainter &painter, const QRect &rect) const;
+
+private:
+    QHash<int, QImage> tiles;
+    QSize  layerSize;
+    int    columns;
+};
+
+#endif // SPARSELAYER_H
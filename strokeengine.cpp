@@ -0,0 +1,373 @@
+#include "strokeengine.h"
+#include "simdsupport.h"
+#include <QtMath>
+#include <cstring>
+#include <cmath>
+
+namespace {
+
+const int SubSteps = 4;             // 筆刷印中心以 1/4 像素對齊
+const double FlattenStep = 1.0;     // 曲線切成直線段的長度（像素）
+const double MinDistance = 0.01;    // 與上一個輸入點距離小於此值時忽略
+
+/*------------------------------ 混合核心 ------------------------------*/
+
+// 與 QPainter 相同的 8 位元乘法：x * a / 255 四捨五入
+inline quint32 byteMul(quint32 x, quint32 a)
+{
+    const quint32 t = x * a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+inline quint32 pixelMul(quint32 pixel, quint32 a)
+{
+    return byteMul(pixel & 0xff, a)
+         | byteMul((pixel >> 8) & 0xff, a) << 8
+         | byteMul((pixel >> 16) & 0xff, a) << 16
+         | byteMul(pixel >> 24, a) << 24;
+}
+
+// dst = color * alpha + dst * (1 - color 的 alpha * alpha)，像素皆為預乘 ARGB32；alpha 為 0 的像素不動
+void blendSpanScalar(quint32 *dst, const uchar *alpha, int count, quint32 color)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        if (!alpha[i])
+            continue;
+        const quint32 source = pixelMul(color, alpha[i]);
+        dst[i] = source + pixelMul(dst[i], 255 - (source >> 24));
+    }
+}
+
+#if defined(IP_X86_SIMD)
+
+// 16 位元的 x * a / 255，與 byteMul 逐位元相同
+IP_TARGET("sse2")
+inline __m128i byteMul16(__m128i x, __m128i a)
+{
+    const __m128i t = _mm_add_epi16(_mm_mullo_epi16(x, a), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// 一次 4 個像素，每個像素展開成 4 個 16 位元通道；4 個 alpha 全為 0（筆刷印外圍）時整組跳過
+IP_TARGET("sse2")
+void blendSpanSse2(quint32 *dst, const uchar *alpha, int count, quint32 color)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i colors = _mm_unpacklo_epi8(_mm_set1_epi32(int(color)), zero);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        quint32 quad;
+        std::memcpy(&quad, alpha + i, 4);
+        if (!quad)
+            continue;
+        const __m128i a16 = _mm_unpacklo_epi8(_mm_cvtsi32_si128(int(quad)), zero);
+        const __m128i a32 = _mm_unpacklo_epi16(a16, a16);
+        const __m128i aLo = _mm_unpacklo_epi32(a32, a32);
+        const __m128i aHi = _mm_unpackhi_epi32(a32, a32);
+
+        const __m128i sLo = byteMul16(colors, aLo);
+        const __m128i sHi = byteMul16(colors, aHi);
+        const __m128i invLo = _mm_sub_epi16(full, _mm_shufflehi_epi16(_mm_shufflelo_epi16(sLo, 0xff), 0xff));
+        const __m128i invHi = _mm_sub_epi16(full, _mm_shufflehi_epi16(_mm_shufflelo_epi16(sHi, 0xff), 0xff));
+
+        __m128i *p = reinterpret_cast<__m128i *>(dst + i);
+        const __m128i d = _mm_loadu_si128(p);
+        const __m128i dLo = byteMul16(_mm_unpacklo_epi8(d, zero), invLo);
+        const __m128i dHi = byteMul16(_mm_unpackhi_epi8(d, zero), invHi);
+        _mm_storeu_si128(p, _mm_packus_epi16(_mm_add_epi16(sLo, dLo), _mm_add_epi16(sHi, dHi)));
+    }
+    if (i < count)
+        blendSpanScalar(dst + i, alpha + i, count - i, color);
+}
+
+#endif // IP_X86_SIMD
+
+typedef void (*BlendSpan)(quint32 *dst, const uchar *alpha, int count, quint32 color);
+
+BlendSpan selectBlendSpan()
+{
+#if defined(IP_X86_SIMD)
+    return blendSpanSse2;
+#else
+    return blendSpanScalar;
+#endif
+}
+
+const BlendSpan blendSpan = selectBlendSpan();
+
+/*------------------------------ 平滑曲線 ------------------------------*/
+
+double distance(const QPointF &a, const QPointF &b)
+{
+    return std::hypot(b.x() - a.x(), b.y() - a.y());
+}
+
+// 向心 Catmull-Rom（Barry-Goldman 形式）在 p1 到 p2 之間的點，t 介於 t1 與 t2
+QPointF catmullRom(const QPointF p[4], const double t[4], double at)
+{
+    auto lerp = [at](const QPointF &a, const QPointF &b, double from, double to) {
+        return a * ((to - at) / (to - from)) + b * ((at - from) / (to - from));
+    };
+    const QPointF a1 = lerp(p[0], p[1], t[0], t[1]);
+    const QPointF a2 = lerp(p[1], p[2], t[1], t[2]);
+    const QPointF a3 = lerp(p[2], p[3], t[2], t[3]);
+    const QPointF b1 = lerp(a1, a2, t[0], t[2]);
+    const QPointF b2 = lerp(a2, a3, t[1], t[3]);
+    return lerp(b1, b2, t[1], t[2]);
+}
+
+}
+
+StrokeEngine::StrokeEngine()
+    : layer(nullptr), color(0), alphaTableFor(-1), spacing(1), untilNextDab(0),
+      pointCount(0)
+{
+}
+
+// 半徑 r 的圓在像素中心距離 d 處的覆蓋率取 r + 0.5 - d（限制在 0 到 1），邊緣有一個像素寬的漸層。
+// 回傳複本：QHash 插入時可能重新配置而搬動既有的值，不能讓進行中的筆觸指向快取裡的元素
+StrokeEngine::Brush StrokeEngine::brushFor(int width)
+{
+    static QHash<int, Brush> brushes;
+    const auto it = brushes.constFind(width);
+    if (it != brushes.cend())
+        return it.value();
+
+    Brush brush;
+    const double radius = width / 2.0;
+    brush.radius = qCeil(radius) + 1;
+    brush.size = brush.radius * 2 + 2;      // 多一列給最多 3/4 像素的次像素位移
+    for (int sy = 0; sy < SubSteps; ++sy)
+        for (int sx = 0; sx < SubSteps; ++sx)
+        {
+            const double cx = brush.radius + double(sx) / SubSteps;
+            const double cy = brush.radius + double(sy) / SubSteps;
+            QByteArray mask(brush.size * brush.size, 0);
+            uchar *out = reinterpret_cast<uchar *>(mask.data());
+            for (int y = 0; y < brush.size; ++y)
+                for (int x = 0; x < brush.size; ++x)
+                {
+                    const double d = std::hypot(x + 0.5 - cx, y + 0.5 - cy);
+                    const double value = qBound(0.0, radius + 0.5 - d, 1.0);
+                    out[y * brush.size + x] = uchar(qRound(value * 255));
+                }
+            brush.masks.append(mask);
+        }
+    brushes.insert(width, brush);
+    return brush;
+}
+
+// 覆蓋率從 c 增加到 m 時，再混合 (m - c) / (1 - α·c) 就等於以覆蓋率 m 一次合成（α 為畫筆的 alpha）
+void StrokeEngine::buildAlphaTable(int penAlpha)
+{
+    if (alphaTableFor == penAlpha)
+        return;
+    alphaTableFor = penAlpha;
+    blendAlpha = QByteArray(256 * 256, 0);
+    uchar *table = reinterpret_cast<uchar *>(blendAlpha.data());
+    const double alpha = penAlpha / 255.0;
+    for (int before = 0; before < 256; ++before)
+        for (int after = before + 1; after < 256; ++after)
+        {
+            const double value = (after - before) / (255.0 - alpha * before);
+            table[before * 256 + after] = uchar(qBound(1, qRound(value * 255), 255));
+        }
+}
+
+QRect StrokeEngine::begin(SparseLayer *target, const QPointF &point, const QColor &penColor, int width,
+                          const TouchFunction &touchFunction)
+{
+    layer = target;
+    touch = touchFunction;
+    brush = brushFor(qMax(1, width));
+    color = qPremultiply(penColor.rgba());
+    buildAlphaTable(penColor.alpha());
+    // 筆刷印的間距在細筆時也不超過 1/4 像素的誤差，粗筆時最多 1 像素
+    spacing = qBound(0.25, width / 8.0, 1.0);
+    coverage.clear();
+
+    points[0] = point;
+    pointCount = 1;
+    position = point;
+    untilNextDab = spacing;
+    dabs.append(point);         // 只點一下也留下一個點
+    return flushDabs();
+}
+
+QRect StrokeEngine::addPoint(const QPointF &point)
+{
+    if (!isActive())
+        return QRect();
+    appendPoint(point);
+    return flushDabs();
+}
+
+QRect StrokeEngine::addPoints(const QVector<QPointF> &newPoints)
+{
+    if (!isActive())
+        return QRect();
+    for (const QPointF &point : newPoints)
+        appendPoint(point);
+    return flushDabs();
+}
+
+void StrokeEngine::appendPoint(const QPointF &point)
+{
+    if (distance(points[pointCount - 1], point) < MinDistance)
+        return;
+
+    if (pointCount == 4)
+    {
+        std::memmove(points, points + 1, sizeof(QPointF) * 3);
+        pointCount = 3;
+    }
+    points[pointCount++] = point;
+
+    // 第一段沒有前一個點，以第二個點的對稱點代替，起點的切線沿著第一段
+    if (pointCount == 3)
+        curveTo(points[0] * 2 - points[1], points[0], points[1], points[2]);
+    else if (pointCount == 4)
+        curveTo(points[0], points[1], points[2], points[3]);
+}
+
+QRect StrokeEngine::end()
+{
+    if (!isActive())
+        return QRect();
+
+    // 最後一段以倒數第二個點的對稱點當作下一個點
+    if (pointCount >= 2)
+    {
+        const QPointF &from = points[pointCount - 2];
+        const QPointF &to = points[pointCount - 1];
+        const QPointF before = pointCount >= 3 ? points[pointCount - 3] : from * 2 - to;
+        curveTo(before, from, to, to * 2 - from);
+        dabs.append(to);        // 終點不一定剛好落在間距上
+    }
+    const QRect dirty = flushDabs();
+
+    layer = nullptr;
+    touch = TouchFunction();
+    pointCount = 0;
+    coverage.clear();
+    return dirty;
+}
+
+bool StrokeEngine::isActive() const
+{
+    return layer != nullptr;
+}
+
+void StrokeEngine::curveTo(const QPointF &p0, const QPointF &p1, const QPointF &p2, const QPointF &p3)
+{
+    const QPointF p[4] = { p0, p1, p2, p3 };
+    double t[4] = { 0, 0, 0, 0 };
+    for (int i = 1; i < 4; ++i)
+        t[i] = t[i - 1] + qMax(std::sqrt(distance(p[i - 1], p[i])), 1e-4);
+
+    const int steps = qMax(1, qCeil(distance(p1, p2) / FlattenStep));
+    for (int step = 1; step < steps; ++step)
+        walkTo(catmullRom(p, t, t[1] + (t[2] - t[1]) * step / steps));
+    walkTo(p2);
+}
+
+void StrokeEngine::walkTo(const QPointF &point)
+{
+    const double length = distance(position, point);
+    double travelled = 0;
+    while (length - travelled >= untilNextDab)
+    {
+        travelled += untilNextDab;
+        dabs.append(position + (point - position) * (travelled / length));
+        untilNextDab = spacing;
+    }
+    untilNextDab -= length - travelled;
+    position = point;
+}
+
+QRect StrokeEngine::flushDabs()
+{
+    if (dabs.isEmpty())
+        return QRect();
+
+    // 修改前一次告知整批筆刷印的範圍
+    const QRect bounds(QPoint(0, 0), layer->size());
+    QRect dirty;
+    for (const QPointF &center : dabs)
+    {
+        const QPoint origin(qFloor(center.x()) - brush.radius, qFloor(center.y()) - brush.radius);
+        dirty |= QRect(origin, QSize(brush.size + 1, brush.size + 1));
+    }
+    dirty &= bounds;
+    if (!dirty.isEmpty())
+    {
+        if (touch)
+            touch(dirty);
+        for (const QPointF &center : dabs)
+            stamp(center);
+    }
+    dabs.clear();
+    return dirty;
+}
+
+void StrokeEngine::stamp(const QPointF &center)
+{
+    // 中心對齊到 1/4 像素，決定所在的像素與次像素位置
+    const int qx = qFloor(center.x() * SubSteps + 0.5);
+    const int qy = qFloor(center.y() * SubSteps + 0.5);
+    const int px = qFloor(double(qx) / SubSteps);
+    const int py = qFloor(double(qy) / SubSteps);
+    const QByteArray &mask = brush.masks.at((qy - py * SubSteps) * SubSteps + (qx - px * SubSteps));
+    const uchar *maskBits = reinterpret_cast<const uchar *>(mask.constData());
+
+    const QRect dab(px - brush.radius, py - brush.radius, brush.size, brush.size);
+    const QRect area = dab & QRect(QPoint(0, 0), layer->size());
+    const uchar *table = reinterpret_cast<const uchar *>(blendAlpha.constData());
+    uchar alpha[SparseLayer::TileSize];
+
+    for (int index : layer->tilesIn(area))
+    {
+        const QRect tileRect = layer->tileRect(index);
+        const QRect span = tileRect & area;
+        QImage &tile = layer->tileForEdit(index);
+        uchar *tileBits = tile.bits();      // 仍與復原歷史共用時在這裡分離
+        const qsizetype bytesPerLine = tile.bytesPerLine();
+        uchar *covered = coverageTile(index);
+        const int count = span.width();
+
+        for (int y = span.top(); y <= span.bottom(); ++y)
+        {
+            const uchar *want = maskBits + (y - dab.top()) * brush.size + (span.left() - dab.left());
+            uchar *have = covered + (y - tileRect.top()) * SparseLayer::TileSize + (span.left() - tileRect.left());
+            bool changed = false;
+            for (int i = 0; i < count; ++i)
+            {
+                if (want[i] > have[i])
+                {
+                    alpha[i] = table[have[i] * 256 + want[i]];
+                    have[i] = want[i];
+                    changed = true;
+                }
+                else
+                {
+                    alpha[i] = 0;
+                }
+            }
+            if (changed)
+                blendSpan(reinterpret_cast<quint32 *>(tileBits + (y - tileRect.top()) * bytesPerLine)
+                              + (span.left() - tileRect.left()),
+                          alpha, count, color);
+        }
+    }
+}
+
+uchar *StrokeEngine::coverageTile(int index)
+{
+    QByteArray &tile = coverage[index];
+    if (tile.isEmpty())
+        tile = QByteArray(SparseLayer::TileSize * SparseLayer::TileSize, 0);
+    return reinterpret_cast<uchar *>(tile.data());
+}
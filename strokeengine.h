@@ -0,0 +1,69 @@
+#ifndef STROKEENGINE_H
+#define STROKEENGINE_H
+
+#include <QPointF>
+#include <QRect>
+#include <QColor>
+#include <QHash>
+#include <QByteArray>
+#include <QVector>
+#include <functional>
+#include "sparselayer.h"
+
+// 畫筆筆觸引擎：取代每段線條都在圖層上開一個 QPainter 的作法。
+// 輸入點以向心 Catmull-Rom 曲線平滑，沿曲線每隔固定弧長蓋一個預先算好的反鋸齒圓形筆刷印，
+// 只在筆刷印涵蓋的區塊與像素上做 source-over 混合，成本只跟筆觸長度與筆寬有關，與影像大小、放大倍率無關。
+//
+// 同一筆內重疊的筆刷印取覆蓋率的最大值，只把增加的部分混合上去，結果等同整筆只合成一次：
+// 半透明的顏色不會在重疊處變深，筆刷印的間距也不會影響外觀，所以輸入頻率高低畫出來的線條相同。
+// 平滑曲線需要下一個點才能決定切線，每段會晚一個輸入點才畫出，放開時由 end() 補上最後一段。只在 GUI 執行緒使用
+class StrokeEngine
+{
+public:
+    // 修改圖層之前先收到會被改動的範圍（圖層座標），用來讓復原歷史保存原本的區塊
+    typedef std::function<void(const QRect &)> TouchFunction;
+
+    StrokeEngine();
+
+    // 開始一筆並在 point 蓋下第一個筆刷印，回傳修改的範圍
+    QRect begin(SparseLayer *layer, const QPointF &point, const QColor &color, int width,
+                const TouchFunction &touch);
+    QRect addPoint(const QPointF &point);       // 回傳這次修改的範圍，可能是空的
+    QRect addPoints(const QVector<QPointF> &points);    // 一次加入多個點，只修改圖層一次
+    QRect end();                                // 畫完最後一段並結束這一筆
+    bool isActive() const;
+
+private:
+    // 同一個筆寬的筆刷印，依中心的次像素位置各存一份覆蓋率
+    struct Brush
+    {
+        int radius = 0;         // 筆刷印左上角到中心所在像素的距離
+        int size = 0;           // 筆刷印的邊長
+        QVector<QByteArray> masks;
+    };
+
+    static Brush brushFor(int width);           // 遮罩以隱式共用，複製只增加參考計數
+    void buildAlphaTable(int penAlpha);
+    void appendPoint(const QPointF &point);     // 加入輸入點並記下新一段曲線上的筆刷印
+    void curveTo(const QPointF &p0, const QPointF &p1, const QPointF &p2, const QPointF &p3);
+    void walkTo(const QPointF &point);          // 沿直線前進，到了間距就記下一個筆刷印
+    QRect flushDabs();                          // 蓋下記下的筆刷印，回傳修改的範圍
+    void stamp(const QPointF &center);
+    uchar *coverageTile(int index);
+
+    SparseLayer *layer;
+    TouchFunction touch;
+    Brush   brush;                  // 這一筆的筆刷印，持有自己的複本
+    quint32 color;                  // 預乘後的畫筆顏色
+    int     alphaTableFor;          // blendAlpha 對應的畫筆 alpha，-1 表示尚未建立
+    QByteArray blendAlpha;          // [原本覆蓋率 * 256 + 新覆蓋率] → 要再混合上去的比例
+    double  spacing;                // 筆刷印的間距（弧長）
+    double  untilNextDab;           // 距離下一個筆刷印還要前進多少
+    QPointF position;               // 沿曲線前進到的位置
+    QPointF points[4];              // 最近的輸入點，平滑曲線用
+    int     pointCount;
+    QVector<QPointF> dabs;          // 還沒蓋下的筆刷印中心
+    QHash<int, QByteArray> coverage;    // 這一筆在各區塊的覆蓋率（與圖層區塊同樣切法）
+};
+
+#endif // STROKEENGINE_H
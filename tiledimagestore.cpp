@@ -0,0 +1,600 @@
+#include "tiledimagestore.h"
+#include "parallelfor.h"
+#include "rowdecoder.h"
+#include <QDataStream>
+#include <QMutexLocker>
+#include <QVector>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+const char Magic[8] = { 'I', 'P', 'T', 'I', 'L', 'E', 'S', '\0' };
+const quint32 Version = 1;
+const int HeaderSize = 56;
+const qint64 DataAlignment = 4096;  // 區塊資料與縮圖都從分頁邊界開始
+
+struct Header
+{
+    quint32 format = 0;
+    quint32 bytesPerPixel = 0;
+    quint32 tileSize = 0;
+    quint32 width = 0;
+    quint32 height = 0;
+    quint32 overviewWidth = 0;
+    quint32 overviewHeight = 0;
+    quint64 tileOffset = 0;
+    quint64 overviewOffset = 0;
+};
+
+QByteArray encodeHeader(const Header &header)
+{
+    QByteArray bytes;
+    QDataStream stream(&bytes, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.writeRawData(Magic, sizeof(Magic));
+    stream << Version << header.format << header.bytesPerPixel << header.tileSize
+           << header.width << header.height << header.overviewWidth << header.overviewHeight
+           << header.tileOffset << header.overviewOffset;
+    return bytes;
+}
+
+bool decodeHeader(const QByteArray &bytes, Header *header)
+{
+    if (bytes.size() < HeaderSize || std::memcmp(bytes.constData(), Magic, sizeof(Magic)) != 0)
+        return false;
+    QDataStream stream(bytes.mid(sizeof(Magic)));
+    stream.setByteOrder(QDataStream::LittleEndian);
+    quint32 version = 0;
+    stream >> version >> header->format >> header->bytesPerPixel >> header->tileSize
+           >> header->width >> header->height >> header->overviewWidth >> header->overviewHeight
+           >> header->tileOffset >> header->overviewOffset;
+    return version == Version && stream.status() == QDataStream::Ok;
+}
+
+qint64 alignUp(qint64 value)
+{
+    return (value + DataAlignment - 1) / DataAlignment * DataAlignment;
+}
+
+// 只存兩種像素：灰階存 Grayscale8，其餘依是否有 alpha 存 RGB32 或 ARGB32_Premultiplied
+QImage::Format storageFormatFor(QImage::Format format)
+{
+    if (format == QImage::Format_Grayscale8 || format == QImage::Format_Grayscale16)
+        return QImage::Format_Grayscale8;
+    if (format != QImage::Format_Invalid &&
+        QImage::toPixelFormat(format).alphaUsage() == QPixelFormat::UsesAlpha)
+        return QImage::Format_ARGB32_Premultiplied;
+    return QImage::Format_RGB32;
+}
+
+QSize overviewSizeFor(const QSize &size)
+{
+    if (size.width() <= TiledImageStore::OverviewSize && size.height() <= TiledImageStore::OverviewSize)
+        return size;
+    return size.scaled(TiledImageStore::OverviewSize, TiledImageStore::OverviewSize, Qt::KeepAspectRatio)
+        .expandedTo(QSize(1, 1));
+}
+
+}
+
+/*------------------------------ 讀取 ------------------------------*/
+
+TiledImageStore::TiledImageStore()
+    : storedFormat(QImage::Format_Invalid), tile(0), bytesPerPixel(0), tilesX(0),
+      tileOffset(0), overviewOffset(0), mapped(nullptr), useCounter(0)
+{
+}
+
+TiledImageStore::~TiledImageStore()
+{
+    close();
+}
+
+bool TiledImageStore::open(const QString &path)
+{
+    close();
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        error = file.errorString();
+        return false;
+    }
+
+    Header header;
+    if (!decodeHeader(file.read(HeaderSize), &header))
+    {
+        error = QStringLiteral("不是有效的分塊影像檔");
+        file.close();
+        return false;
+    }
+    const QImage::Format format = QImage::Format(header.format);
+    const bool valid = header.width > 0 && header.height > 0 &&
+                       header.width <= quint32(INT_MAX) && header.height <= quint32(INT_MAX) &&
+                       header.tileSize > 0 && header.tileSize <= 4096 &&
+                       ((format == QImage::Format_Grayscale8 && header.bytesPerPixel == 1) ||
+                        ((format == QImage::Format_RGB32 || format == QImage::Format_ARGB32_Premultiplied) &&
+                         header.bytesPerPixel == 4));
+    if (!valid)
+    {
+        error = QStringLiteral("不支援的分塊影像檔頭");
+        file.close();
+        return false;
+    }
+
+    imageSize = QSize(int(header.width), int(header.height));
+    storedFormat = format;
+    tile = int(header.tileSize);
+    bytesPerPixel = int(header.bytesPerPixel);
+    tilesX = (imageSize.width() + tile - 1) / tile;
+    const qint64 tilesY = (imageSize.height() + tile - 1) / tile;
+    overviewDims = QSize(int(header.overviewWidth), int(header.overviewHeight));
+    tileOffset = qint64(header.tileOffset);
+    overviewOffset = qint64(header.overviewOffset);
+
+    const qint64 tileBytes = qint64(tile) * tile * bytesPerPixel;
+    const qint64 end = qMax(tileOffset + tilesX * tilesY * tileBytes,
+                            overviewOffset + qint64(overviewDims.width()) * overviewDims.height() * bytesPerPixel);
+    if (file.size() < end)
+    {
+        error = QStringLiteral("分塊影像檔不完整");
+        close();
+        return false;
+    }
+
+    // 映射失敗（位址空間不足）時不算錯誤，改成讀到哪塊映射哪塊
+    mapped = file.map(0, file.size());
+    error.clear();
+    return true;
+}
+
+void TiledImageStore::close()
+{
+    if (mapped)
+        file.unmap(mapped);
+    mapped = nullptr;
+    for (const MappedTile &tileMap : std::as_const(tileMaps))
+        file.unmap(tileMap.data);
+    tileMaps.clear();
+    file.close();
+    imageSize = QSize();
+    storedFormat = QImage::Format_Invalid;
+}
+
+bool TiledImageStore::isOpen() const
+{
+    return file.isOpen() && imageSize.isValid();
+}
+
+QString TiledImageStore::errorString() const
+{
+    return error;
+}
+
+QSize TiledImageStore::size() const
+{
+    return imageSize;
+}
+
+QImage::Format TiledImageStore::format() const
+{
+    return storedFormat;
+}
+
+int TiledImageStore::tileSize() const
+{
+    return tile;
+}
+
+qint64 TiledImageStore::pixelBytes() const
+{
+    return qint64(imageSize.width()) * imageSize.height() * bytesPerPixel;
+}
+
+TiledImageStore::TileRef::TileRef(const TiledImageStore *store, int tx, int ty)
+    : store(store), index(ty * store->tilesX + tx), bytes(store->acquireTile(index))
+{
+}
+
+TiledImageStore::TileRef::~TileRef()
+{
+    if (bytes && !store->mapped)
+        store->releaseTile(index);
+}
+
+const uchar *TiledImageStore::acquireTile(int index) const
+{
+    const qint64 tileBytes = qint64(tile) * tile * bytesPerPixel;
+    const qint64 offset = tileOffset + index * tileBytes;
+    if (mapped)
+        return mapped + offset;
+
+    QMutexLocker locker(&tileMapMutex);
+    MappedTile &entry = tileMaps[index];
+    if (!entry.data)
+    {
+        // 已映射的區塊太多時解除最久沒用、目前沒人讀取的那些，位址空間只佔固定大小
+        while (tileMaps.size() > MaxMappedTiles)
+        {
+            auto oldest = tileMaps.end();
+            for (auto it = tileMaps.begin(); it != tileMaps.end(); ++it)
+                if (it.value().data && it.value().users == 0 &&
+                    (oldest == tileMaps.end() || it.value().lastUse < oldest.value().lastUse))
+                    oldest = it;
+            if (oldest == tileMaps.end())
+                break;              // 全部都在讀取中，暫時超過上限
+            file.unmap(oldest.value().data);
+            tileMaps.erase(oldest);
+        }
+        // 上面的 erase 可能讓 entry 失效，重新取得
+        MappedTile &fresh = tileMaps[index];
+        fresh.data = file.map(offset, tileBytes);
+        if (!fresh.data)
+        {
+            tileMaps.remove(index);
+            return nullptr;
+        }
+        ++fresh.users;
+        fresh.lastUse = ++useCounter;
+        return fresh.data;
+    }
+    ++entry.users;
+    entry.lastUse = ++useCounter;
+    return entry.data;
+}
+
+void TiledImageStore::releaseTile(int index) const
+{
+    QMutexLocker locker(&tileMapMutex);
+    const auto it = tileMaps.find(index);
+    if (it != tileMaps.end())
+        --it.value().users;
+}
+
+QImage TiledImageStore::overview() const
+{
+    if (!isOpen() || overviewDims.isEmpty())
+        return QImage();
+    QImage result(overviewDims, storedFormat);
+    if (result.isNull())
+        return QImage();
+    const qint64 rowBytes = qint64(overviewDims.width()) * bytesPerPixel;
+
+    QMutexLocker locker(&tileMapMutex);
+    if (!mapped)
+        file.seek(overviewOffset);
+    for (int y = 0; y < overviewDims.height(); ++y)
+    {
+        if (mapped)
+            std::memcpy(result.scanLine(y), mapped + overviewOffset + y * rowBytes, size_t(rowBytes));
+        else if (file.read(reinterpret_cast<char *>(result.scanLine(y)), rowBytes) != rowBytes)
+            return QImage();
+    }
+    return result;
+}
+
+QImage TiledImageStore::readRegion(const QRect &rect) const
+{
+    return readRegion(rect, Parallel::CancelCheck(), nullptr);
+}
+
+QImage TiledImageStore::readRegion(const QRect &rect, const Parallel::CancelCheck &isCancelled,
+                                   QAtomicInteger<qint64> *bytesRead) const
+{
+    const QRect region = rect.intersected(QRect(QPoint(0, 0), imageSize));
+    if (!isOpen() || region.isEmpty())
+        return QImage();
+    QImage result(region.size(), storedFormat);
+    if (result.isNull())
+        return QImage();
+
+    const int firstTileX = region.left() / tile;
+    const int lastTileX = region.right() / tile;
+    const int firstTileY = region.top() / tile;
+    const int lastTileY = region.bottom() / tile;
+
+    // 每一列區塊交給一個執行緒，各自只寫結果影像中不重疊的列
+    const bool finished = Parallel::forEachBand(lastTileY - firstTileY + 1, 1, [&](int first, int last) {
+        for (int ty = firstTileY + first; ty < firstTileY + last; ++ty)
+        {
+            for (int tx = firstTileX; tx <= lastTileX; ++tx)
+            {
+                const QRect part = QRect(tx * tile, ty * tile, tile, tile).intersected(region);
+                const TileRef tileRef(this, tx, ty);
+                const uchar *src = tileRef.data();
+                for (int y = part.top(); y <= part.bottom(); ++y)
+                {
+                    uchar *dst = result.scanLine(y - region.top()) + (part.left() - region.left()) * bytesPerPixel;
+                    if (!src)
+                    {
+                        std::memset(dst, 0, size_t(part.width()) * bytesPerPixel);
+                        continue;
+                    }
+                    const uchar *row = src + (qint64(y - ty * tile) * tile + (part.left() - tx * tile)) * bytesPerPixel;
+                    std::memcpy(dst, row, size_t(part.width()) * bytesPerPixel);
+                }
+            }
+            if (bytesRead)
+            {
+                const QRect rows = QRect(region.left(), ty * tile, region.width(), tile).intersected(region);
+                bytesRead->fetchAndAddRelaxed(qint64(rows.height()) * rows.width() * bytesPerPixel);
+            }
+        }
+    }, isCancelled);
+    return finished ? result : QImage();
+}
+
+QImage TiledImageStore::readRegion(const QRect &rect, int factor) const
+{
+    if (factor <= 1)
+        return readRegion(rect);
+    const QRect region = rect.intersected(QRect(QPoint(0, 0), imageSize));
+    if (!isOpen() || region.isEmpty())
+        return QImage();
+    QImage result((region.width() + factor - 1) / factor, (region.height() + factor - 1) / factor, storedFormat);
+    if (result.isNull())
+        return QImage();
+
+    // 每個輸出像素取涵蓋範圍的中心，邊緣不足一整格時取範圍內的最後一個像素；座標遞增，可以二分搜尋各區塊的範圍
+    QVector<int> xs(result.width());
+    QVector<int> ys(result.height());
+    for (int i = 0; i < xs.size(); ++i)
+        xs[i] = qMin(region.left() + i * factor + factor / 2, region.right());
+    for (int i = 0; i < ys.size(); ++i)
+        ys[i] = qMin(region.top() + i * factor + factor / 2, region.bottom());
+
+    const int firstTileX = region.left() / tile;
+    const int lastTileX = region.right() / tile;
+    const int firstTileY = region.top() / tile;
+    const int lastTileY = region.bottom() / tile;
+
+    Parallel::forEachBand(lastTileY - firstTileY + 1, 1, [&](int first, int last) {
+        for (int ty = firstTileY + first; ty < firstTileY + last; ++ty)
+        {
+            const int rowBegin = int(std::lower_bound(ys.cbegin(), ys.cend(), ty * tile) - ys.cbegin());
+            const int rowEnd = int(std::lower_bound(ys.cbegin(), ys.cend(), (ty + 1) * tile) - ys.cbegin());
+            if (rowBegin == rowEnd)
+                continue;
+            for (int tx = firstTileX; tx <= lastTileX; ++tx)
+            {
+                const int columnBegin = int(std::lower_bound(xs.cbegin(), xs.cend(), tx * tile) - xs.cbegin());
+                const int columnEnd = int(std::lower_bound(xs.cbegin(), xs.cend(), (tx + 1) * tile) - xs.cbegin());
+                if (columnBegin == columnEnd)
+                    continue;
+                const TileRef tileRef(this, tx, ty);
+                const uchar *src = tileRef.data();
+                for (int row = rowBegin; row < rowEnd; ++row)
+                {
+                    uchar *dst = result.scanLine(row) + columnBegin * bytesPerPixel;
+                    if (!src)
+                    {
+                        std::memset(dst, 0, size_t(columnEnd - columnBegin) * bytesPerPixel);
+                        continue;
+                    }
+                    const uchar *line = src + qint64(ys.at(row) - ty * tile) * tile * bytesPerPixel;
+                    for (int column = columnBegin; column < columnEnd; ++column, dst += bytesPerPixel)
+                        std::memcpy(dst, line + (xs.at(column) - tx * tile) * bytesPerPixel, bytesPerPixel);
+                }
+            }
+        }
+    });
+    return result;
+}
+
+QRgb TiledImageStore::pixel(int x, int y) const
+{
+    if (!isOpen() || x < 0 || y < 0 || x >= imageSize.width() || y >= imageSize.height())
+        return 0;
+    const TileRef tileRef(this, x / tile, y / tile);
+    const uchar *src = tileRef.data();
+    if (!src)
+        return 0;
+    const uchar *p = src + (qint64(y % tile) * tile + x % tile) * bytesPerPixel;
+    if (bytesPerPixel == 1)
+        return qRgb(*p, *p, *p);
+    QRgb value;
+    std::memcpy(&value, p, sizeof(value));
+    // 與 QImage::pixel 相同：RGB32 補上不透明 alpha，premultiplied 還原成非預乘的 ARGB
+    return storedFormat == QImage::Format_RGB32 ? (value | 0xff000000u) : qUnpremultiply(value);
+}
+
+bool TiledImageStore::isTiledFile(const QString &path)
+{
+    QFile probe(path);
+    if (!probe.open(QIODevice::ReadOnly))
+        return false;
+    const QByteArray head = probe.read(sizeof(Magic));
+    return head.size() == int(sizeof(Magic)) && std::memcmp(head.constData(), Magic, sizeof(Magic)) == 0;
+}
+
+/*------------------------------ 寫入 ------------------------------*/
+
+TiledImageStore::Writer::Writer()
+    : storedFormat(QImage::Format_Invalid), tile(0), bytesPerPixel(0), nextRow(0)
+{
+}
+
+TiledImageStore::Writer::~Writer()
+{
+    // 沒有 finish 的檔案不完整，直接刪除
+    if (file.isOpen())
+    {
+        file.close();
+        file.remove();
+    }
+}
+
+bool TiledImageStore::Writer::begin(const QString &path, const QSize &size,
+                                    QImage::Format sourceFormat, int tileSize)
+{
+    if (size.isEmpty() || tileSize <= 0 || tileSize > 4096)
+    {
+        error = QStringLiteral("影像大小或區塊大小無效");
+        return false;
+    }
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        error = file.errorString();
+        return false;
+    }
+    imageSize = size;
+    storedFormat = storageFormatFor(sourceFormat);
+    bytesPerPixel = storedFormat == QImage::Format_Grayscale8 ? 1 : 4;
+    tile = tileSize;
+    nextRow = 0;
+    overviewImage = QImage(overviewSizeFor(size), storedFormat);
+    overviewImage.fill(0);
+    // 檔頭在 finish 時才知道縮圖位置，先留空
+    file.write(QByteArray(HeaderSize, '\0'));
+    return true;
+}
+
+bool TiledImageStore::Writer::writeBand(const QImage &band)
+{
+    if (!file.isOpen())
+        return false;
+    const int rows = band.height();
+    if (band.width() != imageSize.width() || rows <= 0 || rows > tile ||
+        (rows < tile && nextRow + rows != imageSize.height()) || nextRow + rows > imageSize.height())
+    {
+        error = QStringLiteral("寫入的列數與區塊不對齊");
+        return false;
+    }
+    const QImage source = band.format() == storedFormat ? band : band.convertToFormat(storedFormat);
+
+    const int tilesX = (imageSize.width() + tile - 1) / tile;
+    const qint64 tileBytes = qint64(tile) * tile * bytesPerPixel;
+    const qint64 tileOffset = alignUp(HeaderSize);
+    const int ty = nextRow / tile;
+    QByteArray buffer(tileBytes, '\0');
+    for (int tx = 0; tx < tilesX; ++tx)
+    {
+        const int columns = qMin(tile, imageSize.width() - tx * tile);
+        buffer.fill('\0');
+        for (int y = 0; y < rows; ++y)
+            std::memcpy(buffer.data() + qint64(y) * tile * bytesPerPixel,
+                        source.constScanLine(y) + qint64(tx) * tile * bytesPerPixel,
+                        size_t(columns) * bytesPerPixel);
+        if (!file.seek(tileOffset + (qint64(ty) * tilesX + tx) * tileBytes) ||
+            file.write(buffer) != tileBytes)
+        {
+            error = file.errorString();
+            return false;
+        }
+    }
+
+    // 縮圖以最近鄰取樣，取落在這段列中的縮圖列
+    const qint64 width = imageSize.width();
+    const qint64 height = imageSize.height();
+    const int overviewWidth = overviewImage.width();
+    const int overviewHeight = overviewImage.height();
+    for (int oy = 0; oy < overviewHeight; ++oy)
+    {
+        const qint64 sy = (2 * qint64(oy) + 1) * height / (2 * overviewHeight);
+        if (sy < nextRow || sy >= nextRow + rows)
+            continue;
+        const uchar *srcLine = source.constScanLine(int(sy - nextRow));
+        uchar *dstLine = overviewImage.scanLine(oy);
+        for (int ox = 0; ox < overviewWidth; ++ox)
+        {
+            const qint64 sx = (2 * qint64(ox) + 1) * width / (2 * overviewWidth);
+            std::memcpy(dstLine + ox * bytesPerPixel, srcLine + sx * bytesPerPixel, size_t(bytesPerPixel));
+        }
+    }
+
+    nextRow += rows;
+    return true;
+}
+
+bool TiledImageStore::Writer::finish()
+{
+    if (!file.isOpen())
+        return false;
+    if (nextRow != imageSize.height())
+    {
+        error = QStringLiteral("影像尚未寫完");
+        return false;
+    }
+
+    const qint64 tilesX = (imageSize.width() + tile - 1) / tile;
+    const qint64 tilesY = (imageSize.height() + tile - 1) / tile;
+    Header header;
+    header.format = quint32(storedFormat);
+    header.bytesPerPixel = quint32(bytesPerPixel);
+    header.tileSize = quint32(tile);
+    header.width = quint32(imageSize.width());
+    header.height = quint32(imageSize.height());
+    header.overviewWidth = quint32(overviewImage.width());
+    header.overviewHeight = quint32(overviewImage.height());
+    header.tileOffset = quint64(alignUp(HeaderSize));
+    header.overviewOffset = quint64(alignUp(qint64(header.tileOffset) + tilesX * tilesY * tile * tile * bytesPerPixel));
+
+    bool ok = file.seek(qint64(header.overviewOffset));
+    const qint64 rowBytes = qint64(overviewImage.width()) * bytesPerPixel;
+    for (int y = 0; ok && y < overviewImage.height(); ++y)
+        ok = file.write(reinterpret_cast<const char *>(overviewImage.constScanLine(y)), rowBytes) == rowBytes;
+    ok = ok && file.seek(0) && file.write(encodeHeader(header)) == HeaderSize;
+    if (!ok)
+    {
+        error = file.errorString();
+        return false;
+    }
+    file.close();
+    overviewImage = QImage();
+    return true;
+}
+
+QString TiledImageStore::Writer::errorString() const
+{
+    return error;
+}
+
+/*------------------------------ 轉換 ------------------------------*/
+
+bool TiledImageStore::save(const QImage &image, const QString &path, int tileSize, QString *error)
+{
+    Writer writer;
+    bool ok = writer.begin(path, image.size(), image.format(), tileSize);
+    for (int y = 0; ok && y < image.height(); y += tileSize)
+        ok = writer.writeBand(image.copy(0, y, image.width(), qMin(tileSize, image.height() - y)));
+    ok = ok && writer.finish();
+    if (!ok && error)
+        *error = writer.errorString();
+    return ok;
+}
+
+bool TiledImageStore::convert(const QString &inputPath, const QString &outputPath, int tileSize, QString *error)
+{
+    // 依序解碼，每段 tileSize 列解出後立刻寫入，整個檔案只解一次，記憶體只需一段列的大小；
+    // 無法逐列解碼的格式直接失敗，不整張讀進來
+    QString message;
+    const std::unique_ptr<RowDecoder> decoder = RowDecoder::open(inputPath, &message);
+    if (!decoder)
+    {
+        if (error)
+            *error = message;
+        return false;
+    }
+
+    const QSize size = decoder->size();
+    Writer writer;
+    bool ok = writer.begin(outputPath, size, decoder->format(), tileSize);
+    for (int y = 0; ok && y < size.height(); y += tileSize)
+    {
+        const QImage band = decoder->readRows(qMin(tileSize, size.height() - y));
+        if (band.isNull())
+        {
+            if (error)
+                *error = decoder->errorString();
+            return false;
+        }
+        ok = writer.writeBand(band);
+    }
+    ok = ok && writer.finish();
+    if (!ok && error)
+        *error = writer.errorString();
+    return ok;
+}
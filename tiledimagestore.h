@@ -0,0 +1,136 @@
+#ifndef TILEDIMAGESTORE_H
+#define TILEDIMAGESTORE_H
+
+#include <QFile>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QRect>
+#include <QSize>
+#include <QString>
+#include <QAtomicInteger>
+#include "parallelfor.h"
+
+// 分塊的原始影像容器（*.iptiles），用來開啟放不進記憶體的超大拼接影像
+//
+// 檔案格式（little-endian）：
+//   [0, 56)           檔頭：magic "IPTILES\0"、版本、QImage::Format、每像素位元組數、
+//                     區塊邊長、寬、高、縮圖寬高、區塊資料位移、縮圖位移
+//   [tileOffset, ...) 區塊依列優先排列，每塊固定 tileSize x tileSize（邊緣補 0），
+//                     第 (tx, ty) 塊位於 tileOffset + (ty * tilesX + tx) * tileBytes
+//   [overviewOffset..) 內嵌縮圖（長邊不超過 OverviewSize），開檔時直接拿來顯示
+//
+// 讀取時把整個檔案 memory-map，只有實際讀到的區塊才會被作業系統載入；
+// 位址空間不足以映射整個檔案時（32 位元程式）改為逐塊映射，只保留最近讀過的 MaxMappedTiles 塊
+class TiledImageStore
+{
+public:
+    static const int DefaultTileSize = 256;
+    static const int OverviewSize = 2048;
+
+    TiledImageStore();
+    ~TiledImageStore();
+
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const;
+    QString errorString() const;
+
+    QSize size() const;
+    QImage::Format format() const;
+    int tileSize() const;
+    qint64 pixelBytes() const;      // 整張影像展開後需要的記憶體大小
+
+    QImage overview() const;                    // 內嵌縮圖
+    QImage readRegion(const QRect &rect) const; // 只讀取 rect 碰到的區塊，超出影像的部分被裁掉
+    // 同上，供背景展開大範圍時使用：每讀完一列區塊把讀到的位元組數加到 bytesRead（可為 nullptr），
+    // isCancelled 為真時中止並回傳空影像
+    QImage readRegion(const QRect &rect, const Parallel::CancelCheck &isCancelled,
+                      QAtomicInteger<qint64> *bytesRead) const;
+    // 以顯示解析度讀取：每 factor x factor 個像素取中心一點（最近鄰），結果大小為 rect 除以 factor 向上取整，
+    // 只碰到有取樣點的區塊，讀取量與顯示大小成正比而不是與 rect 成正比
+    QImage readRegion(const QRect &rect, int factor) const;
+    QRgb pixel(int x, int y) const;             // 讀單一像素（非預乘 ARGB，同 QImage::pixel），只碰到一個區塊
+
+    // 依檔頭判斷是否為本格式
+    static bool isTiledFile(const QString &path);
+
+    // 依序寫入整列區塊的寫入器：每次 writeBand 給 tileSize 列（最後一段可以較少），
+    // 縮圖在寫入過程中一併取樣，整張影像不必同時放在記憶體中
+    class Writer
+    {
+    public:
+        Writer();
+        ~Writer();
+        bool begin(const QString &path, const QSize &size, QImage::Format sourceFormat,
+                   int tileSize = DefaultTileSize);
+        bool writeBand(const QImage &band);
+        bool finish();
+        QString errorString() const;
+
+    private:
+        QFile file;
+        QSize imageSize;
+        QImage::Format storedFormat;
+        int tile;
+        int bytesPerPixel;
+        int nextRow;
+        QImage overviewImage;
+        QString error;
+    };
+
+    // 把記憶體中的影像存成分塊檔
+    static bool save(const QImage &image, const QString &path,
+                     int tileSize = DefaultTileSize, QString *error = nullptr);
+
+    // 把一般影像檔轉成分塊檔：以 RowDecoder 依序逐段解碼一次，不必解出整張；無法逐列解碼的格式回傳 false
+    static bool convert(const QString &inputPath, const QString &outputPath,
+                        int tileSize = DefaultTileSize, QString *error = nullptr);
+
+private:
+    static const int MaxMappedTiles = 256;  // 逐塊映射時最多同時保留的區塊數
+
+    // 讀取中的區塊：逐塊映射時持有期間該區塊不會被解除映射
+    class TileRef
+    {
+    public:
+        TileRef(const TiledImageStore *store, int tx, int ty);
+        ~TileRef();
+        const uchar *data() const { return bytes; }
+
+    private:
+        TileRef(const TileRef &) = delete;
+        TileRef &operator=(const TileRef &) = delete;
+
+        const TiledImageStore *store;
+        int index;
+        const uchar *bytes;
+    };
+
+    struct MappedTile
+    {
+        uchar *data = nullptr;
+        int users = 0;              // 持有中的 TileRef 數，為 0 時才能解除映射
+        quint64 lastUse = 0;
+    };
+
+    const uchar *acquireTile(int index) const;
+    void releaseTile(int index) const;
+
+    mutable QFile file;
+    QSize imageSize;
+    QImage::Format storedFormat;
+    int tile;
+    int bytesPerPixel;
+    int tilesX;
+    QSize overviewDims;
+    qint64 tileOffset;
+    qint64 overviewOffset;
+    uchar *mapped;                  // 整個檔案的映射，逐塊映射時為 nullptr
+    mutable QMutex tileMapMutex;
+    mutable QHash<int, MappedTile> tileMaps;    // 逐塊映射時已映射的區塊，超過上限時解除最久沒用的
+    mutable quint64 useCounter;
+    QString error;
+};
+
+#endif // TILEDIMAGESTORE_H
@@ -0,0 +1,121 @@
+#include "tilehistory.h"
+
+TileHistory::TileHistory(int maxSteps)
+    : maxSteps(maxSteps), inStep(false)
+{
+}
+
+void TileHistory::reset()
+{
+    undoStack.clear();
+    redoStack.clear();
+    pendingBefore.clear();
+    inStep = false;
+}
+
+void TileHistory::beginStep()
+{
+    pendingBefore.clear();
+    inStep = true;
+}
+
+void TileHistory::touch(const SparseLayer &layer, const QRect &rect)
+{
+    if (!inStep)
+        return;
+    // 保存的是圖層目前區塊的參照，不會複製像素
+    for (int index : layer.tilesIn(rect))
+        if (!pendingBefore.contains(index))
+            pendingBefore.insert(index, layer.tile(index));
+}
+
+bool TileHistory::endStep(const SparseLayer &layer)
+{
+    inStep = false;
+    Step step;
+    step.reserve(pendingBefore.size());
+    for (auto it = pendingBefore.cbegin(); it != pendingBefore.cend(); ++it)
+    {
+        TileChange change;
+        change.index = it.key();
+        change.before = it.value();
+        change.after = layer.tile(it.key());
+        // 仍是同一份資料表示這一筆其實沒畫到這個區塊
+        if (change.after.isNull() == change.before.isNull()
+            && change.after.cacheKey() == change.before.cacheKey())
+            continue;
+        step.append(change);
+    }
+    pendingBefore.clear();
+    if (step.isEmpty())
+        return false;
+    pushStep(step);
+    return true;
+}
+
+QRect TileHistory::clear(SparseLayer &layer)
+{
+    Step step;
+    QRect changed;
+    for (int index : layer.tileIndexes())
+    {
+        TileChange change;
+        change.index = index;
+        change.before = layer.tile(index);
+        step.append(change);
+        layer.setTile(index, QImage());
+        changed |= layer.tileRect(index);
+    }
+    if (!step.isEmpty())
+        pushStep(step);
+    return changed;
+}
+
+bool TileHistory::canUndo() const
+{
+    return !undoStack.isEmpty();
+}
+
+bool TileHistory::canRedo() const
+{
+    return !redoStack.isEmpty();
+}
+
+QRect TileHistory::undo(SparseLayer &layer)
+{
+    if (undoStack.isEmpty())
+        return QRect();
+    const Step step = undoStack.takeLast();
+    QRect changed;
+    for (const TileChange &change : step)
+    {
+        layer.setTile(change.index, change.before);
+        changed |= layer.tileRect(change.index);
+    }
+    redoStack.append(step);
+    return changed;
+}
+
+QRect TileHistory::redo(SparseLayer &layer)
+{
+    if (redoStack.isEmpty())
+        return QRect();
+    const Step step = redoStack.takeLast();
+    QRect changed;
+    for (const TileChange &change : step)
+    {
+        layer.setTile(change.index, change.after);
+        changed |= layer.tileRect(change.index);
+    }
+    undoStack.append(step);
+    return changed;
+}
+
+void TileHistory::pushStep(const Step &step)
+{
+    undoStack.append(step);
+    redoStack.clear();
+    // 超過上限時丟掉最舊的記錄，沒有其他參照的區塊會自動釋放
+    while (undoStack.size() > maxSteps)
+        undoStack.removeFirst();
+}
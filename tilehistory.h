@@ -0,0 +1,52 @@
+#ifndef TILEHISTORY_H
+#define TILEHISTORY_H
+
+#include <QImage>
+#include <QRect>
+#include <QHash>
+#include <QVector>
+#include "sparselayer.h"
+
+// 以圖層區塊記錄的復原/重做歷史：每一筆只保存被修改到的區塊。
+// 區塊是隱式共享的 QImage，「修改前」直接參照圖層當時的區塊，繪製時圖層才分離出新的一份，
+// 歷史佔用的記憶體因此只和實際畫過的面積成正比，復原與重做也只需換回這些區塊。
+// 空影像代表「該區塊不存在」（完全透明）
+class TileHistory
+{
+public:
+    explicit TileHistory(int maxSteps = 500);
+
+    void reset();                       // 清空歷史
+
+    // 一筆記錄（例如一次筆畫）：修改圖層的某個範圍之前先呼叫 touch，最後以 endStep 收尾
+    void beginStep();
+    void touch(const SparseLayer &layer, const QRect &rect);
+    bool endStep(const SparseLayer &layer); // 沒有任何區塊被修改時不產生記錄
+
+    // 移除圖層的所有區塊，並記成一筆可復原的記錄；回傳變動範圍
+    QRect clear(SparseLayer &layer);
+
+    bool canUndo() const;
+    bool canRedo() const;
+    QRect undo(SparseLayer &layer);     // 回傳變動範圍，供畫面局部更新
+    QRect redo(SparseLayer &layer);
+
+private:
+    struct TileChange
+    {
+        int index;
+        QImage before;
+        QImage after;
+    };
+    typedef QVector<TileChange> Step;
+
+    void pushStep(const Step &step);
+
+    QVector<Step> undoStack;
+    QVector<Step> redoStack;
+    QHash<int, QImage> pendingBefore;   // 目前這一筆已保存「修改前」的區塊
+    int    maxSteps;
+    bool   inStep;
+};
+
+#endif // TILEHISTORY_H
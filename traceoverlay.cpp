@@ -0,0 +1,42 @@
+#include "traceoverlay.h"
+#include "tracer.h"
+
+TraceOverlay::TraceOverlay(QWidget *parent)
+    : QLabel(parent)
+{
+    setToolTip(QStringLiteral("最近一次操作的耗時與最近 %1 次的 p50/p99").arg(Tracer::WindowSize));
+    refreshTimer = new QTimer(this);
+    refreshTimer->setInterval(250);
+    connect(refreshTimer, &QTimer::timeout, this, &TraceOverlay::refresh);
+    hide();
+}
+
+void TraceOverlay::setActive(bool active)
+{
+    setVisible(active);
+    if (active)
+    {
+        refresh();
+        refreshTimer->start();
+    }
+    else
+    {
+        refreshTimer->stop();
+    }
+}
+
+void TraceOverlay::refresh()
+{
+    const Tracer::OperationStats stats = Tracer::lastOperation();
+    if (stats.samples == 0)
+    {
+        setText(QStringLiteral("追蹤中"));
+        return;
+    }
+    setText(QString("%1 %2 ms  p50 %3  p99 %4  (n=%5)")
+                .arg(stats.name)
+                .arg(stats.lastMs, 0, 'f', 1)
+                .arg(stats.p50Ms, 0, 'f', 1)
+                .arg(stats.p99Ms, 0, 'f', 1)
+                .arg(stats.samples));
+}
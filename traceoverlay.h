@@ -0,0 +1,24 @@
+#ifndef TRACEOVERLAY_H
+#define TRACEOVERLAY_H
+
+#include <QLabel>
+#include <QTimer>
+
+// 狀態列上的延遲顯示：最近一次操作的耗時，以及該操作最近幾次的 p50/p99。
+// 只在追蹤啟用時顯示並定時更新
+class TraceOverlay : public QLabel
+{
+    Q_OBJECT
+
+public:
+    explicit TraceOverlay(QWidget *parent = nullptr);
+    void setActive(bool active);
+
+private slots:
+    void refresh();
+
+private:
+    QTimer *refreshTimer;
+};
+
+#endif // TRACEOVERLAY_H
@@ -0,0 +1,247 @@
+#include "tracer.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QVector>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+QAtomicInt Tracer::enabled(0);
+
+namespace {
+
+struct Event
+{
+    const char *name;
+    qint64 start;
+    qint64 duration;
+};
+
+// 單一執行緒的環狀緩衝：只有擁有的執行緒寫入，寫完事件後才以 release 更新 written。
+// 匯出時若寫入端剛好繞一圈覆寫到正在讀的位置，該筆事件可能不完整；匯出通常在操作之間進行
+struct ThreadBuffer
+{
+    Event events[Tracer::BufferCapacity];
+    QAtomicInteger<quint64> written;
+    int threadId = 0;
+    QString threadName;
+    bool inUse = false;     // 執行緒結束後清為 false，下一個新執行緒沿用這份緩衝
+};
+
+// 緩衝不釋放，執行緒結束後仍可匯出它的事件，直到被新的執行緒沿用；
+// QThreadPool 會回收閒置的執行緒再另開新的，沿用讓緩衝數只跟同時存在的執行緒數有關
+QMutex registryMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+// 執行緒結束時由 thread_local 的解構交還緩衝
+struct BufferOwner
+{
+    ThreadBuffer *buffer = nullptr;
+
+    ~BufferOwner()
+    {
+        if (!buffer)
+            return;
+        QMutexLocker locker(&registryMutex);
+        buffer->inUse = false;
+    }
+};
+
+thread_local BufferOwner currentBuffer;
+
+QAtomicInteger<qint64> clearedAt(0);   // 早於此時間的事件在匯出時略過
+
+// 每個操作最近 WindowSize 次的耗時，環狀覆寫
+struct OperationWindow
+{
+    QVector<qint64> samples;
+    int next = 0;
+};
+
+QMutex statsMutex;
+QHash<QByteArray, OperationWindow> windows;
+QByteArray lastName;
+qint64 lastDuration = 0;
+
+QElapsedTimer &traceClock()
+{
+    static QElapsedTimer timer = []() {
+        QElapsedTimer t;
+        t.start();
+        return t;
+    }();
+    return timer;
+}
+
+ThreadBuffer *bufferForThisThread()
+{
+    if (currentBuffer.buffer)
+        return currentBuffer.buffer;
+    QThread *thread = QThread::currentThread();
+    QMutexLocker locker(&registryMutex);
+    // 優先沿用已結束執行緒的緩衝，捨棄它留下的事件
+    ThreadBuffer *buffer = nullptr;
+    for (const std::unique_ptr<ThreadBuffer> &candidate : registry)
+        if (!candidate->inUse)
+        {
+            buffer = candidate.get();
+            buffer->written.storeRelease(0);
+            break;
+        }
+    if (!buffer)
+    {
+        registry.emplace_back(new ThreadBuffer);
+        buffer = registry.back().get();
+        buffer->threadId = int(registry.size());
+    }
+    buffer->inUse = true;
+    if (!thread->objectName().isEmpty())
+        buffer->threadName = thread->objectName();
+    else if (QCoreApplication::instance() && thread == QCoreApplication::instance()->thread())
+        buffer->threadName = QStringLiteral("GUI");
+    else
+        buffer->threadName = QString("worker %1").arg(buffer->threadId);
+    currentBuffer.buffer = buffer;
+    return buffer;
+}
+
+// 排序後取最近秩的百分位數
+double percentileMs(const QVector<qint64> &sorted, int percent)
+{
+    if (sorted.isEmpty())
+        return 0;
+    return sorted.at((sorted.size() - 1) * percent / 100) / 1e6;
+}
+
+}
+
+void Tracer::setEnabled(bool on)
+{
+    traceClock();   // 第一次啟用時開始計時
+    enabled.storeRelaxed(on ? 1 : 0);
+}
+
+void Tracer::clear()
+{
+    clearedAt.storeRelaxed(now());
+    QMutexLocker locker(&statsMutex);
+    windows.clear();
+    lastName.clear();
+    lastDuration = 0;
+}
+
+qint64 Tracer::now()
+{
+    return traceClock().nsecsElapsed();
+}
+
+void Tracer::record(const char *name, qint64 start, qint64 duration, bool operation)
+{
+    ThreadBuffer *buffer = bufferForThisThread();
+    const quint64 index = buffer->written.loadRelaxed();
+    buffer->events[index % BufferCapacity] = { name, start, duration };
+    buffer->written.storeRelease(index + 1);
+
+    if (!operation)
+        return;
+    // 操作是使用者觸發的，頻率低，取鎖的成本可以忽略
+    QMutexLocker locker(&statsMutex);
+    OperationWindow &window = windows[QByteArray(name)];
+    if (window.samples.size() < WindowSize)
+        window.samples.append(duration);
+    else
+        window.samples[window.next] = duration;
+    window.next = (window.next + 1) % WindowSize;
+    lastName = name;
+    lastDuration = duration;
+}
+
+Tracer::OperationStats Tracer::lastOperation()
+{
+    OperationStats stats;
+    QVector<qint64> sorted;
+    {
+        QMutexLocker locker(&statsMutex);
+        if (lastName.isEmpty())
+            return stats;
+        stats.name = QString::fromLatin1(lastName);
+        stats.lastMs = lastDuration / 1e6;
+        sorted = windows.value(lastName).samples;
+    }
+    std::sort(sorted.begin(), sorted.end());
+    stats.samples = sorted.size();
+    stats.p50Ms = percentileMs(sorted, 50);
+    stats.p99Ms = percentileMs(sorted, 99);
+    return stats;
+}
+
+bool Tracer::exportChromeTrace(const QString &path, QString *error)
+{
+    const qint64 since = clearedAt.loadRelaxed();
+    QJsonArray events;
+    QJsonObject process;
+    process["name"] = QStringLiteral("process_name");
+    process["ph"] = QStringLiteral("M");
+    process["pid"] = 1;
+    process["args"] = QJsonObject{ { "name", QStringLiteral("ImageProcessor") } };
+    events.append(process);
+    {
+        QMutexLocker locker(&registryMutex);
+        for (const std::unique_ptr<ThreadBuffer> &buffer : registry)
+        {
+            const quint64 written = buffer->written.loadAcquire();
+            if (written == 0)
+                continue;           // 剛被沿用、還沒有事件
+            QJsonObject thread;
+            thread["name"] = QStringLiteral("thread_name");
+            thread["ph"] = QStringLiteral("M");
+            thread["pid"] = 1;
+            thread["tid"] = buffer->threadId;
+            thread["args"] = QJsonObject{ { "name", buffer->threadName } };
+            events.append(thread);
+
+            const quint64 first = written > quint64(BufferCapacity) ? written - BufferCapacity : 0;
+            for (quint64 i = first; i < written; ++i)
+            {
+                const Event &event = buffer->events[i % BufferCapacity];
+                if (event.start < since)
+                    continue;
+                // 完整事件（ph = X），時間單位為微秒
+                QJsonObject row;
+                row["name"] = QString::fromLatin1(event.name);
+                row["ph"] = QStringLiteral("X");
+                row["pid"] = 1;
+                row["tid"] = buffer->threadId;
+                row["ts"] = event.start / 1000.0;
+                row["dur"] = event.duration / 1000.0;
+                events.append(row);
+            }
+        }
+    }
+
+    QJsonObject root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = QStringLiteral("ms");
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        if (error)
+            *error = file.errorString();
+        return false;
+    }
+    if (file.write(QJsonDocument(root).toJson(QJsonDocument::Compact)) < 0)
+    {
+        if (error)
+            *error = file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,797 @@
+#include "warpengine.h"
+#include "simdsupport.h"
+#include "parallelfor.h"
+#include "pixelformats.h"
+#include <QRectF>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const int TileSize = 64;           // 目的區塊邊長，讓來源的斜向存取留在快取內
+const double CoordLimit = 30000.0; // 16.16 定點座標可表示的安全範圍
+
+// 反向映射的來源影像
+struct WarpSource
+{
+    const uchar *bits;
+    qsizetype bytesPerLine;
+    int width;
+    int height;
+};
+
+// 一列目的像素的取樣核心：起點 (fx, fy) 與每像素增量 (dfx, dfy) 皆為 16.16 定點數
+typedef void (*RowKernel)(const WarpSource &src, uchar *dst, int count,
+                          int fx, int fy, int dfx, int dfy);
+
+/*------------------------------ 純量核心 ------------------------------*/
+
+inline quint32 fetch32(const WarpSource &s, int x, int y)
+{
+    if (uint(x) >= uint(s.width) || uint(y) >= uint(s.height))
+        return 0;
+    return reinterpret_cast<const quint32 *>(s.bits + y * s.bytesPerLine)[x];
+}
+
+inline uint fetch8(const WarpSource &s, int x, int y)
+{
+    if (uint(x) >= uint(s.width) || uint(y) >= uint(s.height))
+        return 0;
+    return s.bits[y * s.bytesPerLine + x];
+}
+
+// 兩個 32 位元像素以 0..256 的權重混合，每個通道為 (a*(256-w) + b*w) >> 8；
+// SIMD 核心使用完全相同的算式，輸出與純量版逐位元一致
+inline quint32 lerp32(quint32 a, quint32 b, uint w)
+{
+    const uint iw = 256 - w;
+    const quint32 rb = (((a & 0x00ff00ff) * iw + (b & 0x00ff00ff) * w) >> 8) & 0x00ff00ff;
+    const quint32 ag = ((((a >> 8) & 0x00ff00ff) * iw + ((b >> 8) & 0x00ff00ff) * w) >> 8) & 0x00ff00ff;
+    return rb | (ag << 8);
+}
+
+inline uint lerp8(uint a, uint b, uint w)
+{
+    return (a * (256 - w) + b * w) >> 8;
+}
+
+void bilinear32Scalar(const WarpSource &s, uchar *dst, int count, int fx, int fy, int dfx, int dfy)
+{
+    quint32 *out = reinterpret_cast<quint32 *>(dst);
+    for (int i = 0; i < count; ++i, fx += dfx, fy += dfy)
+    {
+        const int x0 = fx >> 16;
+        const int y0 = fy >> 16;
+        const uint wx = (fx >> 8) & 0xff;
+        const uint wy = (fy >> 8) & 0xff;
+        quint32 tl, tr, bl, br;
+        if (x0 >= 0 && y0 >= 0 && x0 < s.width - 1 && y0 < s.height - 1)
+        {
+            const quint32 *r0 = reinterpret_cast<const quint32 *>(s.bits + y0 * s.bytesPerLine) + x0;
+            const quint32 *r1 = reinterpret_cast<const quint32 *>(s.bits + (y0 + 1) * s.bytesPerLine) + x0;
+            tl = r0[0]; tr = r0[1];
+            bl = r1[0]; br = r1[1];
+        }
+        else if (x0 < -1 || y0 < -1 || x0 >= s.width || y0 >= s.height)
+        {
+            out[i] = 0;
+            continue;
+        }
+        else
+        {
+            // 影像邊緣：超出範圍的取樣點視為透明
+            tl = fetch32(s, x0, y0);     tr = fetch32(s, x0 + 1, y0);
+            bl = fetch32(s, x0, y0 + 1); br = fetch32(s, x0 + 1, y0 + 1);
+        }
+        out[i] = lerp32(lerp32(tl, tr, wx), lerp32(bl, br, wx), wy);
+    }
+}
+
+void nearest32Scalar(const WarpSource &s, uchar *dst, int count, int fx, int fy, int dfx, int dfy)
+{
+    quint32 *out = reinterpret_cast<quint32 *>(dst);
+    for (int i = 0; i < count; ++i, fx += dfx, fy += dfy)
+        out[i] = fetch32(s, fx >> 16, fy >> 16);
+}
+
+void bilinear8Scalar(const WarpSource &s, uchar *dst, int count, int fx, int fy, int dfx, int dfy)
+{
+    for (int i = 0; i < count; ++i, fx += dfx, fy += dfy)
+    {
+        const int x0 = fx >> 16;
+        const int y0 = fy >> 16;
+        const uint wx = (fx >> 8) & 0xff;
+        const uint wy = (fy >> 8) & 0xff;
+        uint tl, tr, bl, br;
+        if (x0 >= 0 && y0 >= 0 && x0 < s.width - 1 && y0 < s.height - 1)
+        {
+            const uchar *r0 = s.bits + y0 * s.bytesPerLine + x0;
+            const uchar *r1 = r0 + s.bytesPerLine;
+            tl = r0[0]; tr = r0[1];
+            bl = r1[0]; br = r1[1];
+        }
+        else if (x0 < -1 || y0 < -1 || x0 >= s.width || y0 >= s.height)
+        {
+            dst[i] = 0;
+            continue;
+        }
+        else
+        {
+            tl = fetch8(s, x0, y0);     tr = fetch8(s, x0 + 1, y0);
+            bl = fetch8(s, x0, y0 + 1); br = fetch8(s, x0 + 1, y0 + 1);
+        }
+        dst[i] = uchar(lerp8(lerp8(tl, tr, wx), lerp8(bl, br, wx), wy));
+    }
+}
+
+void nearest8Scalar(const WarpSource &s, uchar *dst, int count, int fx, int fy, int dfx, int dfy)
+{
+    for (int i = 0; i < count; ++i, fx += dfx, fy += dfy)
+        dst[i] = uchar(fetch8(s, fx >> 16, fy >> 16));
+}
+
+inline quint64 fetch64(const WarpSource &s, int x, int y)
+{
+    if (uint(x) >= uint(s.width) || uint(y) >= uint(s.height))
+        return 0;
+    return reinterpret_cast<const quint64 *>(s.bits + y * s.bytesPerLine)[x];
+}
+
+// RGBA64：四個 16 位元通道，與 lerp32 相同的算式；乘積小於 2^24，兩個通道一組放在 32 位元欄位內
+inline quint64 lerp64(quint64 a, quint64 b, uint w)
+{
+    const quint64 mask = Q_UINT64_C(0x0000ffff0000ffff);
+    const quint64 iw = 256 - w;
+    const quint64 even = (((a & mask) * iw + (b & mask) * w) >> 8) & mask;
+    const quint64 odd = ((((a >> 16) & mask) * iw + ((b >> 16) & mask) * w) >> 8) & mask;
+    return even | (odd << 16);
+}
+
+void bilinear64Scalar(const WarpSource &s, uchar *dst, int count, int fx, int fy, int dfx, int dfy)
+{
+    quint64 *out = reinterpret_cast<quint64 *>(dst);
+    for (int i = 0; i < count; ++i, fx += dfx, fy += dfy)
+    {
+        const int x0 = fx >> 16;
+        const int y0 = fy >> 16;
+        const uint wx = (fx >> 8) & 0xff;
+        const uint wy = (fy >> 8) & 0xff;
+        quint64 tl, tr, bl, br;
+        if (x0 >= 0 && y0 >= 0 && x0 < s.width - 1 && y0 < s.height - 1)
+        {
+            const quint64 *r0 = reinterpret_cast<const quint64 *>(s.bits + y0 * s.bytesPerLine) + x0;
+            const quint64 *r1 = reinterpret_cast<const quint64 *>(s.bits + (y0 + 1) * s.bytesPerLine) + x0;
+            tl = r0[0]; tr = r0[1];
+            bl = r1[0]; br = r1[1];
+        }
+        else if (x0 < -1 || y0 < -1 || x0 >= s.width || y0 >= s.height)
+        {
+            out[i] = 0;
+            continue;
+        }
+        else
+        {
+            tl = fetch64(s, x0, y0);     tr = fetch64(s, x0 + 1, y0);
+            bl = fetch64(s, x0, y0 + 1); br = fetch64(s, x0 + 1, y0 + 1);
+        }
+        out[i] = lerp64(lerp64(tl, tr, wx), lerp64(bl, br, wx), wy);
+    }
+}
+
+void nearest64Scalar(const WarpSource &s, uchar *dst, int count, int fx, int fy, int dfx, int dfy)
+{
+    quint64 *out = reinterpret_cast<quint64 *>(dst);
+    for (int i = 0; i < count; ++i, fx += dfx, fy += dfy)
+        out[i] = fetch64(s, fx >> 16, fy >> 16);
+}
+
+/*------------------------------ SIMD 核心 ------------------------------*/
+
+#if defined(IP_X86_SIMD)
+
+// SSE4.1：32 位元雙線性，一次一個像素，四個通道在 16 位元欄位內同時運算
+IP_TARGET("sse4.1")
+void bilinear32Sse41(const WarpSource &s, uchar *dst, int count, int fx, int fy, int dfx, int dfy)
+{
+    quint32 *out = reinterpret_cast<quint32 *>(dst);
+    for (int i = 0; i < count; ++i, fx += dfx, fy += dfy)
+    {
+        const int x0 = fx >> 16;
+        const int y0 = fy >> 16;
+        if (!(x0 >= 0 && y0 >= 0 && x0 < s.width - 1 && y0 < s.height - 1))
+        {
+            bilinear32Scalar(s, dst + i * 4, 1, fx, fy, dfx, dfy);
+            continue;
+        }
+        const short wx = short((fx >> 8) & 0xff);
+        const short wy = short((fy >> 8) & 0xff);
+        const uchar *r0 = s.bits + y0 * s.bytesPerLine + x0 * 4;
+        const __m128i weightX = _mm_setr_epi16(256 - wx, 256 - wx, 256 - wx, 256 - wx, wx, wx, wx, wx);
+        // 低 64 位元為左像素、高 64 位元為右像素
+        __m128i top = _mm_mullo_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(r0))), weightX);
+        __m128i bottom = _mm_mullo_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(r0 + s.bytesPerLine))), weightX);
+        top = _mm_srli_epi16(_mm_add_epi16(top, _mm_srli_si128(top, 8)), 8);
+        bottom = _mm_srli_epi16(_mm_add_epi16(bottom, _mm_srli_si128(bottom, 8)), 8);
+        __m128i result = _mm_add_epi16(_mm_mullo_epi16(top, _mm_set1_epi16(256 - wy)),
+                                       _mm_mullo_epi16(bottom, _mm_set1_epi16(wy)));
+        result = _mm_srli_epi16(result, 8);
+        out[i] = quint32(_mm_cvtsi128_si32(_mm_packus_epi16(result, result)));
+    }
+}
+
+// SSE4.1：Grayscale8 雙線性，一次四個像素
+IP_TARGET("sse4.1")
+void bilinear8Sse41(const WarpSource &s, uchar *dst, int count, int fx, int fy, int dfx, int dfy)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        int taps[4][4];
+        int weights[2][4];
+        bool inside = true;
+        for (int k = 0; k < 4 && inside; ++k)
+        {
+            const int px = fx + (i + k) * dfx;
+            const int py = fy + (i + k) * dfy;
+            const int x0 = px >> 16;
+            const int y0 = py >> 16;
+            inside = x0 >= 0 && y0 >= 0 && x0 < s.width - 1 && y0 < s.height - 1;
+            if (!inside)
+                break;
+            const uchar *r0 = s.bits + y0 * s.bytesPerLine + x0;
+            taps[0][k] = r0[0];
+            taps[1][k] = r0[1];
+            taps[2][k] = r0[s.bytesPerLine];
+            taps[3][k] = r0[s.bytesPerLine + 1];
+            weights[0][k] = (px >> 8) & 0xff;
+            weights[1][k] = (py >> 8) & 0xff;
+        }
+        if (!inside)
+        {
+            bilinear8Scalar(s, dst + i, 4, fx + i * dfx, fy + i * dfy, dfx, dfy);
+            continue;
+        }
+        const __m128i v256 = _mm_set1_epi32(256);
+        const __m128i wx = _mm_loadu_si128(reinterpret_cast<const __m128i *>(weights[0]));
+        const __m128i wy = _mm_loadu_si128(reinterpret_cast<const __m128i *>(weights[1]));
+        const __m128i iwx = _mm_sub_epi32(v256, wx);
+        const __m128i iwy = _mm_sub_epi32(v256, wy);
+        const __m128i top = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(taps[0])), iwx),
+                                                         _mm_mullo_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(taps[1])), wx)), 8);
+        const __m128i bottom = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(taps[2])), iwx),
+                                                            _mm_mullo_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(taps[3])), wx)), 8);
+        __m128i result = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi32(top, iwy), _mm_mullo_epi32(bottom, wy)), 8);
+        result = _mm_packus_epi32(result, result);
+        result = _mm_packus_epi16(result, result);
+        const int packed = _mm_cvtsi128_si32(result);
+        std::memcpy(dst + i, &packed, 4);
+    }
+    if (i < count)
+        bilinear8Scalar(s, dst + i, count - i, fx + i * dfx, fy + i * dfy, dfx, dfy);
+}
+
+// AVX2：(a*(256-w) + b*w) >> 8，每個 16 位元欄位放一個通道
+IP_TARGET("avx2")
+inline __m256i lerpChannels(__m256i a, __m256i b, __m256i inverseWeight, __m256i weight)
+{
+    return _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(a, inverseWeight),
+                                              _mm256_mullo_epi16(b, weight)), 8);
+}
+
+// AVX2：八個像素的座標與是否完全落在內部
+struct Lanes8
+{
+    __m256i x0;
+    __m256i y0;
+    __m256i wx;  // 0..255 的小數權重
+    __m256i wy;
+};
+
+IP_TARGET("avx2")
+inline Lanes8 splitLanes(__m256i vfx, __m256i vfy)
+{
+    const __m256i fracMask = _mm256_set1_epi32(0xff);
+    Lanes8 lanes;
+    lanes.x0 = _mm256_srai_epi32(vfx, 16);
+    lanes.y0 = _mm256_srai_epi32(vfy, 16);
+    lanes.wx = _mm256_and_si256(_mm256_srli_epi32(vfx, 8), fracMask);
+    lanes.wy = _mm256_and_si256(_mm256_srli_epi32(vfy, 8), fracMask);
+    return lanes;
+}
+
+// x0 在 [0, maxX)、y0 在 [0, maxY) 時為全 1
+IP_TARGET("avx2")
+inline __m256i insideMask(const Lanes8 &lanes, int maxX, int maxY)
+{
+    const __m256i minusOne = _mm256_set1_epi32(-1);
+    const __m256i inX = _mm256_and_si256(_mm256_cmpgt_epi32(lanes.x0, minusOne),
+                                         _mm256_cmpgt_epi32(_mm256_set1_epi32(maxX), lanes.x0));
+    const __m256i inY = _mm256_and_si256(_mm256_cmpgt_epi32(lanes.y0, minusOne),
+                                         _mm256_cmpgt_epi32(_mm256_set1_epi32(maxY), lanes.y0));
+    return _mm256_and_si256(inX, inY);
+}
+
+IP_TARGET("avx2")
+void bilinear32Avx2(const WarpSource &s, uchar *dst, int count, int fx, int fy, int dfx, int dfy)
+{
+    quint32 *out = reinterpret_cast<quint32 *>(dst);
+    const int *base = reinterpret_cast<const int *>(s.bits);
+    const int stride = int(s.bytesPerLine / 4);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i vfx = _mm256_add_epi32(_mm256_set1_epi32(fx), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dfx)));
+    __m256i vfy = _mm256_add_epi32(_mm256_set1_epi32(fy), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dfy)));
+    const __m256i stepX = _mm256_set1_epi32(dfx * 8);
+    const __m256i stepY = _mm256_set1_epi32(dfy * 8);
+    const __m256i vstride = _mm256_set1_epi32(stride);
+    const __m256i lowBytes = _mm256_set1_epi16(0x00ff);
+    const __m256i v256 = _mm256_set1_epi16(256);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const Lanes8 lanes = splitLanes(vfx, vfy);
+        if (_mm256_movemask_epi8(insideMask(lanes, s.width - 1, s.height - 1)) != -1)
+        {
+            bilinear32Scalar(s, dst + i * 4, 8, fx + i * dfx, fy + i * dfy, dfx, dfy);
+        }
+        else
+        {
+            const __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(lanes.y0, vstride), lanes.x0);
+            const __m256i tl = _mm256_i32gather_epi32(base, index, 4);
+            const __m256i tr = _mm256_i32gather_epi32(base + 1, index, 4);
+            const __m256i bl = _mm256_i32gather_epi32(base + stride, index, 4);
+            const __m256i br = _mm256_i32gather_epi32(base + stride + 1, index, 4);
+
+            // 權重複製到每個 32 位元欄位的兩個 16 位元半部
+            const __m256i wx = _mm256_or_si256(lanes.wx, _mm256_slli_epi32(lanes.wx, 16));
+            const __m256i wy = _mm256_or_si256(lanes.wy, _mm256_slli_epi32(lanes.wy, 16));
+            const __m256i iwx = _mm256_sub_epi16(v256, wx);
+            const __m256i iwy = _mm256_sub_epi16(v256, wy);
+
+            const __m256i topRB = lerpChannels(_mm256_and_si256(tl, lowBytes), _mm256_and_si256(tr, lowBytes), iwx, wx);
+            const __m256i topAG = lerpChannels(_mm256_srli_epi16(tl, 8), _mm256_srli_epi16(tr, 8), iwx, wx);
+            const __m256i botRB = lerpChannels(_mm256_and_si256(bl, lowBytes), _mm256_and_si256(br, lowBytes), iwx, wx);
+            const __m256i botAG = lerpChannels(_mm256_srli_epi16(bl, 8), _mm256_srli_epi16(br, 8), iwx, wx);
+            const __m256i rb = lerpChannels(topRB, botRB, iwy, wy);
+            const __m256i ag = lerpChannels(topAG, botAG, iwy, wy);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_or_si256(rb, _mm256_slli_epi16(ag, 8)));
+        }
+        vfx = _mm256_add_epi32(vfx, stepX);
+        vfy = _mm256_add_epi32(vfy, stepY);
+    }
+    if (i < count)
+        bilinear32Scalar(s, dst + i * 4, count - i, fx + i * dfx, fy + i * dfy, dfx, dfy);
+}
+
+IP_TARGET("avx2")
+void nearest32Avx2(const WarpSource &s, uchar *dst, int count, int fx, int fy, int dfx, int dfy)
+{
+    quint32 *out = reinterpret_cast<quint32 *>(dst);
+    const int *base = reinterpret_cast<const int *>(s.bits);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i vfx = _mm256_add_epi32(_mm256_set1_epi32(fx), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dfx)));
+    __m256i vfy = _mm256_add_epi32(_mm256_set1_epi32(fy), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dfy)));
+    const __m256i stepX = _mm256_set1_epi32(dfx * 8);
+    const __m256i stepY = _mm256_set1_epi32(dfy * 8);
+    const __m256i vstride = _mm256_set1_epi32(int(s.bytesPerLine / 4));
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const Lanes8 lanes = splitLanes(vfx, vfy);
+        // 外部像素以遮罩略過讀取，直接得到 0（透明）
+        const __m256i inside = insideMask(lanes, s.width, s.height);
+        const __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(lanes.y0, vstride), lanes.x0);
+        const __m256i pixels = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), base, index, inside, 4);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), pixels);
+        vfx = _mm256_add_epi32(vfx, stepX);
+        vfy = _mm256_add_epi32(vfy, stepY);
+    }
+    if (i < count)
+        nearest32Scalar(s, dst + i * 4, count - i, fx + i * dfx, fy + i * dfy, dfx, dfy);
+}
+
+// 八個 32 位元結果（0..255）壓成八個位元組
+IP_TARGET("avx2")
+inline void storeBytes8(uchar *dst, __m256i values)
+{
+    __m256i packed = _mm256_packus_epi32(values, values);
+    packed = _mm256_packus_epi16(packed, packed);
+    const int low = _mm_cvtsi128_si32(_mm256_castsi256_si128(packed));
+    const int high = _mm_cvtsi128_si32(_mm256_extracti128_si256(packed, 1));
+    std::memcpy(dst, &low, 4);
+    std::memcpy(dst + 4, &high, 4);
+}
+
+// Grayscale8 以 32 位元 gather 一次讀四個位元組，因此要求 x0 + 3 仍在列內，避免讀出緩衝區
+IP_TARGET("avx2")
+void bilinear8Avx2(const WarpSource &s, uchar *dst, int count, int fx, int fy, int dfx, int dfy)
+{
+    const char *base = reinterpret_cast<const char *>(s.bits);
+    const int stride = int(s.bytesPerLine);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i vfx = _mm256_add_epi32(_mm256_set1_epi32(fx), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dfx)));
+    __m256i vfy = _mm256_add_epi32(_mm256_set1_epi32(fy), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dfy)));
+    const __m256i stepX = _mm256_set1_epi32(dfx * 8);
+    const __m256i stepY = _mm256_set1_epi32(dfy * 8);
+    const __m256i vstride = _mm256_set1_epi32(stride);
+    const __m256i byteMask = _mm256_set1_epi32(0xff);
+    const __m256i v256 = _mm256_set1_epi32(256);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const Lanes8 lanes = splitLanes(vfx, vfy);
+        if (_mm256_movemask_epi8(insideMask(lanes, s.width - 3, s.height - 1)) != -1)
+        {
+            bilinear8Scalar(s, dst + i, 8, fx + i * dfx, fy + i * dfy, dfx, dfy);
+        }
+        else
+        {
+            const __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(lanes.y0, vstride), lanes.x0);
+            const __m256i row0 = _mm256_i32gather_epi32(reinterpret_cast<const int *>(base), index, 1);
+            const __m256i row1 = _mm256_i32gather_epi32(reinterpret_cast<const int *>(base + stride), index, 1);
+            const __m256i iwx = _mm256_sub_epi32(v256, lanes.wx);
+            const __m256i iwy = _mm256_sub_epi32(v256, lanes.wy);
+            // 值都小於 2^16，可直接用 16 位元乘法
+            const __m256i top = lerpChannels(_mm256_and_si256(row0, byteMask),
+                                             _mm256_and_si256(_mm256_srli_epi32(row0, 8), byteMask), iwx, lanes.wx);
+            const __m256i bottom = lerpChannels(_mm256_and_si256(row1, byteMask),
+                                                _mm256_and_si256(_mm256_srli_epi32(row1, 8), byteMask), iwx, lanes.wx);
+            storeBytes8(dst + i, lerpChannels(top, bottom, iwy, lanes.wy));
+        }
+        vfx = _mm256_add_epi32(vfx, stepX);
+        vfy = _mm256_add_epi32(vfy, stepY);
+    }
+    if (i < count)
+        bilinear8Scalar(s, dst + i, count - i, fx + i * dfx, fy + i * dfy, dfx, dfy);
+}
+
+IP_TARGET("avx2")
+void nearest8Avx2(const WarpSource &s, uchar *dst, int count, int fx, int fy, int dfx, int dfy)
+{
+    const int *base = reinterpret_cast<const int *>(s.bits);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i vfx = _mm256_add_epi32(_mm256_set1_epi32(fx), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dfx)));
+    __m256i vfy = _mm256_add_epi32(_mm256_set1_epi32(fy), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dfy)));
+    const __m256i stepX = _mm256_set1_epi32(dfx * 8);
+    const __m256i stepY = _mm256_set1_epi32(dfy * 8);
+    const __m256i vstride = _mm256_set1_epi32(int(s.bytesPerLine));
+    const __m256i byteMask = _mm256_set1_epi32(0xff);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const Lanes8 lanes = splitLanes(vfx, vfy);
+        if (_mm256_movemask_epi8(insideMask(lanes, s.width - 3, s.height)) != -1)
+        {
+            nearest8Scalar(s, dst + i, 8, fx + i * dfx, fy + i * dfy, dfx, dfy);
+        }
+        else
+        {
+            const __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(lanes.y0, vstride), lanes.x0);
+            storeBytes8(dst + i, _mm256_and_si256(_mm256_i32gather_epi32(base, index, 1), byteMask));
+        }
+        vfx = _mm256_add_epi32(vfx, stepX);
+        vfy = _mm256_add_epi32(vfy, stepY);
+    }
+    if (i < count)
+        nearest8Scalar(s, dst + i, count - i, fx + i * dfx, fy + i * dfy, dfx, dfy);
+}
+
+// 16 位元通道沒有無號的 pmaddwd：先減去 32768 變成有號數，每組權重總和為 256，最後加回 32768 << 8
+const int Bias16 = 32768 << 8;
+
+// SSE2：RGBA64 雙線性，一次一個像素；先水平混合成 32 位元，再以有號飽和打包成交錯的 16 位元做垂直混合
+IP_TARGET("sse2")
+void bilinear64Sse2(const WarpSource &s, uchar *dst, int count, int fx, int fy, int dfx, int dfy)
+{
+    const __m128i sign = _mm_set1_epi16(qint16(0x8000));
+    const __m128i bias = _mm_set1_epi32(Bias16);
+    const __m128i offset = _mm_set1_epi32(32768);
+    for (int i = 0; i < count; ++i, fx += dfx, fy += dfy)
+    {
+        const int x0 = fx >> 16;
+        const int y0 = fy >> 16;
+        if (!(x0 >= 0 && y0 >= 0 && x0 < s.width - 1 && y0 < s.height - 1))
+        {
+            bilinear64Scalar(s, dst + i * 8, 1, fx, fy, dfx, dfy);
+            continue;
+        }
+        const int wx = (fx >> 8) & 0xff;
+        const int wy = (fy >> 8) & 0xff;
+        const uchar *r0 = s.bits + y0 * s.bytesPerLine + x0 * 8;
+        // 每列讀相鄰兩個像素，交錯成 (左 右) 一組後與 (256-w, w) 做 pmaddwd
+        const __m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r0));
+        const __m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r0 + s.bytesPerLine));
+        const __m128i weightX = _mm_set1_epi32((wx << 16) | (256 - wx));
+        const __m128i rowTop = _mm_add_epi32(_mm_madd_epi16(_mm_xor_si128(_mm_unpacklo_epi16(top, _mm_srli_si128(top, 8)), sign), weightX), bias);
+        const __m128i rowBottom = _mm_add_epi32(_mm_madd_epi16(_mm_xor_si128(_mm_unpacklo_epi16(bottom, _mm_srli_si128(bottom, 8)), sign), weightX), bias);
+        // 減 32768 後打包即為翻轉最高位元的 16 位元值，可直接交錯做垂直的 pmaddwd
+        const __m128i rows = _mm_packs_epi32(_mm_sub_epi32(_mm_srai_epi32(rowTop, 8), offset),
+                                             _mm_sub_epi32(_mm_srai_epi32(rowBottom, 8), offset));
+        __m128i result = _mm_madd_epi16(_mm_unpacklo_epi16(rows, _mm_srli_si128(rows, 8)),
+                                        _mm_set1_epi32((wy << 16) | (256 - wy)));
+        result = _mm_sub_epi32(_mm_srai_epi32(_mm_add_epi32(result, bias), 8), offset);
+        result = _mm_xor_si128(_mm_packs_epi32(result, result), sign);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i * 8), result);
+    }
+}
+
+#endif // IP_X86_SIMD
+
+RowKernel selectKernel(int bytesPerPixel, WarpEngine::Sampling sampling)
+{
+    const bool bilinear = sampling == WarpEngine::Bilinear;
+    if (bytesPerPixel == 8)
+#if defined(IP_X86_SIMD)
+        return bilinear ? bilinear64Sse2 : nearest64Scalar;
+#else
+        return bilinear ? bilinear64Scalar : nearest64Scalar;
+#endif
+    const bool gray = bytesPerPixel == 1;
+#if defined(IP_X86_SIMD)
+    if (Simd::hasAvx2())
+    {
+        if (gray)
+            return bilinear ? bilinear8Avx2 : nearest8Avx2;
+        return bilinear ? bilinear32Avx2 : nearest32Avx2;
+    }
+    if (Simd::hasSse41() && bilinear)
+        return gray ? bilinear8Sse41 : bilinear32Sse41;
+#endif
+    if (gray)
+        return bilinear ? bilinear8Scalar : nearest8Scalar;
+    return bilinear ? bilinear32Scalar : nearest32Scalar;
+}
+
+/*------------------------------ 90/180/270 度 ------------------------------*/
+
+struct Pixel24
+{
+    uchar c[3];
+};
+
+// 目的座標 (x, y) 對應的來源座標：
+// 90 度 (h-1-x 列, y 行)、180 度 (w-1-x, h-1-y)、270 度 (x 列, w-1-y 行)
+template <typename Pixel>
+void rotateQuarterTile(const uchar *src, qsizetype srcBpl, int srcWidth, int srcHeight,
+                       uchar *dst, qsizetype dstBpl, int turns, const QRect &tile)
+{
+    for (int y = tile.top(); y <= tile.bottom(); ++y)
+    {
+        Pixel *out = reinterpret_cast<Pixel *>(dst + y * dstBpl);
+        if (turns == 2)
+        {
+            const Pixel *in = reinterpret_cast<const Pixel *>(src + (srcHeight - 1 - y) * srcBpl);
+            for (int x = tile.left(); x <= tile.right(); ++x)
+                out[x] = in[srcWidth - 1 - x];
+        }
+        else if (turns == 1)
+        {
+            const uchar *column = src + qsizetype(y) * sizeof(Pixel);
+            for (int x = tile.left(); x <= tile.right(); ++x)
+                out[x] = *reinterpret_cast<const Pixel *>(column + (srcHeight - 1 - x) * srcBpl);
+        }
+        else
+        {
+            const uchar *column = src + qsizetype(srcWidth - 1 - y) * sizeof(Pixel);
+            for (int x = tile.left(); x <= tile.right(); ++x)
+                out[x] = *reinterpret_cast<const Pixel *>(column + x * srcBpl);
+        }
+    }
+}
+
+// 判斷 matrix 是否恰好為 90/180/270 度旋轉（QTransform::rotate 對這些角度給出精確的 0 與 ±1）
+int quarterTurns(const QTransform &m)
+{
+    if (m.m11() == 0 && m.m22() == 0 && m.m12() == 1 && m.m21() == -1)
+        return 1;
+    if (m.m11() == -1 && m.m22() == -1 && m.m12() == 0 && m.m21() == 0)
+        return 2;
+    if (m.m11() == 0 && m.m22() == 0 && m.m12() == -1 && m.m21() == 1)
+        return 3;
+    return 0;
+}
+
+QImage rotateQuarter(const QImage &src, int turns, const WarpEngine::CancelCheck &isCancelled)
+{
+    const int w = src.width();
+    const int h = src.height();
+    QImage dst = (turns == 2) ? QImage(w, h, src.format()) : QImage(h, w, src.format());
+    if (dst.isNull())
+        return QImage();
+    dst.setColorTable(src.colorTable());
+    dst.setDotsPerMeterX(turns == 2 ? src.dotsPerMeterX() : src.dotsPerMeterY());
+    dst.setDotsPerMeterY(turns == 2 ? src.dotsPerMeterY() : src.dotsPerMeterX());
+
+    const uchar *srcBits = src.constBits();
+    const qsizetype srcBpl = src.bytesPerLine();
+    uchar *dstBits = dst.bits();
+    const qsizetype dstBpl = dst.bytesPerLine();
+    void (*tileFn)(const uchar *, qsizetype, int, int, uchar *, qsizetype, int, const QRect &) = nullptr;
+    switch (src.depth())
+    {
+    case 8:  tileFn = rotateQuarterTile<quint8>;  break;
+    case 16: tileFn = rotateQuarterTile<quint16>; break;
+    case 24: tileFn = rotateQuarterTile<Pixel24>; break;
+    case 32: tileFn = rotateQuarterTile<quint32>; break;
+    case 64: tileFn = rotateQuarterTile<quint64>; break;
+    default: break;
+    }
+    if (!tileFn)
+        return src.transformed(QTransform().rotate(turns * 90));
+
+    const bool done = Parallel::forEachTile(dst.size(), TileSize, TileSize, [&](const QRect &tile) {
+        tileFn(srcBits, srcBpl, w, h, dstBits, dstBpl, turns, tile);
+    }, isCancelled);
+    return done ? dst : QImage();
+}
+
+// 反向映射 inv 的 16.16 定點座標是否足以涵蓋輸出的 region
+bool withinFixedRange(const QTransform &inv, const QRect &region)
+{
+    const QRectF reach = inv.mapRect(QRectF(region));
+    return qAbs(reach.left()) <= CoordLimit && qAbs(reach.right()) <= CoordLimit &&
+           qAbs(reach.top()) <= CoordLimit && qAbs(reach.bottom()) <= CoordLimit;
+}
+
+// 一般仿射路徑：以反向映射 inv 產生輸出座標中的 region 範圍
+QImage warpRegion(const QImage &src, const QTransform &inv, const QRect &region,
+                  WarpEngine::Sampling sampling, const WarpEngine::CancelCheck &isCancelled)
+{
+    // 正規格式與 32 位元 RGBA 直接以位元組運算（通道順序不影響）；
+    // 其餘格式轉成 premultiplied，每通道超過 8 位元的影像轉成 RGBA64 保留精度
+    QImage::Format sourceFormat = src.format();
+    QImage::Format targetFormat;
+    switch (src.format())
+    {
+    case QImage::Format_Grayscale8:
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_RGBA8888_Premultiplied:
+    case QImage::Format_RGBA64_Premultiplied:
+        targetFormat = src.format();
+        break;
+    case QImage::Format_RGB32:
+        targetFormat = QImage::Format_ARGB32_Premultiplied;
+        break;
+    case QImage::Format_RGBX8888:
+        targetFormat = QImage::Format_RGBA8888_Premultiplied;
+        break;
+    case QImage::Format_RGBA8888:
+        sourceFormat = targetFormat = QImage::Format_RGBA8888_Premultiplied;
+        break;
+    default:
+        sourceFormat = targetFormat = PixelFormats::isDeepFormat(src.format())
+                                          ? QImage::Format_RGBA64_Premultiplied
+                                          : QImage::Format_ARGB32_Premultiplied;
+        break;
+    }
+
+    QImage dst(region.size(), targetFormat);
+    if (dst.isNull())
+        return QImage();
+    dst.setDotsPerMeterX(src.dotsPerMeterX());
+    dst.setDotsPerMeterY(src.dotsPerMeterY());
+
+    // 需要轉換時只轉換 region 反向映射後碰到的來源列（上下各多一列給雙線性與定點誤差）
+    QImage source = src;
+    int firstRow = 0;
+    if (sourceFormat != src.format())
+    {
+        const QRectF reach = inv.mapRect(QRectF(region));
+        firstRow = qMax(0, int(std::floor(reach.top())) - 1);
+        const int lastRow = qMin(src.height() - 1, int(std::ceil(reach.bottom())) + 1);
+        if (firstRow > lastRow)
+        {
+            dst.fill(0);
+            return dst;
+        }
+        QImage band(src.constBits() + qsizetype(firstRow) * src.bytesPerLine(), src.width(),
+                    lastRow - firstRow + 1, src.bytesPerLine(), src.format());
+        band.setColorTable(src.colorTable());
+        source = band.convertToFormat(sourceFormat);
+        if (source.isNull())
+            return QImage();
+    }
+
+    int bytesPerPixel = 4;
+    PixelFormats::dispatch(targetFormat, [&](auto traits) { bytesPerPixel = decltype(traits)::bytesPerPixel; });
+    const RowKernel kernel = selectKernel(bytesPerPixel, sampling);
+    const WarpSource warpSource = { source.constBits(), source.bytesPerLine(), source.width(), source.height() };
+    uchar *dstBits = dst.bits();
+    const qsizetype dstBpl = dst.bytesPerLine();
+
+    // 反向映射的列增量：目的 x 每加 1，來源座標加 (m11, m12)
+    const int dfx = qRound(inv.m11() * 65536.0);
+    const int dfy = qRound(inv.m12() * 65536.0);
+    const double centerShift = sampling == WarpEngine::Bilinear ? 0.5 : 0.0;
+
+    const bool done = Parallel::forEachTile(region.size(), TileSize, TileSize, [&](const QRect &tile) {
+        for (int y = tile.top(); y <= tile.bottom(); ++y)
+        {
+            // 以像素中心取樣；每列起點以倍精度重新計算，避免定點誤差累積；
+            // 來源只轉換了部分列時，y 以 firstRow 為原點
+            const double cx = region.left() + tile.left() + 0.5;
+            const double cy = region.top() + y + 0.5;
+            const double sx = inv.m11() * cx + inv.m21() * cy + inv.dx() - centerShift;
+            const double sy = inv.m12() * cx + inv.m22() * cy + inv.dy() - centerShift - firstRow;
+            kernel(warpSource, dstBits + y * dstBpl + qsizetype(tile.left()) * bytesPerPixel, tile.width(),
+                   int(std::floor(sx * 65536.0 + 0.5)), int(std::floor(sy * 65536.0 + 0.5)), dfx, dfy);
+        }
+    }, isCancelled);
+
+    return done ? dst : QImage();
+}
+
+}
+
+QImage WarpEngine::transformed(const QImage &src, const QTransform &matrix,
+                               Sampling sampling, const CancelCheck &isCancelled)
+{
+    if (src.isNull())
+        return QImage();
+    const Qt::TransformationMode mode = sampling == Bilinear ? Qt::SmoothTransformation
+                                                             : Qt::FastTransformation;
+    if (matrix.type() == QTransform::TxProject)
+        return src.transformed(matrix, mode);
+    if (matrix.isIdentity())
+        return src;
+
+    // 與 QImage::trueMatrix 相同：平移到包圍盒左上角為原點
+    const QRectF srcRect(0, 0, src.width(), src.height());
+    const QRect aligned = matrix.mapRect(srcRect).toAlignedRect();
+    const QTransform mat = matrix * QTransform::fromTranslate(-aligned.x(), -aligned.y());
+
+    const int turns = quarterTurns(mat);
+    if (turns)
+        return rotateQuarter(src, turns, isCancelled);
+
+    QSize targetSize;
+    if (mat.type() <= QTransform::TxScale)
+        targetSize = QSize(qAbs(qRound(mat.m11() * src.width())), qAbs(qRound(mat.m22() * src.height())));
+    else
+        targetSize = mat.mapRect(srcRect).toAlignedRect().size();
+    if (targetSize.isEmpty())
+        return QImage();
+
+    bool invertible = false;
+    const QTransform inv = mat.inverted(&invertible);
+    if (!invertible)
+        return QImage();
+
+    // 超出 16.16 定點數範圍的極大影像交回 Qt 處理
+    const QRect target(QPoint(0, 0), targetSize);
+    if (!withinFixedRange(inv, target))
+        return src.transformed(matrix, mode);
+    return warpRegion(src, inv, target, sampling, isCancelled);
+}
+
+QImage WarpEngine::transformedRegion(const QImage &src, const QTransform &matrix, const QRect &region,
+                                     Sampling sampling, const CancelCheck &isCancelled)
+{
+    if (src.isNull() || region.isEmpty() || matrix.type() == QTransform::TxProject)
+        return QImage();
+
+    bool invertible = false;
+    const QTransform inv = matrix.inverted(&invertible);
+    if (!invertible)
+        return QImage();
+
+    if (!withinFixedRange(inv, region))
+    {
+        // QImage::transformed 的輸出以包圍盒左上角為原點，換算後裁出 region
+        const QRect aligned = matrix.mapRect(QRectF(0, 0, src.width(), src.height())).toAlignedRect();
+        const Qt::TransformationMode mode = sampling == Bilinear ? Qt::SmoothTransformation
+                                                                 : Qt::FastTransformation;
+        return src.transformed(matrix, mode).copy(region.translated(-aligned.topLeft()));
+    }
+    return warpRegion(src, inv, region, sampling, isCancelled);
+}
+
+QImage WarpEngine::rotated(const QImage &src, qreal angle, Sampling sampling, const CancelCheck &isCancelled)
+{
+    QTransform tran;
+    tran.rotate(angle);
+    return transformed(src, tran, sampling, isCancelled);
+}
@@ -0,0 +1,43 @@
+#ifndef WARPENGINE_H
+#define WARPENGINE_H
+
+#include <QImage>
+#include <QTransform>
+#include <functional>
+
+// 仿射變形引擎：取代 QImage::transformed 的旋轉路徑
+// 以 64x64 的目的區塊做反向映射，區塊分散到所有核心；
+// 32 位元（RGB32/ARGB32）與 Grayscale8 有 AVX2/SSE4.1 核心，RGBA64 有 SSE2 雙線性核心，
+// 90/180/270 度則走純記憶體轉置的快速路徑，結果與原圖逐像素相同
+class WarpEngine
+{
+public:
+    enum Sampling
+    {
+        Nearest,    // 最近鄰取樣（對應 Qt::FastTransformation）
+        Bilinear    // 雙線性內插（對應 Qt::SmoothTransformation）
+    };
+
+    // 取消檢查：回傳 true 時引擎在下一個區塊前放棄並回傳空影像
+    typedef std::function<bool()> CancelCheck;
+
+    // 與 QImage::transformed 相同的輸出大小與位置；
+    // 任意角度時 32 位元影像輸出 premultiplied 格式（角落透明），Grayscale8 輸出 Grayscale8（角落為 0），
+    // 每通道超過 8 位元的影像輸出 RGBA64_Premultiplied
+    static QImage transformed(const QImage &src, const QTransform &matrix,
+                              Sampling sampling = Nearest,
+                              const CancelCheck &isCancelled = CancelCheck());
+
+    // matrix 直接把來源映射到輸出座標（不再平移到包圍盒），只產生輸出座標中的 region 範圍；
+    // 輸出格式與任意角度路徑相同，映射不到來源的像素為透明
+    static QImage transformedRegion(const QImage &src, const QTransform &matrix, const QRect &region,
+                                    Sampling sampling = Nearest,
+                                    const CancelCheck &isCancelled = CancelCheck());
+
+    // 便利函式：以角度旋轉
+    static QImage rotated(const QImage &src, qreal angle,
+                          Sampling sampling = Nearest,
+                          const CancelCheck &isCancelled = CancelCheck());
+};
+
+#endif // WARPENGINE_H
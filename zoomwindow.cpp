@@ -1,4 +1,5 @@
 #include "zoomwindow.h"
+#include "tracer.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QFileDialog>
@@ -11,34 +12,39 @@
 
 // 建構子：初始化放大視窗
 ZoomWindow::ZoomWindow(const QImage &sourceImage, const QRect &selectedRect, double zoomFactor, QWidget *parent)
-    : QMainWindow(parent), zoomFactor(zoomFactor), drawing(false), penColor(Qt::red), penWidth(3)
+    : QMainWindow(parent), zoomFactor(zoomFactor), drawing(false), pendingReceived(0), penColor(Qt::red), penWidth(3)
 {
+    TRACE_OPERATION("ZoomWindow");
     setWindowTitle(QStringLiteral("區域放大視窗"));
     
-    // 擷取選取的區域
-    originalImage = sourceImage.copy(selectedRect);
-    
-    // 根據放大倍率縮放圖片
-    int newWidth = originalImage.width() * zoomFactor;
-    int newHeight = originalImage.height() * zoomFactor;
-    zoomedImage = originalImage.scaled(newWidth, newHeight, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    
-    // 建立可繪圖的圖片副本
-    drawingImage = zoomedImage.copy();
+    // 裁切與放大只記錄成運算鏈，不複製選取區域；實際取樣交給畫布在捲動時按需處理，
+    // 開啟時間與倍率無關，每個顯示區塊也只由來源取樣一次
+    const QRect selection = selectedRect.intersected(sourceImage.rect());
+    zoomedSize = selection.size().scaled(selection.width() * zoomFactor,
+                                         selection.height() * zoomFactor,
+                                         Qt::KeepAspectRatio);
+    view = ImageGraph(sourceImage).cropped(selection).scaled(zoomedSize);
+    annotations.reset(zoomedSize);
+    history.reset();
     
     // 建立捲軸區域以容納大圖片
     QScrollArea *scrollArea = new QScrollArea;
-    imageLabel = new QLabel;
-    imageLabel->setPixmap(QPixmap::fromImage(drawingImage));
-    imageLabel->setMouseTracking(true);
-    imageLabel->installEventFilter(this);  // 安裝事件過濾器以捕捉滑鼠事件
-    scrollArea->setWidget(imageLabel);
+    canvas = new ImageCanvas;
+    canvas->setSource(view);
+    canvas->setOverlay(&annotations);
+    canvas->setMouseTracking(true);
+    canvas->installEventFilter(this);  // 安裝事件過濾器以捕捉滑鼠事件
+    scrollArea->setWidget(canvas);
     scrollArea->setWidgetResizable(false);
     
     setCentralWidget(scrollArea);
     
     createActions();
     createToolBars();
+    saver = new ImageSaver(statusBar(), this);
+    latency = new InputLatency(this);
+    frames = new FrameScheduler(this);
+    connect(frames, &FrameScheduler::frame, this, &ZoomWindow::drawPendingPoints);
     
     // 啟用滑鼠追蹤
     setMouseTracking(true);
@@ -68,6 +74,18 @@ void ZoomWindow::createActions()
     clearAction = new QAction(QStringLiteral("清除繪圖"), this);
     clearAction->setStatusTip(QStringLiteral("清除所有繪圖內容"));
     connect(clearAction, &QAction::triggered, this, &ZoomWindow::clearDrawing);
+
+    // 復原/重做動作
+    undoAction = new QAction(QStringLiteral("復原"), this);
+    undoAction->setShortcut(QKeySequence::Undo);
+    undoAction->setStatusTip(QStringLiteral("復原上一筆繪圖"));
+    connect(undoAction, &QAction::triggered, this, &ZoomWindow::undo);
+
+    redoAction = new QAction(QStringLiteral("重做"), this);
+    redoAction->setShortcut(QKeySequence::Redo);
+    redoAction->setStatusTip(QStringLiteral("重做上一筆復原的繪圖"));
+    connect(redoAction, &QAction::triggered, this, &ZoomWindow::redo);
+    updateHistoryActions();
 }
 
 // 建立工具列
@@ -75,8 +93,16 @@ void ZoomWindow::createToolBars()
 {
     toolBar = addToolBar(QStringLiteral("工具"));
     toolBar->addAction(saveAction);
+    presetBox = new QComboBox;
+    for (PngEncoder::Preset preset : { PngEncoder::Fast, PngEncoder::Balanced, PngEncoder::Smallest })
+        presetBox->addItem(PngEncoder::presetName(preset), int(preset));
+    presetBox->setCurrentIndex(presetBox->findData(int(PngEncoder::Balanced)));
+    presetBox->setToolTip(QStringLiteral("PNG 存檔的速度與檔案大小"));
+    toolBar->addWidget(presetBox);
     toolBar->addAction(penColorAction);
     toolBar->addAction(clearAction);
+    toolBar->addAction(undoAction);
+    toolBar->addAction(redoAction);
     
     // 加入畫筆寬度控制
     QLabel *widthLabel = new QLabel(QStringLiteral(" 畫筆寬度: "));
@@ -100,15 +126,12 @@ void ZoomWindow::saveImage()
                                                     "PNG (*.png);;JPEG (*.jpg);;BMP (*.bmp)");
     if (!filename.isEmpty())
     {
-        bool ok = drawingImage.save(filename);
-        if (ok)
-        {
-            statusBar()->showMessage(QStringLiteral("圖片已儲存"), 3000);
-        }
-        else
-        {
-            statusBar()->showMessage(QStringLiteral("儲存失敗"), 3000);
-        }
+        TRACE_OPERATION("ZoomWindow::saveImage");
+        // 運算鏈與圖層都是隱式共享的值，複製後交給工作執行緒合成與編碼；之後繼續繪圖不影響這次存檔
+        const ImageGraph graph = view;
+        const SparseLayer layer = annotations;
+        saver->save([graph, layer]() { return flattenedImage(graph, layer); }, filename, QByteArray(),
+                    PngEncoder::Preset(presetBox->currentData().toInt()));
     }
 }
 
@@ -133,24 +156,64 @@ void ZoomWindow::penWidthChanged(int width)
 // 清除繪圖
 void ZoomWindow::clearDrawing()
 {
-    // 重設為原始放大圖片
-    drawingImage = zoomedImage.copy();
-    imageLabel->setPixmap(QPixmap::fromImage(drawingImage));
+    // 移除繪圖圖層的所有區塊，並記成一筆可復原的記錄
+    canvas->updateRegion(history.clear(annotations));
+    updateHistoryActions();
     statusBar()->showMessage(QStringLiteral("繪圖已清除"), 2000);
 }
 
-// 事件過濾器：處理 imageLabel 上的滑鼠事件
+// 復原上一筆
+void ZoomWindow::undo()
+{
+    if (drawing)
+        return;
+    canvas->updateRegion(history.undo(annotations));
+    updateHistoryActions();
+}
+
+// 重做
+void ZoomWindow::redo()
+{
+    if (drawing)
+        return;
+    canvas->updateRegion(history.redo(annotations));
+    updateHistoryActions();
+}
+
+void ZoomWindow::updateHistoryActions()
+{
+    undoAction->setEnabled(history.canUndo());
+    redoAction->setEnabled(history.canRedo());
+}
+
+QImage ZoomWindow::flattenedImage(const ImageGraph &view, const SparseLayer &annotations)
+{
+    QImage result = view.render();
+    if (annotations.isEmpty())
+        return result;
+    // 畫筆是彩色的；灰階與索引色（倍率為 1 時直接裁切會保留原格式）先轉成 32 位元
+    if (result.depth() <= 8)
+        result = result.convertToFormat(result.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied
+                                                                 : QImage::Format_RGB32);
+    QPainter painter(&result);
+    annotations.drawOnto(painter, result.rect());
+    painter.end();
+    return result;
+}
+
+// 事件過濾器：處理 canvas 上的滑鼠事件
 bool ZoomWindow::eventFilter(QObject *watched, QEvent *event)
 {
-    if (watched == imageLabel && event)
+    if (watched == canvas && event)
     {
         if (event->type() == QEvent::MouseButtonPress)
         {
             QMouseEvent *mouseEvent = static_cast<QMouseEvent*>(event);
             if (mouseEvent && mouseEvent->button() == Qt::LeftButton)
             {
-                lastPoint = mouseEvent->pos();
                 drawing = true;
+                history.beginStep();  // 一次按下到放開為一筆記錄
+                beginStroke(strokePoint(mouseEvent));
                 return true;
             }
         }
@@ -159,7 +222,11 @@ bool ZoomWindow::eventFilter(QObject *watched, QEvent *event)
             QMouseEvent *mouseEvent = static_cast<QMouseEvent*>(event);
             if (mouseEvent && (mouseEvent->buttons() & Qt::LeftButton) && drawing)
             {
-                drawLineTo(mouseEvent->pos());
+                // 只把點排進佇列，下一個畫面一起畫
+                if (pendingPoints.isEmpty())
+                    pendingReceived = InputLatency::timestamp();
+                pendingPoints.append(strokePoint(mouseEvent));
+                frames->requestFrame();
                 return true;
             }
         }
@@ -168,8 +235,11 @@ bool ZoomWindow::eventFilter(QObject *watched, QEvent *event)
             QMouseEvent *mouseEvent = static_cast<QMouseEvent*>(event);
             if (mouseEvent && mouseEvent->button() == Qt::LeftButton && drawing)
             {
-                drawLineTo(mouseEvent->pos());
+                frames->flush();  // 先畫完還在排隊的點
+                finishStroke(strokePoint(mouseEvent));
                 drawing = false;
+                history.endStep(annotations);
+                updateHistoryActions();
                 return true;
             }
         }
@@ -178,15 +248,41 @@ bool ZoomWindow::eventFilter(QObject *watched, QEvent *event)
     return QMainWindow::eventFilter(watched, event);
 }
 
-// 繪製線條從上一個點到當前點
-void ZoomWindow::drawLineTo(const QPoint &endPoint)
+// 游標所在像素的中心（圖層座標），筆觸以像素中心為準
+QPointF ZoomWindow::strokePoint(const QMouseEvent *event)
 {
-    QPainter painter(&drawingImage);
-    painter.setPen(QPen(penColor, penWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
-    painter.drawLine(lastPoint, endPoint);
-    
-    lastPoint = endPoint;
-    
-    // 更新顯示
-    imageLabel->setPixmap(QPixmap::fromImage(drawingImage));
+    return event->position() + QPointF(0.5, 0.5);
+}
+
+void ZoomWindow::beginStroke(const QPointF &point)
+{
+    TRACE_OPERATION("beginStroke");
+    // 修改前先保存會被畫到的區塊
+    const QRect dirty = stroke.begin(&annotations, point, penColor, penWidth, [this](const QRect &rect) {
+        history.touch(annotations, rect);
+    });
+    canvas->updateRegion(dirty);
+}
+
+// 延伸目前的筆觸：這個畫面之前累積的點一次加入，只修改圖層與保存歷史一次。
+// 平滑曲線晚一個點畫出，這次畫的是最後一個點之前的部分
+void ZoomWindow::drawPendingPoints()
+{
+    if (pendingPoints.isEmpty())
+        return;
+    TRACE_OPERATION("drawPendingPoints");
+    const QRect dirty = stroke.addPoints(pendingPoints);
+    if (!dirty.isEmpty())
+        canvas->updateRegion(dirty);
+    latency->inputReceived(InputLatency::Painting, pendingReceived, pendingPoints.size());
+    pendingPoints.clear();
+}
+
+void ZoomWindow::finishStroke(const QPointF &point)
+{
+    TRACE_OPERATION("finishStroke");
+    QRect dirty = stroke.addPoint(point);
+    dirty |= stroke.end();
+    if (!dirty.isEmpty())
+        canvas->updateRegion(dirty);
 }
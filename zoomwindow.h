@@ -12,6 +12,15 @@
 #include <QAction>
 #include <QColorDialog>
 #include <QStatusBar>
+#include <QComboBox>
+#include "imagecanvas.h"
+#include "imagegraph.h"
+#include "imagesaver.h"
+#include "inputlatency.h"
+#include "framescheduler.h"
+#include "sparselayer.h"
+#include "strokeengine.h"
+#include "tilehistory.h"
 
 // 放大視窗類別：用於顯示選取區域的放大圖片，並提供畫筆和存檔功能
 class ZoomWindow : public QMainWindow
@@ -30,29 +39,46 @@ private slots:
     void choosePenColor();      // 選擇畫筆顏色
     void penWidthChanged(int width);  // 畫筆寬度改變
     void clearDrawing();        // 清除繪圖
+    void undo();                // 復原上一筆
+    void redo();                // 重做
+    void drawPendingPoints();   // 每個畫面一次：把累積的拖曳點一起畫上
 
 private:
     void createActions();       // 建立動作
     void createToolBars();      // 建立工具列
-    void drawLineTo(const QPoint &endPoint);  // 繪製線條
+    static QPointF strokePoint(const QMouseEvent *event);  // 滑鼠事件對應的筆觸座標
+    void beginStroke(const QPointF &point);     // 按下：開始一筆
+    void finishStroke(const QPointF &point);    // 放開：畫完最後一段
+    void updateHistoryActions();              // 更新復原/重做按鈕狀態
+    // 放大圖片與繪圖圖層合成的完整影像；只在存檔時於工作執行緒產生，參數是存檔當下的複本
+    static QImage flattenedImage(const ImageGraph &view, const SparseLayer &annotations);
 
-    QLabel *imageLabel;         // 顯示圖片的標籤
-    QImage originalImage;       // 原始選取區域圖片
-    QImage zoomedImage;         // 放大後的圖片
-    QImage drawingImage;        // 用於繪圖的圖片
+    ImageCanvas *canvas;        // 顯示圖片的虛擬畫布（只取樣可見區塊）
+    ImageGraph view;            // 來源 → 裁切選取區域 → 放大，只在需要像素時取樣
+    QSize zoomedSize;           // 放大後的顯示大小
+    SparseLayer annotations;    // 繪圖內容，只為畫過的區塊配置記憶體
     double zoomFactor;          // 放大倍率
     
     // 畫筆相關
     bool drawing;               // 是否正在繪圖
-    QPoint lastPoint;           // 上一個繪圖點
+    StrokeEngine stroke;        // 平滑筆觸與筆刷印混合
+    QVector<QPointF> pendingPoints; // 還沒畫上的拖曳點
+    qint64 pendingReceived;     // 其中最早的事件開始處理的時間
     QColor penColor;            // 畫筆顏色
     int penWidth;               // 畫筆寬度
+    TileHistory history;        // 以區塊記錄的復原/重做歷史
     
     // UI 元件
     QAction *saveAction;        // 存檔動作
     QAction *penColorAction;    // 畫筆顏色動作
     QAction *clearAction;       // 清除動作
+    QAction *undoAction;        // 復原動作
+    QAction *redoAction;        // 重做動作
     QSlider *penWidthSlider;    // 畫筆寬度滑桿
+    QComboBox *presetBox;       // PNG 存檔的速度／大小取捨
+    ImageSaver *saver;          // 背景存檔，存檔時仍可繼續繪圖
+    InputLatency *latency;      // 畫筆從滑鼠事件到畫面更新的延遲
+    FrameScheduler *frames;     // 拖曳點合併到每個畫面畫一次
     QToolBar *toolBar;          // 工具列
 };
 